@@ -0,0 +1,79 @@
+#include <string.h>
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "abssys/abstrace.h"
+
+#define RING_MASK (ABSTRACE_RING_SIZE - 1)
+
+_Static_assert((ABSTRACE_RING_SIZE & RING_MASK) == 0, "ABSTRACE_RING_SIZE must be a power of two");
+
+static const char *TAG = "abstrace";
+
+static abstrace_record_t s_ring[ABSTRACE_RING_SIZE];
+static uint32_t s_next = 0;
+
+static const char *event_name(uint16_t event)
+{
+    switch (event) {
+    case TRACE_TCP_SERVER_ACCEPT: return "server_accept";
+    case TRACE_TCP_SERVER_CLOSE:  return "server_close";
+    case TRACE_TCP_SERVER_RECV:   return "server_recv";
+    case TRACE_TCP_SERVER_SEND:   return "server_send";
+    case TRACE_TCP_SERVER_FRAMES: return "server_frames";
+    case TRACE_TCP_SERVER_STREAM: return "server_stream";
+    case TRACE_TCP_SERVER_TIMEOUT: return "server_timeout";
+    case TRACE_TCP_SERVER_REJECT: return "server_reject";
+    case TRACE_TCP_CLIENT_SEND:   return "client_send";
+    case TRACE_TCP_CLIENT_RECV:   return "client_recv";
+    case TRACE_UDP_SERVER_BATCH:  return "udp_server_batch";
+    case TRACE_UDP_SERVER_SEND:   return "udp_server_send";
+    case TRACE_UDP_CLIENT_SEND:   return "udp_client_send";
+    default:                      return "unknown";
+    }
+}
+
+void abstrace_record(uint16_t event, uint16_t arg0, uint32_t arg1)
+{
+    // Claiming a slot is the only shared write, so concurrent writers never block each other
+    uint32_t index = __atomic_fetch_add(&s_next, 1, __ATOMIC_RELAXED);
+    abstrace_record_t *record = &s_ring[index & RING_MASK];
+
+    record->timestamp_us = (uint32_t)esp_timer_get_time();
+    record->event = event;
+    record->arg0 = arg0;
+    record->arg1 = arg1;
+}
+
+int abstrace_snapshot(abstrace_record_t *records, int max_records)
+{
+    uint32_t next = __atomic_load_n(&s_next, __ATOMIC_RELAXED);
+    uint32_t count = next < ABSTRACE_RING_SIZE ? next : ABSTRACE_RING_SIZE;
+    if (count > (uint32_t)max_records) {
+        count = max_records;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        records[i] = s_ring[(next - count + i) & RING_MASK];
+    }
+    return (int)count;
+}
+
+void abstrace_dump(void)
+{
+    uint32_t next = __atomic_load_n(&s_next, __ATOMIC_RELAXED);
+    uint32_t count = next < ABSTRACE_RING_SIZE ? next : ABSTRACE_RING_SIZE;
+
+    ESP_LOGI(TAG, "%u record(s), %u dropped", (unsigned)count, (unsigned)(next - count));
+    for (uint32_t i = 0; i < count; i++) {
+        abstrace_record_t record = s_ring[(next - count + i) & RING_MASK];
+        ESP_LOGI(TAG, "%10u us  %-14s %5u %10u", (unsigned)record.timestamp_us, event_name(record.event),
+                 (unsigned)record.arg0, (unsigned)record.arg1);
+    }
+}
+
+void abstrace_clear(void)
+{
+    __atomic_store_n(&s_next, 0, __ATOMIC_RELAXED);
+    memset(s_ring, 0, sizeof(s_ring));
+}
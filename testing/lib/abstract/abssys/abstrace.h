@@ -0,0 +1,67 @@
+#ifndef ABSTRACE_H
+#define ABSTRACE_H
+
+#include <stdint.h>
+
+/// @brief Number of records kept in the trace ring (must be a power of two)
+#ifndef ABSTRACE_RING_SIZE
+#define ABSTRACE_RING_SIZE 256
+#endif
+
+/// @brief Trace event identifiers; each module owns a range of 0x100 ids
+typedef enum {
+    TRACE_TCP_SERVER_ACCEPT = 0x0100,  ///< arg0 = socket, arg1 = peer IPv4 address (network order)
+    TRACE_TCP_SERVER_CLOSE,            ///< arg0 = socket
+    TRACE_TCP_SERVER_RECV,             ///< arg0 = socket, arg1 = bytes received
+    TRACE_TCP_SERVER_SEND,             ///< arg0 = socket, arg1 = bytes sent
+    TRACE_TCP_SERVER_FRAMES,           ///< arg0 = socket, arg1 = messages framed from one read
+    TRACE_TCP_SERVER_STREAM,           ///< arg0 = socket, arg1 = chunks in a streamed response
+    TRACE_TCP_SERVER_TIMEOUT,          ///< arg0 = socket, arg1 = 1 for a read timeout, 0 for an idle timeout
+    TRACE_TCP_SERVER_REJECT,           ///< arg0 = socket, arg1 = peer IPv4 address refused by admission control
+
+    TRACE_TCP_CLIENT_SEND = 0x0200,    ///< arg0 = socket, arg1 = bytes sent
+    TRACE_TCP_CLIENT_RECV,             ///< arg0 = socket, arg1 = bytes received
+
+    TRACE_UDP_SERVER_BATCH = 0x0300,   ///< arg0 = socket, arg1 = datagrams drained in one wake-up
+    TRACE_UDP_SERVER_SEND,             ///< arg0 = socket, arg1 = reply bytes sent
+    TRACE_UDP_CLIENT_SEND,             ///< arg0 = socket, arg1 = bytes sent
+} abstrace_event_t;
+
+/// @brief One binary trace record, formatted only when the ring is dumped
+typedef struct {
+    uint32_t timestamp_us;     ///< Low 32 bits of esp_timer_get_time()
+    uint16_t event;            ///< `abstrace_event_t` id
+    uint16_t arg0;             ///< First event argument
+    uint32_t arg1;             ///< Second event argument
+} abstrace_record_t;
+
+/// @brief Append a record to the trace ring, overwriting the oldest one when full
+/// @param event Event id
+/// @param arg0 First event argument
+/// @param arg1 Second event argument
+void abstrace_record(uint16_t event, uint16_t arg0, uint32_t arg1);
+
+/// @brief Copy the buffered records, oldest first, e.g. to send them to a host-side decoder
+/// @param records Destination array
+/// @param max_records Capacity of the destination array
+/// @return Number of records copied
+int abstrace_snapshot(abstrace_record_t *records, int max_records);
+
+/// @brief Format and log every buffered record, oldest first
+void abstrace_dump(void);
+
+/// @brief Discard every buffered record
+void abstrace_clear(void);
+
+#endif // ABSTRACE_H
+
+// The trace macro is defined outside the include guard so each translation unit picks its own
+// setting: define ABSTRACE_ENABLED to 1 before including this header to compile trace points in.
+// Otherwise ABSTRACE() compiles to nothing; its arguments only appear under sizeof, so they are not
+// evaluated but still count as used.
+#undef ABSTRACE
+#if defined(ABSTRACE_ENABLED) && ABSTRACE_ENABLED
+#define ABSTRACE(event, arg0, arg1) abstrace_record((event), (uint16_t)(arg0), (uint32_t)(arg1))
+#else
+#define ABSTRACE(event, arg0, arg1) ((void)sizeof(event), (void)sizeof(arg0), (void)sizeof(arg1))
+#endif
@@ -0,0 +1,100 @@
+#include <stdlib.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+
+#include "abstcp-v4/buffer-pool.h"
+
+// Free blocks form an intrusive singly linked list through their first word
+typedef struct free_block {
+    struct free_block *next;
+} free_block_t;
+
+struct buffer_pool {
+    char *storage;
+    free_block_t *free_list;
+    portMUX_TYPE lock;
+    buffer_pool_stats_t stats;
+};
+
+buffer_pool_t *buffer_pool_create(int block_size, int block_count)
+{
+    if (block_size <= 0 || block_count <= 0) {
+        return NULL;
+    }
+    block_size = (block_size + 3) & ~3;
+    if ((size_t)block_size < sizeof(free_block_t)) {
+        block_size = sizeof(free_block_t);
+    }
+
+    buffer_pool_t *pool = calloc(1, sizeof(buffer_pool_t));
+    if (!pool) {
+        return NULL;
+    }
+    pool->storage = malloc((size_t)block_size * block_count);
+    if (!pool->storage) {
+        free(pool);
+        return NULL;
+    }
+
+    for (int i = block_count - 1; i >= 0; i--) {
+        free_block_t *block = (free_block_t *)(pool->storage + (size_t)i * block_size);
+        block->next = pool->free_list;
+        pool->free_list = block;
+    }
+
+    portMUX_INITIALIZE(&pool->lock);
+    pool->stats.block_size = block_size;
+    pool->stats.block_count = block_count;
+    return pool;
+}
+
+void buffer_pool_destroy(buffer_pool_t *pool)
+{
+    if (!pool) {
+        return;
+    }
+    free(pool->storage);
+    free(pool);
+}
+
+char *buffer_pool_alloc(buffer_pool_t *pool)
+{
+    portENTER_CRITICAL(&pool->lock);
+    free_block_t *block = pool->free_list;
+    if (block) {
+        pool->free_list = block->next;
+        pool->stats.in_use++;
+        pool->stats.allocations++;
+        if (pool->stats.in_use > pool->stats.high_water) {
+            pool->stats.high_water = pool->stats.in_use;
+        }
+    } else {
+        pool->stats.alloc_failures++;
+    }
+    portEXIT_CRITICAL(&pool->lock);
+    return (char *)block;
+}
+
+void buffer_pool_free(buffer_pool_t *pool, char *block)
+{
+    if (!block) {
+        return;
+    }
+    portENTER_CRITICAL(&pool->lock);
+    ((free_block_t *)block)->next = pool->free_list;
+    pool->free_list = (free_block_t *)block;
+    pool->stats.in_use--;
+    portEXIT_CRITICAL(&pool->lock);
+}
+
+int buffer_pool_block_size(const buffer_pool_t *pool)
+{
+    return pool->stats.block_size;
+}
+
+void buffer_pool_get_stats(buffer_pool_t *pool, buffer_pool_stats_t *stats)
+{
+    portENTER_CRITICAL(&pool->lock);
+    *stats = pool->stats;
+    portEXIT_CRITICAL(&pool->lock);
+}
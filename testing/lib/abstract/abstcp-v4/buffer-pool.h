@@ -0,0 +1,49 @@
+#ifndef ABSTCP_V4_BUFFER_POOL_H
+#define ABSTCP_V4_BUFFER_POOL_H
+
+#include <stdint.h>
+
+/// @brief Fixed-block buffer pool, safe to share between tasks
+typedef struct buffer_pool buffer_pool_t;
+
+/// @brief Buffer pool usage counters
+typedef struct {
+    int block_size;            ///< Size of each block in bytes
+    int block_count;           ///< Total number of blocks
+    int in_use;                ///< Blocks currently borrowed
+    int high_water;            ///< Highest number of blocks borrowed at once
+    uint32_t allocations;      ///< Successful allocations
+    uint32_t alloc_failures;   ///< Allocations that failed because the pool was empty
+} buffer_pool_stats_t;
+
+/// @brief Create a pool of equally sized blocks backed by a single allocation
+/// @param block_size Size of each block in bytes (rounded up to a multiple of 4)
+/// @param block_count Number of blocks
+/// @return The new pool, or NULL on failure
+buffer_pool_t *buffer_pool_create(int block_size, int block_count);
+
+/// @brief Free a pool and all of its blocks
+/// @param pool Pool to free; no block may still be in use
+void buffer_pool_destroy(buffer_pool_t *pool);
+
+/// @brief Borrow a block from the pool
+/// @param pool Pool to borrow from
+/// @return The block, or NULL if the pool is empty
+char *buffer_pool_alloc(buffer_pool_t *pool);
+
+/// @brief Return a block to the pool
+/// @param pool Pool the block was borrowed from
+/// @param block Block to return (NULL is ignored)
+void buffer_pool_free(buffer_pool_t *pool, char *block);
+
+/// @brief Get the size of the blocks in a pool
+/// @param pool Pool to query
+/// @return Block size in bytes
+int buffer_pool_block_size(const buffer_pool_t *pool);
+
+/// @brief Read the usage counters of a pool
+/// @param pool Pool to query
+/// @param stats Filled in with the current counters
+void buffer_pool_get_stats(buffer_pool_t *pool, buffer_pool_stats_t *stats);
+
+#endif // ABSTCP_V4_BUFFER_POOL_H
@@ -1,44 +1,877 @@
 #include "sdkconfig.h"
 #include <string.h>
+#include <stdlib.h>
 #include <unistd.h>
+#include <fcntl.h>
 #include <sys/socket.h>
+#include <sys/select.h>
+#include <sys/uio.h>
 #include <errno.h>
 #include <netdb.h> 
 #include <arpa/inet.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_netif.h"
 #include "esp_log.h"
+#include "esp_timer.h"
 
 #include "abstcp-v4/client.h"
+#include "abstcp-v4/dns-cache.h"
+
+// Set to 0 to compile the client's trace points out
+#ifndef CONFIG_ABSTCP_CLIENT_TRACE
+#define CONFIG_ABSTCP_CLIENT_TRACE 1
+#endif
+#define ABSTRACE_ENABLED CONFIG_ABSTCP_CLIENT_TRACE
+#include "abssys/abstrace.h"
 
 static const char *TAG = "abstcp-v4-client";
 
+// Default pool limits
+#define DEFAULT_POOL_MAX_IDLE          4
+#define DEFAULT_POOL_MAX_IDLE_PER_HOST 2
+#define DEFAULT_POOL_IDLE_TIMEOUT_MS   30000
+
+// Default asynchronous mode settings
+#define DEFAULT_MAX_IN_FLIGHT          8
+#define DEFAULT_ASYNC_TASK_PRIORITY    5
+#define DEFAULT_ASYNC_BUFFER_SIZE      1024
+#define ASYNC_TASK_STACK_SIZE          4096
+
+// Default write coalescing thresholds
+#define DEFAULT_COALESCE_SIZE          1024
+#define DEFAULT_COALESCE_DELAY_MS      10
+#define COALESCE_RETRY_DELAY_US        1000
+
+// State of a connection in asynchronous mode
+typedef struct {
+    tcp_client_async_options_t options;
+    QueueHandle_t pending;     // Contexts of sent requests, oldest first
+    SemaphoreHandle_t slots;   // Counts free places in `pending`; taken before `send_lock` so no sender waits holding it
+    SemaphoreHandle_t send_lock; // Keeps the order of `pending` and of the bytes on the wire the same
+    SemaphoreHandle_t idle;    // Given by the receiver whenever the last outstanding request completes
+    SemaphoreHandle_t task_done; // Given by the receiver task when it exits
+    int in_flight;             // Requests queued and not yet completed, including one in its callback
+    bool stopped;              // Set by the receiver under send_lock once it stops taking responses
+    char *storage;             // Receive ring storage followed by the scratch block
+    frame_buffer_t rx;
+} client_async_t;
+
+// Write coalescing buffer
+typedef struct {
+    tcp_client_coalesce_options_t options;
+    SemaphoreHandle_t lock;    // Guards the buffer against the flush timer
+    SemaphoreHandle_t stopped; // Given by the timer callback once it has seen `stopping`
+    esp_timer_handle_t timer;  // Started by the first write into an empty buffer
+    char *data;
+    int used;
+    int error;                 // errno of a failed timer flush; every later write fails with it
+    bool stopping;             // Set when the connection closes; the callback then only gives `stopped`
+} client_coalesce_t;
+
+struct tcp_client {
+    int sock;
+    struct sockaddr_in addr;   // Pool key
+    socket_tuning_t tuning;
+    int64_t idle_since_us;     // When the connection was released to a pool
+    client_async_t *async;     // NULL unless in asynchronous mode
+    client_coalesce_t *coalesce; // NULL unless writes are coalesced
+    tcp_client_stats_t stats;
+};
+
+struct tcp_client_pool {
+    tcp_client_pool_options_t options;
+    portMUX_TYPE lock;         // Guards `idle` and `stats`, which every task sharing the pool uses
+    tcp_client_t **idle;       // Idle connections, oldest first
+    tcp_client_pool_stats_t stats;
+};
+
 typedef ssize_t (*recv_func_t)(int sockfd, void *buf, size_t len, int flags);
 typedef ssize_t (*send_func_t)(int sockfd, const void *buf, size_t len, int flags);
 
-static int client_sock = -1;
+// Connection behind the single-connection API
+static tcp_client_t *default_client = NULL;
 static recv_func_t client_recv_callback = NULL;
+static socket_tuning_t client_tuning = {0};
+static int client_connect_timeout_ms = 0;
+
+// Connects without blocking for longer than timeout_ms. Returns 0, or -1 with errno set, to ETIMEDOUT
+// when the deadline passed.
+static int connect_with_timeout(int sock, const struct sockaddr_in *addr, int timeout_ms) {
+    if (timeout_ms <= 0) {
+        return connect(sock, (const struct sockaddr *)addr, sizeof(*addr));
+    }
+
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+    int result = connect(sock, (const struct sockaddr *)addr, sizeof(*addr));
+    if (result != 0 && errno == EINPROGRESS) {
+        fd_set write_fds;
+        FD_ZERO(&write_fds);
+        FD_SET(sock, &write_fds);
+        struct timeval timeout = {
+            .tv_sec = timeout_ms / 1000,
+            .tv_usec = (timeout_ms % 1000) * 1000,
+        };
+        int ready = select(sock + 1, NULL, &write_fds, NULL, &timeout);
+        if (ready == 0) {
+            errno = ETIMEDOUT;
+        } else if (ready > 0) {
+            // Writability only says the handshake finished; SO_ERROR says whether it succeeded
+            int error = 0;
+            socklen_t error_len = sizeof(error);
+            if (getsockopt(sock, SOL_SOCKET, SO_ERROR, &error, &error_len) == 0 && error == 0) {
+                result = 0;
+            } else {
+                errno = error ? error : errno;
+            }
+        }
+    }
+
+    // Later sends and receives block as before
+    int saved_errno = errno;
+    fcntl(sock, F_SETFL, flags);
+    errno = saved_errno;
+    return result;
+}
+
+tcp_client_t *tcp_client_connect(const char *host, uint16_t port, const socket_tuning_t *tuning, int timeout_ms) {
+    struct sockaddr_in dest_addr;
+    memset(&dest_addr, 0, sizeof(dest_addr));
+    if (!host || dns_resolve(host, &dest_addr.sin_addr.s_addr) != 0) {
+        ESP_LOGE(TAG, "Unable to resolve %s", host ? host : "(null)");
+        errno = EHOSTUNREACH;
+        return NULL;
+    }
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_port = htons(port);
+
+    tcp_client_t *client = calloc(1, sizeof(tcp_client_t));
+    if (!client) {
+        ESP_LOGE(TAG, "Failed to allocate memory for client");
+        return NULL;
+    }
+    client->addr = dest_addr;
+    if (tuning) {
+        client->tuning = *tuning;
+    }
+
+    client->sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (client->sock < 0) {
+        ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+        free(client);
+        return NULL;
+    }
+    ESP_LOGD(TAG, "Socket created, connecting to %s:%d", host, port);
+
+    if (connect_with_timeout(client->sock, &dest_addr, timeout_ms) != 0) {
+        int saved_errno = errno;
+        if (saved_errno == ETIMEDOUT) {
+            ESP_LOGD(TAG, "Connect to %s:%d timed out after %d ms", host, port, timeout_ms);
+        } else {
+            ESP_LOGD(TAG, "Socket unable to connect to %s:%d: errno %d", host, port, saved_errno);
+        }
+        close(client->sock);
+        free(client);
+        errno = saved_errno;
+        return NULL;
+    }
+    socket_tuning_apply(client->sock, &client->tuning);
+    return client;
+}
+
+// Sends every byte of the iovecs, with one sendmsg() unless the socket takes only part of them.
+// The iovecs are modified. Returns the number of bytes sent, or -1 on error.
+static ssize_t send_all(tcp_client_t *client, struct iovec *iov, int iov_count) {
+    size_t total = 0;
+    while (iov_count > 0) {
+        if (iov->iov_len == 0) {
+            iov++;
+            iov_count--;
+            continue;
+        }
+        struct msghdr msg = {
+            .msg_iov = iov,
+            .msg_iovlen = iov_count,
+        };
+        ssize_t sent = sendmsg(client->sock, &msg, 0);
+        client->stats.syscalls++;
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
+            return -1;
+        }
+        total += sent;
+        client->stats.bytes_sent += sent;
+
+        // Skip what the socket took; a partial send resumes inside the current iovec
+        while (sent > 0 && (size_t)sent >= iov->iov_len) {
+            sent -= iov->iov_len;
+            iov++;
+            iov_count--;
+        }
+        if (sent > 0) {
+            iov->iov_base = (char *)iov->iov_base + sent;
+            iov->iov_len -= sent;
+        }
+    }
+    ABSTRACE(TRACE_TCP_CLIENT_SEND, client->sock, total);
+    return total;
+}
+
+// Fails with the error of an earlier timer flush, whose bytes were lost. Call with the coalesce lock held.
+static int coalesce_error(client_coalesce_t *coalesce) {
+    if (coalesce->error) {
+        errno = coalesce->error;
+        return -1;
+    }
+    return 0;
+}
+
+// Sends the buffered writes followed by `data`, if any. Call with the coalesce lock held.
+static int send_coalesced(tcp_client_t *client, const void *data, size_t len) {
+    client_coalesce_t *coalesce = client->coalesce;
+    struct iovec iov[2] = {
+        { .iov_base = coalesce->data, .iov_len = coalesce->used },
+        { .iov_base = (void *)data, .iov_len = len },
+    };
+    esp_timer_stop(coalesce->timer);
+    coalesce->used = 0;
+    return send_all(client, iov, 2) < 0 ? -1 : 0;
+}
+
+ssize_t tcp_client_send(tcp_client_t *client, const void *data, size_t len) {
+    if (!client) {
+        return -1;
+    }
+
+    if (client->coalesce) {
+        // The flush timer updates the same counters, so they are only touched under the lock
+        xSemaphoreTake(client->coalesce->lock, portMAX_DELAY);
+        client->stats.writes++;
+        int result = coalesce_error(client->coalesce) < 0 ? -1 : send_coalesced(client, data, len);
+        xSemaphoreGive(client->coalesce->lock);
+        return result < 0 ? -1 : (ssize_t)len;
+    }
+
+    client->stats.writes++;
+    struct iovec iov = { .iov_base = (void *)data, .iov_len = len };
+    return send_all(client, &iov, 1);
+}
+
+// Sends as much of the buffer as the socket takes without blocking and keeps the rest for another
+// try. A failure is kept for the next write to report. Call with the coalesce lock held.
+static void send_expired(tcp_client_t *client) {
+    client_coalesce_t *coalesce = client->coalesce;
+    ssize_t sent = send(client->sock, coalesce->data, coalesce->used, MSG_DONTWAIT);
+    client->stats.syscalls++;
+    if (sent < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+            ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
+            coalesce->error = errno;
+            coalesce->used = 0;
+            return;
+        }
+        sent = 0;
+    }
+    if (sent > 0) {
+        ABSTRACE(TRACE_TCP_CLIENT_SEND, client->sock, sent);
+        client->stats.bytes_sent += sent;
+        coalesce->used -= sent;
+        memmove(coalesce->data, coalesce->data + sent, coalesce->used);
+    }
+    if (coalesce->used > 0) {
+        esp_timer_start_once(coalesce->timer, COALESCE_RETRY_DELAY_US);
+    }
+}
+
+// Runs on the esp_timer task, which every timer shares, so it never waits: a busy lock or a full
+// socket buffer only puts the flush off for another try
+static void coalesce_timer_callback(void *arg) {
+    tcp_client_t *client = (tcp_client_t *)arg;
+    client_coalesce_t *coalesce = client->coalesce;
+    if (__atomic_load_n(&coalesce->stopping, __ATOMIC_ACQUIRE)) {
+        xSemaphoreGive(coalesce->stopped);
+        return;
+    }
+    if (xSemaphoreTake(coalesce->lock, 0) != pdTRUE) {
+        esp_timer_start_once(coalesce->timer, COALESCE_RETRY_DELAY_US);
+        return;
+    }
+    if (coalesce->used > 0) {
+        client->stats.timer_flushes++;
+        send_expired(client);
+    }
+    xSemaphoreGive(coalesce->lock);
+}
+
+// Waits until the timer callback can no longer run. esp_timer_stop() does not wait for a callback
+// already under way, but callbacks run one at a time on the esp_timer task, so once one started
+// after `stopping` was set has given `stopped`, no earlier one is still running.
+static void stop_coalesce(client_coalesce_t *coalesce) {
+    xSemaphoreTake(coalesce->lock, portMAX_DELAY);
+    __atomic_store_n(&coalesce->stopping, true, __ATOMIC_RELEASE);
+    xSemaphoreGive(coalesce->lock);
+
+    // The start fails harmlessly if a running callback has just rearmed the timer for a retry
+    esp_timer_stop(coalesce->timer);
+    esp_timer_start_once(coalesce->timer, 0);
+    xSemaphoreTake(coalesce->stopped, portMAX_DELAY);
+}
+
+static void free_coalesce(client_coalesce_t *coalesce) {
+    if (coalesce->timer) {
+        esp_timer_stop(coalesce->timer);
+        esp_timer_delete(coalesce->timer);
+    }
+    if (coalesce->lock) {
+        vSemaphoreDelete(coalesce->lock);
+    }
+    if (coalesce->stopped) {
+        vSemaphoreDelete(coalesce->stopped);
+    }
+    free(coalesce->data);
+    free(coalesce);
+}
+
+int tcp_client_enable_coalescing(tcp_client_t *client, const tcp_client_coalesce_options_t *options) {
+    if (!client || client->coalesce) {
+        return -1;
+    }
+
+    client_coalesce_t *coalesce = calloc(1, sizeof(client_coalesce_t));
+    if (!coalesce) {
+        ESP_LOGE(TAG, "Failed to allocate memory for write buffer");
+        return -1;
+    }
+    if (options) {
+        coalesce->options = *options;
+    }
+    if (coalesce->options.size <= 0) {
+        coalesce->options.size = DEFAULT_COALESCE_SIZE;
+    }
+    if (coalesce->options.max_delay_ms <= 0) {
+        coalesce->options.max_delay_ms = DEFAULT_COALESCE_DELAY_MS;
+    }
+
+    coalesce->data = malloc(coalesce->options.size);
+    coalesce->lock = xSemaphoreCreateMutex();
+    coalesce->stopped = xSemaphoreCreateBinary();
+    esp_timer_create_args_t timer_args = {
+        .callback = coalesce_timer_callback,
+        .arg = client,
+        .name = "tcp_client_flush",
+    };
+    if (!coalesce->data || !coalesce->lock || !coalesce->stopped || esp_timer_create(&timer_args, &coalesce->timer) != ESP_OK) {
+        ESP_LOGE(TAG, "Failed to allocate memory for write buffer");
+        free_coalesce(coalesce);
+        return -1;
+    }
+    client->coalesce = coalesce;
+    return 0;
+}
+
+ssize_t tcp_client_write(tcp_client_t *client, const void *data, size_t len) {
+    if (!client) {
+        return -1;
+    }
+    client_coalesce_t *coalesce = client->coalesce;
+    if (!coalesce) {
+        return tcp_client_send(client, data, len);
+    }
+
+    int result = 0;
+    xSemaphoreTake(coalesce->lock, portMAX_DELAY);
+    client->stats.writes++;
+    if (coalesce_error(coalesce) < 0) {
+        result = -1;
+    } else if (coalesce->used + len > (size_t)coalesce->options.size) {
+        // Too much to buffer: send the buffer and the new write together
+        client->stats.size_flushes++;
+        result = send_coalesced(client, data, len);
+    } else {
+        memcpy(coalesce->data + coalesce->used, data, len);
+        coalesce->used += len;
+        if (coalesce->used == coalesce->options.size) {
+            client->stats.size_flushes++;
+            result = send_coalesced(client, NULL, 0);
+        } else if (coalesce->used == (int)len) {
+            esp_timer_start_once(coalesce->timer, (uint64_t)coalesce->options.max_delay_ms * 1000);
+        }
+    }
+    xSemaphoreGive(coalesce->lock);
+    return result < 0 ? -1 : (ssize_t)len;
+}
+
+int tcp_client_write_flush(tcp_client_t *client) {
+    if (!client) {
+        return -1;
+    }
+    if (!client->coalesce) {
+        return 0;
+    }
+
+    xSemaphoreTake(client->coalesce->lock, portMAX_DELAY);
+    int result = coalesce_error(client->coalesce);
+    if (result == 0 && client->coalesce->used > 0) {
+        result = send_coalesced(client, NULL, 0);
+    }
+    xSemaphoreGive(client->coalesce->lock);
+    return result;
+}
+
+int tcp_client_get_stats(tcp_client_t *client, tcp_client_stats_t *stats) {
+    if (!client || !stats) {
+        return -1;
+    }
+    if (client->coalesce) {
+        xSemaphoreTake(client->coalesce->lock, portMAX_DELAY);
+        *stats = client->stats;
+        xSemaphoreGive(client->coalesce->lock);
+    } else {
+        *stats = client->stats;
+    }
+    return 0;
+}
+
+ssize_t tcp_client_recv(tcp_client_t *client, void *buffer, size_t len, int timeout_ms) {
+    if (!client) {
+        return -1;
+    }
+
+    if (timeout_ms > 0) {
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(client->sock, &read_fds);
+        struct timeval timeout = {
+            .tv_sec = timeout_ms / 1000,
+            .tv_usec = (timeout_ms % 1000) * 1000,
+        };
+        int ready = select(client->sock + 1, &read_fds, NULL, NULL, &timeout);
+        if (ready <= 0) {
+            if (ready == 0) {
+                errno = EAGAIN;
+            }
+            return -1;
+        }
+    }
+
+    ssize_t received = recv(client->sock, buffer, len, 0);
+    if (received > 0) {
+        ABSTRACE(TRACE_TCP_CLIENT_RECV, client->sock, received);
+    }
+    return received;
+}
+
+void tcp_client_cork(tcp_client_t *client) {
+    if (client) {
+        socket_cork(client->sock, &client->tuning);
+    }
+}
+
+void tcp_client_uncork(tcp_client_t *client) {
+    if (client) {
+        socket_uncork(client->sock, &client->tuning);
+    }
+}
+
+int tcp_client_socket(const tcp_client_t *client) {
+    return client ? client->sock : -1;
+}
+
+static TickType_t timeout_ticks(int timeout_ms) {
+    return timeout_ms > 0 ? pdMS_TO_TICKS(timeout_ms) : portMAX_DELAY;
+}
+
+// Completes the oldest outstanding request. Returns false if none was outstanding.
+static bool complete_request(client_async_t *async, const char *response, int response_len) {
+    void *context;
+    if (xQueueReceive(async->pending, &context, 0) != pdTRUE) {
+        return false;
+    }
+    async->options.callback(context, response, response_len, async->options.user_data);
+    xSemaphoreGive(async->slots);
+    if (__atomic_sub_fetch(&async->in_flight, 1, __ATOMIC_ACQ_REL) == 0) {
+        xSemaphoreGive(async->idle);
+    }
+    return true;
+}
+
+static void client_receiver_task(void *pvParameters) {
+    tcp_client_t *client = (tcp_client_t *)pvParameters;
+    client_async_t *async = client->async;
+    bool framed = async->options.framer.type != FRAMER_NONE;
+    char *scratch = async->storage + async->rx.size;
+
+    for (;;) {
+        int len;
+        if (framed) {
+            len = frame_buffer_recv(&async->rx, client->sock);
+        } else {
+            len = recv(client->sock, async->storage, async->rx.size, 0);
+        }
+        if (len <= 0) {
+            if (len < 0 && errno != ENOTCONN && errno != EBADF) {
+                ESP_LOGE(TAG, "Error occurred during receiving: errno %d", errno);
+            }
+            break;
+        }
+        ABSTRACE(TRACE_TCP_CLIENT_RECV, client->sock, len);
+
+        int result = 1;
+        if (!framed) {
+            if (!complete_request(async, async->storage, len)) {
+                ESP_LOGW(TAG, "Dropping %d unsolicited byte(s)", len);
+            }
+            continue;
+        }
+        const char *response;
+        int response_len;
+        while ((result = frame_buffer_next(&async->rx, &async->options.framer, scratch, async->rx.size,
+                                           &response, &response_len)) == 1) {
+            if (!complete_request(async, response, response_len)) {
+                ESP_LOGW(TAG, "Dropping an unsolicited response of %d byte(s)", response_len);
+            }
+        }
+        if (result < 0) {
+            ESP_LOGE(TAG, "Framing error, closing connection");
+            break;
+        }
+    }
+
+    // Stop taking requests, then fail whatever was sent before. Shutting the socket down fails a
+    // sender blocked in send(), the only place `send_lock` is held for long, and draining gives
+    // senders waiting for a slot theirs back so they see `stopped`.
+    shutdown(client->sock, SHUT_RDWR);
+    xSemaphoreTake(async->send_lock, portMAX_DELAY);
+    async->stopped = true;
+    xSemaphoreGive(async->send_lock);
+    while (complete_request(async, NULL, -1)) {
+    }
+    xSemaphoreGive(async->idle);
+
+    xSemaphoreGive(async->task_done);
+    vTaskDelete(NULL);
+}
+
+static void free_async(client_async_t *async) {
+    if (async->pending) {
+        vQueueDelete(async->pending);
+    }
+    if (async->slots) {
+        vSemaphoreDelete(async->slots);
+    }
+    if (async->send_lock) {
+        vSemaphoreDelete(async->send_lock);
+    }
+    if (async->idle) {
+        vSemaphoreDelete(async->idle);
+    }
+    if (async->task_done) {
+        vSemaphoreDelete(async->task_done);
+    }
+    free(async->storage);
+    free(async);
+}
+
+int tcp_client_start_async(tcp_client_t *client, const tcp_client_async_options_t *options) {
+    if (!client || client->async || !options || !options->callback) {
+        return -1;
+    }
+
+    client_async_t *async = calloc(1, sizeof(client_async_t));
+    if (!async) {
+        ESP_LOGE(TAG, "Failed to allocate memory for async client");
+        return -1;
+    }
+    async->options = *options;
+    if (async->options.max_in_flight <= 0) {
+        async->options.max_in_flight = DEFAULT_MAX_IN_FLIGHT;
+    }
+    if (async->options.task_priority <= 0) {
+        async->options.task_priority = DEFAULT_ASYNC_TASK_PRIORITY;
+    }
+    int buffer_size = options->framer.max_message_size > 0 ? options->framer.max_message_size : DEFAULT_ASYNC_BUFFER_SIZE;
+
+    async->storage = malloc(2 * buffer_size);
+    async->pending = xQueueCreate(async->options.max_in_flight, sizeof(void *));
+    async->slots = xSemaphoreCreateCounting(async->options.max_in_flight, async->options.max_in_flight);
+    async->send_lock = xSemaphoreCreateMutex();
+    async->idle = xSemaphoreCreateBinary();
+    async->task_done = xSemaphoreCreateBinary();
+    if (!async->storage || !async->pending || !async->slots || !async->send_lock || !async->idle || !async->task_done) {
+        ESP_LOGE(TAG, "Failed to allocate memory for async client");
+        free_async(async);
+        return -1;
+    }
+    frame_buffer_init(&async->rx, async->storage, buffer_size);
+
+    client->async = async;
+    if (xTaskCreate(client_receiver_task, "tcp_client_rx", ASYNC_TASK_STACK_SIZE, client,
+                    async->options.task_priority, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create receiver task");
+        client->async = NULL;
+        free_async(async);
+        return -1;
+    }
+    return 0;
+}
+
+ssize_t tcp_client_send_async(tcp_client_t *client, const void *data, size_t len, void *context, int timeout_ms) {
+    if (!client || !client->async) {
+        return -1;
+    }
+    client_async_t *async = client->async;
+
+    // Reserve a place in `pending` first: the receiver needs `send_lock` to stop, so it must never
+    // be held while waiting for a response to free one
+    TickType_t start = xTaskGetTickCount();
+    TickType_t wait = timeout_ticks(timeout_ms);
+    if (xSemaphoreTake(async->slots, wait) != pdTRUE) {
+        errno = EAGAIN;
+        return -1;
+    }
+    if (wait != portMAX_DELAY) {
+        TickType_t elapsed = xTaskGetTickCount() - start;
+        wait = elapsed < wait ? wait - elapsed : 0;
+    }
+    if (xSemaphoreTake(async->send_lock, wait) != pdTRUE) {
+        xSemaphoreGive(async->slots);
+        errno = EAGAIN;
+        return -1;
+    }
+    if (async->stopped) {
+        xSemaphoreGive(async->send_lock);
+        xSemaphoreGive(async->slots);
+        errno = ENOTCONN;
+        return -1;
+    }
+    __atomic_add_fetch(&async->in_flight, 1, __ATOMIC_ACQ_REL);
+    xQueueSend(async->pending, &context, 0);
+
+    // The context is queued before its bytes go out, so the receiver always finds it
+    ssize_t sent = tcp_client_send(client, data, len);
+    if (sent < 0) {
+        // A partly sent request leaves the stream unusable; the receiver fails what is outstanding
+        shutdown(client->sock, SHUT_RDWR);
+    }
+    xSemaphoreGive(async->send_lock);
+    return sent;
+}
+
+int tcp_client_flush(tcp_client_t *client, int timeout_ms) {
+    if (!client || !client->async) {
+        return -1;
+    }
+    client_async_t *async = client->async;
+
+    int64_t deadline_us = esp_timer_get_time() + (int64_t)timeout_ms * 1000;
+    while (__atomic_load_n(&async->in_flight, __ATOMIC_ACQUIRE) > 0) {
+        TickType_t wait = portMAX_DELAY;
+        if (timeout_ms > 0) {
+            int64_t remaining_us = deadline_us - esp_timer_get_time();
+            if (remaining_us <= 0) {
+                return -1;
+            }
+            wait = pdMS_TO_TICKS((remaining_us + 999) / 1000);
+        }
+        // A stale give from an earlier flush only costs another check of the counter
+        xSemaphoreTake(async->idle, wait);
+    }
+    return 0;
+}
+
+void tcp_client_close(tcp_client_t *client) {
+    if (!client) {
+        return;
+    }
+    if (client->coalesce) {
+        tcp_client_write_flush(client);
+        stop_coalesce(client->coalesce);
+        free_coalesce(client->coalesce);
+    }
+    shutdown(client->sock, SHUT_RDWR);
+    if (client->async) {
+        xSemaphoreTake(client->async->task_done, portMAX_DELAY);
+        free_async(client->async);
+    }
+    close(client->sock);
+    free(client);
+}
+
+tcp_client_pool_t *tcp_client_pool_create(const tcp_client_pool_options_t *options) {
+    tcp_client_pool_t *pool = calloc(1, sizeof(tcp_client_pool_t));
+    if (!pool) {
+        ESP_LOGE(TAG, "Failed to allocate memory for client pool");
+        return NULL;
+    }
+    if (options) {
+        pool->options = *options;
+    }
+    if (pool->options.max_idle <= 0) {
+        pool->options.max_idle = DEFAULT_POOL_MAX_IDLE;
+    }
+    if (pool->options.max_idle_per_host <= 0) {
+        pool->options.max_idle_per_host = DEFAULT_POOL_MAX_IDLE_PER_HOST;
+    }
+    if (pool->options.idle_timeout_ms <= 0) {
+        pool->options.idle_timeout_ms = DEFAULT_POOL_IDLE_TIMEOUT_MS;
+    }
+
+    pool->idle = calloc(pool->options.max_idle, sizeof(tcp_client_t *));
+    if (!pool->idle) {
+        ESP_LOGE(TAG, "Failed to allocate memory for client pool");
+        free(pool);
+        return NULL;
+    }
+    portMUX_INITIALIZE(&pool->lock);
+    return pool;
+}
+
+// Removes entry `index` from the idle list. Call with the pool lock held.
+static tcp_client_t *take_idle(tcp_client_pool_t *pool, int index) {
+    tcp_client_t *client = pool->idle[index];
+    memmove(&pool->idle[index], &pool->idle[index + 1], (pool->stats.idle - index - 1) * sizeof(tcp_client_t *));
+    pool->stats.idle--;
+    return client;
+}
+
+// An idle connection is only reusable if the server has neither closed it nor sent anything unasked
+static bool idle_connection_usable(tcp_client_t *client) {
+    char byte;
+    ssize_t peeked = recv(client->sock, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return peeked < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+tcp_client_t *tcp_client_pool_acquire(tcp_client_pool_t *pool, const char *host, uint16_t port) {
+    if (!pool || !host) {
+        return NULL;
+    }
+    struct in_addr addr;
+    if (dns_resolve(host, &addr.s_addr) != 0) {
+        ESP_LOGE(TAG, "Unable to resolve %s", host);
+        errno = EHOSTUNREACH;
+        return NULL;
+    }
+
+    int64_t expired_before = esp_timer_get_time() - (int64_t)pool->options.idle_timeout_ms * 1000;
+    for (;;) {
+        // The most recently released connection is the least likely to have been closed by the server
+        tcp_client_t *client = NULL;
+        portENTER_CRITICAL(&pool->lock);
+        for (int i = pool->stats.idle - 1; i >= 0; i--) {
+            if (pool->idle[i]->addr.sin_addr.s_addr == addr.s_addr && pool->idle[i]->addr.sin_port == htons(port)) {
+                client = take_idle(pool, i);
+                break;
+            }
+        }
+        portEXIT_CRITICAL(&pool->lock);
+        if (!client) {
+            break;
+        }
+
+        if (client->idle_since_us >= expired_before && idle_connection_usable(client)) {
+            portENTER_CRITICAL(&pool->lock);
+            pool->stats.reused++;
+            portEXIT_CRITICAL(&pool->lock);
+            return client;
+        }
+        tcp_client_close(client);
+        portENTER_CRITICAL(&pool->lock);
+        pool->stats.discarded++;
+        portEXIT_CRITICAL(&pool->lock);
+    }
+
+    tcp_client_t *client = tcp_client_connect(host, port, &pool->options.tuning, pool->options.connect_timeout_ms);
+    if (client) {
+        portENTER_CRITICAL(&pool->lock);
+        pool->stats.connected++;
+        portEXIT_CRITICAL(&pool->lock);
+    }
+    return client;
+}
+
+void tcp_client_pool_release(tcp_client_pool_t *pool, tcp_client_t *client, bool reusable) {
+    if (!client) {
+        return;
+    }
+    if (!pool || !reusable) {
+        tcp_client_close(client);
+        return;
+    }
+
+    client->idle_since_us = esp_timer_get_time();
+    tcp_client_t *evicted = NULL;
+    portENTER_CRITICAL(&pool->lock);
+    int same_host = 0;
+    for (int i = 0; i < pool->stats.idle; i++) {
+        if (pool->idle[i]->addr.sin_addr.s_addr == client->addr.sin_addr.s_addr &&
+            pool->idle[i]->addr.sin_port == client->addr.sin_port) {
+            same_host++;
+        }
+    }
+    if (same_host >= pool->options.max_idle_per_host) {
+        evicted = client;
+    } else {
+        // A full pool makes room by dropping its oldest connection
+        if (pool->stats.idle >= pool->options.max_idle) {
+            evicted = take_idle(pool, 0);
+        }
+        pool->idle[pool->stats.idle++] = client;
+    }
+    if (evicted) {
+        pool->stats.discarded++;
+    }
+    portEXIT_CRITICAL(&pool->lock);
+
+    tcp_client_close(evicted);
+}
+
+int tcp_client_pool_get_stats(tcp_client_pool_t *pool, tcp_client_pool_stats_t *stats) {
+    if (!pool || !stats) {
+        return -1;
+    }
+    portENTER_CRITICAL(&pool->lock);
+    *stats = pool->stats;
+    portEXIT_CRITICAL(&pool->lock);
+    return 0;
+}
+
+void tcp_client_pool_destroy(tcp_client_pool_t *pool) {
+    if (!pool) {
+        return;
+    }
+    for (int i = 0; i < pool->stats.idle; i++) {
+        tcp_client_close(pool->idle[i]);
+    }
+    free(pool->idle);
+    free(pool);
+}
 
 static ssize_t client_send_func(int sockfd, const void *buf, size_t len, int flags) {
-    if (client_sock == -1) {
+    if (!default_client) {
         ESP_LOGE(TAG, "Client not connected");
         return -1;
     }
     
-    ssize_t sent = send(client_sock, buf, len, flags);
+    ssize_t sent = send(default_client->sock, buf, len, flags);
     if (sent < 0) {
         ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
         return sent;
     }
+    ABSTRACE(TRACE_TCP_CLIENT_SEND, default_client->sock, sent);
     
     if (client_recv_callback) {
         char rx_buffer[1024];
-        int recv_len = client_recv_callback(client_sock, rx_buffer, sizeof(rx_buffer) - 1, 0);
+        int recv_len = client_recv_callback(default_client->sock, rx_buffer, sizeof(rx_buffer) - 1, 0);
         if (recv_len < 0) {
             ESP_LOGE(TAG, "recv failed: errno %d", errno);
         } else if (recv_len > 0) {
-            rx_buffer[recv_len] = 0; // Null-terminate
-            ESP_LOGI(TAG, "Received %d bytes:", recv_len);
-            ESP_LOGI(TAG, "%s", rx_buffer);
+            ABSTRACE(TRACE_TCP_CLIENT_RECV, default_client->sock, recv_len);
         }
     }
     
@@ -46,28 +879,18 @@ static ssize_t client_send_func(int sockfd, const void *buf, size_t len, int fla
 }
 
 send_func_t client(const char *host, const char *target, uint16_t port, recv_func_t recv_callback) {
-    struct sockaddr_in dest_addr;
-    int addr_family = AF_INET;
-    int ip_protocol = IPPROTO_IP;
-    
+    client_cleanup();
     client_recv_callback = recv_callback;
     
-    inet_pton(AF_INET, host, &dest_addr.sin_addr);
-    dest_addr.sin_family = AF_INET;
-    dest_addr.sin_port = htons(port);
-    
-    client_sock = socket(addr_family, SOCK_STREAM, ip_protocol);
-    if (client_sock < 0) {
-        ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
-        return NULL;
-    }
-    ESP_LOGI(TAG, "Socket created, connecting to %s:%d", host, port);
-    
-    int err = connect(client_sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
-    if (err != 0) {
-        ESP_LOGE(TAG, "Socket unable to connect: errno %d", errno);
-        close(client_sock);
-        client_sock = -1;
+    ESP_LOGI(TAG, "Connecting to %s:%d", host, port);
+    default_client = tcp_client_connect(host, port, &client_tuning, client_connect_timeout_ms);
+    if (!default_client) {
+        if (errno == ETIMEDOUT) {
+            ESP_LOGE(TAG, "Connect timed out after %d ms", client_connect_timeout_ms);
+        } else {
+            ESP_LOGE(TAG, "Socket unable to connect: errno %d", errno);
+        }
+        client_recv_callback = NULL;
         return NULL;
     }
     ESP_LOGI(TAG, "Successfully connected");
@@ -76,11 +899,34 @@ send_func_t client(const char *host, const char *target, uint16_t port, recv_fun
 }
 
 void client_cleanup(void) {
-    if (client_sock != -1) {
+    if (default_client) {
         ESP_LOGI(TAG, "Shutting down client socket");
-        shutdown(client_sock, SHUT_RDWR);
-        close(client_sock);
-        client_sock = -1;
+        tcp_client_close(default_client);
+        default_client = NULL;
         client_recv_callback = NULL;
     }
-}
\ No newline at end of file
+}
+
+void client_set_tuning(const socket_tuning_t *tuning) {
+    if (tuning) {
+        client_tuning = *tuning;
+    } else {
+        memset(&client_tuning, 0, sizeof(client_tuning));
+    }
+    if (default_client) {
+        default_client->tuning = client_tuning;
+        socket_tuning_apply(default_client->sock, &client_tuning);
+    }
+}
+
+void client_set_connect_timeout(int timeout_ms) {
+    client_connect_timeout_ms = timeout_ms > 0 ? timeout_ms : 0;
+}
+
+void client_cork(void) {
+    tcp_client_cork(default_client);
+}
+
+void client_uncork(void) {
+    tcp_client_uncork(default_client);
+}
@@ -1,15 +1,237 @@
 #ifndef ABSTCP_V4_CLIENT_H
 #define ABSTCP_V4_CLIENT_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/types.h>
 
+#include "abstcp-v4/framing.h"
+#include "abstcp-v4/socket-tuning.h"
+
 /// @brief Function pointer type for receiving data
 typedef ssize_t (*recv_func_t)(int sockfd, void *buf, size_t len, int flags);
 /// @brief Function pointer type for sending data
 typedef ssize_t (*send_func_t)(int sockfd, const void *buf, size_t len, int flags);
 
+/// @brief Handle of one outbound TCP connection
+typedef struct tcp_client tcp_client_t;
+
+/// @brief Pool of kept-alive connections, keyed by host and port
+typedef struct tcp_client_pool tcp_client_pool_t;
+
+/// @brief Completion callback of an asynchronous request
+/// 
+/// Runs on the connection's receiver task, once per request and in the order the requests were sent.
+/// 
+/// @param context Context passed with the request
+/// @param response Response payload without framing, valid only during the call; NULL if the request failed
+/// @param response_len Length of the response, or -1 if the connection failed before the response arrived
+/// @param user_data User data from `tcp_client_async_options_t`
+typedef void (*tcp_client_response_func_t)(void *context, const char *response, int response_len, void *user_data);
+
+/// @brief Asynchronous mode configuration
+typedef struct {
+    framer_options_t framer;   ///< Framing of the responses; each response completes the oldest outstanding request (zeroed = every read is one response)
+    tcp_client_response_func_t callback; ///< Completion callback
+    void *user_data;           ///< Passed to the completion callback
+    int max_in_flight;         ///< Requests sent but not yet answered; further sends wait for a response (0 = use default of 8)
+    int task_priority;         ///< FreeRTOS priority of the receiver task (0 = use default of 5)
+} tcp_client_async_options_t;
+
+/// @brief Connection pool configuration options
+typedef struct {
+    int max_idle;              ///< Idle connections kept in total; the oldest is closed to make room (0 = use default of 4)
+    int max_idle_per_host;     ///< Idle connections kept per host and port; more are closed on release (0 = use default of 2)
+    int idle_timeout_ms;       ///< Idle connections older than this are closed instead of reused (0 = use default of 30000)
+    int connect_timeout_ms;    ///< Deadline for opening a new connection (0 = wait for the stack's SYN retries)
+    socket_tuning_t tuning;    ///< Applied to every connection the pool opens (zeroed = stack defaults)
+} tcp_client_pool_options_t;
+
+/// @brief Connection pool statistics
+typedef struct {
+    uint32_t reused;           ///< Acquires served by an idle connection
+    uint32_t connected;        ///< Acquires that had to open a new connection
+    uint32_t discarded;        ///< Idle connections closed because they expired, were closed by the server or did not fit
+    int idle;                  ///< Connections currently idle in the pool
+} tcp_client_pool_stats_t;
+
+/// @brief Write coalescing configuration
+typedef struct {
+    int size;                  ///< Buffered bytes at which the writes are sent; larger writes bypass the buffer (0 = use default of 1024)
+    int max_delay_ms;          ///< Longest a buffered write waits for more to join it (0 = use default of 10)
+} tcp_client_coalesce_options_t;
+
+/// @brief Connection statistics
+typedef struct {
+    uint32_t writes;           ///< Messages passed to `tcp_client_send()` or `tcp_client_write()`
+    uint32_t syscalls;         ///< send() and sendmsg() calls made for them
+    uint64_t bytes_sent;       ///< Bytes handed to the socket
+    uint32_t size_flushes;     ///< Coalesced sends triggered by the size threshold
+    uint32_t timer_flushes;    ///< Coalesced sends triggered by the time threshold
+} tcp_client_stats_t;
+
+/// @brief Open a TCP connection
+/// 
+/// Host names are resolved through the DNS cache of `dns_resolve()`, so repeated connects to the
+/// same backend skip the lookup.
+/// 
+/// With a timeout the connect runs non-blocking and is finished with select(), so an unreachable
+/// host costs at most `timeout_ms` instead of lwIP's full SYN retry period.
+/// 
+/// @param host The host name or IP address to connect to
+/// @param port The port number to connect to
+/// @param tuning Tuning applied to the connection (NULL = stack defaults)
+/// @param timeout_ms Deadline for the connection to be established (0 = wait for the stack's SYN retries)
+/// @return Handle of the connection, or NULL on failure with errno set; ETIMEDOUT means the deadline passed
+///         and EHOSTUNREACH that the host did not resolve
+tcp_client_t *tcp_client_connect(const char *host, uint16_t port, const socket_tuning_t *tuning, int timeout_ms);
+
+/// @brief Send data, blocking until the socket has taken all of it
+/// @param client Open connection
+/// @param data Data to send
+/// @param len Length of the data
+/// @return Number of bytes sent, or -1 on error
+ssize_t tcp_client_send(tcp_client_t *client, const void *data, size_t len);
+
+/// @brief Receive whatever data is available, waiting for some to arrive
+/// @param client Open connection
+/// @param buffer Buffer to receive into
+/// @param len Size of the buffer
+/// @param timeout_ms How long to wait (0 = wait indefinitely)
+/// @return Number of bytes received, 0 if the server closed the connection, or -1 on error or timeout
+ssize_t tcp_client_recv(tcp_client_t *client, void *buffer, size_t len, int timeout_ms);
+
+/// @brief Hold back partial segments until `tcp_client_uncork()`; only has an effect when the tuning enables `cork`
+/// @param client Open connection
+void tcp_client_cork(tcp_client_t *client);
+
+/// @brief Stop batching sends; call it before the last send of a batch
+/// @param client Open connection
+void tcp_client_uncork(tcp_client_t *client);
+
+/// @brief Buffer small writes and send them together
+/// 
+/// `tcp_client_write()` then collects messages until `size` bytes are buffered, `max_delay_ms`
+/// passes or `tcp_client_write_flush()` is called, and sends them with one sendmsg(), which usually
+/// puts them in one TCP segment. `tcp_client_send()` sends whatever is buffered ahead of its data.
+/// The `max_delay_ms` flush never blocks; if it fails, the buffered bytes are lost and every later
+/// write, send and flush returns -1.
+/// 
+/// @param client Open connection
+/// @param options Coalescing configuration (can be NULL for defaults)
+/// @return 0 on success, -1 on failure
+int tcp_client_enable_coalescing(tcp_client_t *client, const tcp_client_coalesce_options_t *options);
+
+/// @brief Write a message, coalesced with others when coalescing is enabled
+/// @param client Open connection
+/// @param data Data to write
+/// @param len Length of the data
+/// @return Number of bytes buffered or sent, or -1 on error, including a failed send of earlier buffered writes
+ssize_t tcp_client_write(tcp_client_t *client, const void *data, size_t len);
+
+/// @brief Send every buffered write now
+/// @param client Open connection
+/// @return 0 on success, -1 on error
+int tcp_client_write_flush(tcp_client_t *client);
+
+/// @brief Read the statistics of a connection
+/// @param client Open connection
+/// @param stats Filled in with the current counters
+/// @return 0 on success, -1 on invalid arguments
+int tcp_client_get_stats(tcp_client_t *client, tcp_client_stats_t *stats);
+
+/// @brief Get the socket of a connection, e.g. to wait on it with select()
+/// @param client Open connection
+/// @return Socket descriptor
+int tcp_client_socket(const tcp_client_t *client);
+
+/// @brief Switch a connection to asynchronous mode
+/// 
+/// A receiver task reads and frames the responses and hands each one to the completion callback
+/// together with the context of its request, so the sender can keep up to `max_in_flight` requests
+/// on the wire instead of waiting a round trip for each. Responses are matched to requests by order,
+/// which holds for any server that answers the requests of one connection in sequence.
+/// 
+/// `tcp_client_recv()` must not be used afterwards, and the connection should be closed rather than
+/// released to a pool.
+/// 
+/// @param client Open connection
+/// @param options Asynchronous mode configuration; `callback` is required
+/// @return 0 on success, -1 on failure
+int tcp_client_start_async(tcp_client_t *client, const tcp_client_async_options_t *options);
+
+/// @brief Send a request without waiting for its response
+/// 
+/// Safe to call from several tasks at once. If the connection fails, every outstanding request,
+/// including one whose send failed, is completed through the callback with a length of -1.
+/// A sender waiting for a free slot then fails with errno set to ENOTCONN.
+/// 
+/// @param client Connection in asynchronous mode
+/// @param data Request to send, including any framing the server expects
+/// @param len Length of the request
+/// @param context Passed to the completion callback of this request
+/// @param timeout_ms How long to wait while `max_in_flight` requests are outstanding (0 = wait indefinitely)
+/// @return Number of bytes sent, or -1 on error or timeout (the callback is not called after a timeout)
+ssize_t tcp_client_send_async(tcp_client_t *client, const void *data, size_t len, void *context, int timeout_ms);
+
+/// @brief Wait until every outstanding request has been completed
+/// @param client Connection in asynchronous mode
+/// @param timeout_ms How long to wait (0 = wait indefinitely)
+/// @return 0 once nothing is outstanding, -1 on timeout or invalid arguments
+int tcp_client_flush(tcp_client_t *client, int timeout_ms);
+
+/// @brief Close a connection and free it; the handle is invalid afterwards
+/// 
+/// Buffered writes are sent first. In asynchronous mode the receiver task completes outstanding
+/// requests as failed before the connection is freed.
+/// 
+/// @param client Connection to close (NULL is ignored)
+void tcp_client_close(tcp_client_t *client);
+
+/// @brief Create a pool of kept-alive connections
+/// 
+/// Connections released to the pool stay open, so the next request to the same host and port skips
+/// the connect and its handshake. The pool is safe to share between tasks.
+/// 
+/// @param options Optional pool configuration (can be NULL for defaults)
+/// @return Handle of the pool, or NULL on failure
+tcp_client_pool_t *tcp_client_pool_create(const tcp_client_pool_options_t *options);
+
+/// @brief Take a connection to a host and port, reusing an idle one if the pool has one
+/// 
+/// Idle connections the server has closed meanwhile are detected and skipped.
+/// 
+/// @param pool Pool to take the connection from
+/// @param host The host name or IP address to connect to
+/// @param port The port number to connect to
+/// @return Connection owned by the caller until it is released, or NULL on failure with errno set as by `tcp_client_connect()`
+tcp_client_t *tcp_client_pool_acquire(tcp_client_pool_t *pool, const char *host, uint16_t port);
+
+/// @brief Give a connection back to the pool
+/// @param pool Pool the connection was acquired from
+/// @param client Connection to give back (NULL is ignored)
+/// @param reusable False if the exchange failed or left unread data; the connection is then closed
+void tcp_client_pool_release(tcp_client_pool_t *pool, tcp_client_t *client, bool reusable);
+
+/// @brief Read the statistics of a pool
+/// @param pool Pool
+/// @param stats Filled in with the current counters
+/// @return 0 on success, -1 on invalid arguments
+int tcp_client_pool_get_stats(tcp_client_pool_t *pool, tcp_client_pool_stats_t *stats);
+
+/// @brief Close every idle connection of a pool and free it
+/// 
+/// Connections still acquired must be closed by their owners with `tcp_client_close()`.
+/// 
+/// @param pool Pool to destroy (NULL is ignored)
+void tcp_client_pool_destroy(tcp_client_pool_t *pool);
+
 /// @brief Create a TCP client connection
+/// 
+/// Wraps one process-wide connection; a new call replaces the previous connection. Use
+/// `tcp_client_connect()` for several connections at once.
+/// 
 /// @param host The hostname or IP address to connect to
 /// @param target Target parameter (currently unused)
 /// @param port The port number to connect to
@@ -20,4 +242,23 @@ send_func_t client(const char *host, const char *target, uint16_t port, recv_fun
 /// @brief Clean up the client resources
 void client_cleanup(void);
 
+/// @brief Set the socket tuning of the client, e.g. from `socket_tuning_profile()`
+/// 
+/// The tuning applies to the open connection, if any, and to connections made afterwards.
+/// 
+/// @param tuning Tuning to use (NULL = stack defaults)
+void client_set_tuning(const socket_tuning_t *tuning);
+
+/// @brief Set the deadline for the connect of `client()`
+/// @param timeout_ms Deadline in milliseconds (0 = wait for the stack's SYN retries)
+void client_set_connect_timeout(int timeout_ms);
+
+/// @brief Hold back partial segments until `client_uncork()`, to batch several small sends
+/// 
+/// Only has an effect when the client tuning enables `cork`.
+void client_cork(void);
+
+/// @brief Stop batching sends; call it before the last send of a batch
+void client_uncork(void);
+
 #endif // ABSTCP_V4_CLIENT_H
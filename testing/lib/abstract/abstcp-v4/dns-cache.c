@@ -0,0 +1,218 @@
+#include <string.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+
+#include "lwip/sockets.h"
+#include "lwip/netdb.h"
+
+#include "abstcp-v4/dns-cache.h"
+
+static const char *TAG = "abstcp-v4-dns";
+
+// Default cache settings
+#define DEFAULT_CAPACITY        8
+#define DEFAULT_TTL_MS          60000
+#define DEFAULT_NEGATIVE_TTL_MS 5000
+
+typedef struct {
+    char name[DNS_CACHE_MAX_NAME + 1]; // Empty for a free entry
+    uint32_t addr;
+    bool resolved;             // False for a cached failure
+    int64_t expires_us;
+    uint32_t used;             // `cache_clock` at the last lookup, for LRU eviction
+} dns_entry_t;
+
+static portMUX_TYPE cache_lock = portMUX_INITIALIZER_UNLOCKED; // Guards everything below
+static dns_cache_options_t cache_options;
+static dns_entry_t *cache_entries = NULL;
+static dns_cache_stats_t cache_stats;
+static uint32_t cache_clock;   // Counts lookups; timestamps can tie between lookups in the same microsecond
+
+static int getaddrinfo_resolver(const char *host, uint32_t *addr, void *user_data)
+{
+    struct addrinfo hints = {
+        .ai_family = AF_INET,
+        .ai_socktype = SOCK_STREAM,
+    };
+    struct addrinfo *result = NULL;
+    int err = getaddrinfo(host, NULL, &hints, &result);
+    if (err != 0 || !result) {
+        ESP_LOGD(TAG, "getaddrinfo(%s) failed: %d", host, err);
+        return -1;
+    }
+    *addr = ((struct sockaddr_in *)result->ai_addr)->sin_addr.s_addr;
+    freeaddrinfo(result);
+    return 0;
+}
+
+// Allocates the entries outside the lock, since a critical section must not allocate, and installs
+// them under it. With `if_unset` a cache that another caller configured meanwhile is kept.
+static int configure_cache(const dns_cache_options_t *options, bool if_unset)
+{
+    dns_cache_options_t configured = {0};
+    if (options) {
+        configured = *options;
+    }
+    if (configured.capacity <= 0) {
+        configured.capacity = DEFAULT_CAPACITY;
+    }
+    if (configured.ttl_ms <= 0) {
+        configured.ttl_ms = DEFAULT_TTL_MS;
+    }
+    if (configured.negative_ttl_ms <= 0) {
+        configured.negative_ttl_ms = DEFAULT_NEGATIVE_TTL_MS;
+    }
+    if (!configured.resolver) {
+        configured.resolver = getaddrinfo_resolver;
+    }
+
+    dns_entry_t *entries = calloc(configured.capacity, sizeof(dns_entry_t));
+    if (!entries) {
+        ESP_LOGE(TAG, "Failed to allocate memory for DNS cache");
+        return -1;
+    }
+
+    portENTER_CRITICAL(&cache_lock);
+    dns_entry_t *old_entries = cache_entries;
+    if (if_unset && old_entries) {
+        old_entries = entries;
+    } else {
+        cache_entries = entries;
+        cache_options = configured;
+        memset(&cache_stats, 0, sizeof(cache_stats));
+    }
+    portEXIT_CRITICAL(&cache_lock);
+
+    free(old_entries);
+    return 0;
+}
+
+int dns_cache_configure(const dns_cache_options_t *options)
+{
+    return configure_cache(options, false);
+}
+
+// Finds the entry for a name, or NULL. Call with cache_lock held.
+static dns_entry_t *find_entry(const char *host)
+{
+    for (int i = 0; i < cache_options.capacity; i++) {
+        if (cache_entries[i].name[0] != '\0' && strcmp(cache_entries[i].name, host) == 0) {
+            return &cache_entries[i];
+        }
+    }
+    return NULL;
+}
+
+// Picks the entry to store a new name in: a free or expired one if possible, otherwise the least
+// recently used. Call with cache_lock held.
+static dns_entry_t *claim_entry(int64_t now_us)
+{
+    dns_entry_t *oldest = &cache_entries[0];
+    for (int i = 0; i < cache_options.capacity; i++) {
+        dns_entry_t *entry = &cache_entries[i];
+        if (entry->name[0] == '\0' || entry->expires_us <= now_us) {
+            return entry;
+        }
+        if ((int32_t)(entry->used - oldest->used) < 0) {
+            oldest = entry;
+        }
+    }
+    cache_stats.evictions++;
+    return oldest;
+}
+
+int dns_resolve(const char *host, uint32_t *addr)
+{
+    if (!host || !addr) {
+        return -1;
+    }
+
+    struct in_addr parsed;
+    if (inet_pton(AF_INET, host, &parsed) == 1) {
+        *addr = parsed.s_addr;
+        return 0;
+    }
+
+    // Two first lookups may both allocate; only one set of entries is installed
+    portENTER_CRITICAL(&cache_lock);
+    bool configured = cache_entries != NULL;
+    portEXIT_CRITICAL(&cache_lock);
+    if (!configured && configure_cache(NULL, true) != 0) {
+        return -1;
+    }
+    bool cacheable = strlen(host) <= DNS_CACHE_MAX_NAME;
+
+    int64_t now_us = esp_timer_get_time();
+    int result = -1;
+    bool cached = false;
+    portENTER_CRITICAL(&cache_lock);
+    dns_entry_t *entry = cacheable ? find_entry(host) : NULL;
+    if (entry && entry->expires_us > now_us) {
+        cached = true;
+        entry->used = ++cache_clock;
+        if (entry->resolved) {
+            *addr = entry->addr;
+            result = 0;
+            cache_stats.hits++;
+        } else {
+            cache_stats.negative_hits++;
+        }
+    } else {
+        cache_stats.misses++;
+    }
+    dns_resolve_func_t resolver = cache_options.resolver;
+    void *resolver_data = cache_options.resolver_data;
+    portEXIT_CRITICAL(&cache_lock);
+    if (cached) {
+        return result;
+    }
+
+    // The resolver may block for a network round trip, so it runs without the lock
+    uint32_t resolved_addr = 0;
+    result = resolver(host, &resolved_addr, resolver_data);
+    if (result == 0) {
+        *addr = resolved_addr;
+    } else {
+        ESP_LOGW(TAG, "Unable to resolve %s", host);
+    }
+    if (!cacheable) {
+        return result;
+    }
+
+    now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&cache_lock);
+    entry = find_entry(host);
+    if (!entry) {
+        entry = claim_entry(now_us);
+        strcpy(entry->name, host);
+    }
+    entry->addr = resolved_addr;
+    entry->resolved = result == 0;
+    entry->expires_us = now_us + (int64_t)(result == 0 ? cache_options.ttl_ms : cache_options.negative_ttl_ms) * 1000;
+    entry->used = ++cache_clock;
+    portEXIT_CRITICAL(&cache_lock);
+    return result;
+}
+
+void dns_cache_flush(void)
+{
+    portENTER_CRITICAL(&cache_lock);
+    if (cache_entries) {
+        memset(cache_entries, 0, cache_options.capacity * sizeof(dns_entry_t));
+    }
+    portEXIT_CRITICAL(&cache_lock);
+}
+
+int dns_cache_get_stats(dns_cache_stats_t *stats)
+{
+    if (!stats) {
+        return -1;
+    }
+    portENTER_CRITICAL(&cache_lock);
+    *stats = cache_stats;
+    portEXIT_CRITICAL(&cache_lock);
+    return 0;
+}
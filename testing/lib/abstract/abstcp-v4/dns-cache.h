@@ -0,0 +1,61 @@
+#ifndef ABSTCP_V4_DNS_CACHE_H
+#define ABSTCP_V4_DNS_CACHE_H
+
+#include <stdint.h>
+
+/// @brief Longest host name that is cached; longer names are resolved on every lookup
+#define DNS_CACHE_MAX_NAME 64
+
+/// @brief Resolver function type
+/// @param host Host name to resolve
+/// @param addr Set to the IPv4 address in network order
+/// @param user_data User-provided data from `dns_cache_options_t`
+/// @return 0 on success, -1 if the name does not resolve
+typedef int (*dns_resolve_func_t)(const char *host, uint32_t *addr, void *user_data);
+
+/// @brief DNS cache configuration
+typedef struct {
+    int capacity;              ///< Names kept at once; the least recently used one makes room (0 = use default of 8)
+    int ttl_ms;                ///< How long a resolved address is reused (0 = use default of 60000)
+    int negative_ttl_ms;       ///< How long a failed lookup is remembered (0 = use default of 5000)
+    dns_resolve_func_t resolver; ///< Resolver for names missing from the cache, e.g. a stub for host tests (NULL = getaddrinfo())
+    void *resolver_data;       ///< Passed to the resolver
+} dns_cache_options_t;
+
+/// @brief DNS cache statistics
+typedef struct {
+    uint32_t hits;             ///< Lookups answered with a cached address
+    uint32_t negative_hits;    ///< Lookups answered with a cached failure
+    uint32_t misses;           ///< Lookups passed to the resolver
+    uint32_t evictions;        ///< Live entries dropped to make room
+} dns_cache_stats_t;
+
+/// @brief Replace the configuration of the process-wide cache and empty it
+/// 
+/// The cache works with defaults without being configured.
+/// 
+/// @param options Cache configuration (can be NULL for defaults)
+/// @return 0 on success, -1 if the cache could not be allocated
+int dns_cache_configure(const dns_cache_options_t *options);
+
+/// @brief Resolve a host name or dotted-quad address to an IPv4 address
+/// 
+/// Dotted quads are parsed without touching the cache. Names are answered from the cache while
+/// their entry is fresh, and otherwise passed to the resolver, whose answer is cached for `ttl_ms`
+/// or, on failure, for `negative_ttl_ms`. getaddrinfo() does not report record TTLs, so the cache
+/// uses the configured ones; lwIP's own resolver still honours the record TTL below it.
+/// 
+/// @param host Host name or IPv4 address
+/// @param addr Set to the IPv4 address in network order
+/// @return 0 on success, -1 if the host does not resolve
+int dns_resolve(const char *host, uint32_t *addr);
+
+/// @brief Forget every cached name, e.g. after a network change
+void dns_cache_flush(void);
+
+/// @brief Read the statistics of the cache
+/// @param stats Filled in with the current counters
+/// @return 0 on success, -1 on invalid arguments
+int dns_cache_get_stats(dns_cache_stats_t *stats);
+
+#endif // ABSTCP_V4_DNS_CACHE_H
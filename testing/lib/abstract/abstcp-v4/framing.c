@@ -0,0 +1,174 @@
+#include <string.h>
+#include <errno.h>
+#include "lwip/sockets.h"
+
+#include "abstcp-v4/framing.h"
+
+// Default length header size for FRAMER_LENGTH_PREFIX
+#define DEFAULT_LENGTH_BYTES 2
+
+static int frame_length_prefix(const char *data, int len, int *payload_offset, int *payload_len,
+                               const framer_options_t *options)
+{
+    int header = options->length_bytes > 0 ? options->length_bytes : DEFAULT_LENGTH_BYTES;
+    if (header != 1 && header != 2 && header != 4) {
+        return -1;
+    }
+    if (len < header) {
+        return 0;
+    }
+
+    uint32_t body = 0;
+    for (int i = 0; i < header; i++) {
+        body = (body << 8) | (uint8_t)data[i];
+    }
+    if (body > (uint32_t)(INT32_MAX - header)) {
+        return -1;
+    }
+    if ((uint32_t)(len - header) < body) {
+        return 0;
+    }
+
+    *payload_offset = header;
+    *payload_len = (int)body;
+    return header + (int)body;
+}
+
+static int frame_delimiter(const char *data, int len, int *payload_offset, int *payload_len,
+                           const framer_options_t *options)
+{
+    const char *delimiter = options->delimiter ? options->delimiter : "\n";
+    int delimiter_len = strlen(delimiter);
+    if (delimiter_len == 0) {
+        return -1;
+    }
+
+    for (int i = 0; i + delimiter_len <= len; i++) {
+        if (data[i] == delimiter[0] && memcmp(data + i, delimiter, delimiter_len) == 0) {
+            *payload_offset = 0;
+            *payload_len = i;
+            return i + delimiter_len;
+        }
+    }
+    return 0;
+}
+
+static int frame_fixed_size(const char *data, int len, int *payload_offset, int *payload_len,
+                            const framer_options_t *options)
+{
+    if (options->fixed_size <= 0) {
+        return -1;
+    }
+    if (len < options->fixed_size) {
+        return 0;
+    }
+
+    *payload_offset = 0;
+    *payload_len = options->fixed_size;
+    return options->fixed_size;
+}
+
+static int find_frame(const char *data, int len, int *payload_offset, int *payload_len,
+                      const framer_options_t *options)
+{
+    switch (options->type) {
+    case FRAMER_LENGTH_PREFIX:
+        return frame_length_prefix(data, len, payload_offset, payload_len, options);
+    case FRAMER_DELIMITER:
+        return frame_delimiter(data, len, payload_offset, payload_len, options);
+    case FRAMER_FIXED_SIZE:
+        return frame_fixed_size(data, len, payload_offset, payload_len, options);
+    case FRAMER_CUSTOM:
+        return options->custom ? options->custom(data, len, payload_offset, payload_len, options->custom_data) : -1;
+    default:
+        return -1;
+    }
+}
+
+static void consume(frame_buffer_t *buffer, int len)
+{
+    buffer->count -= len;
+    buffer->head = buffer->count > 0 ? (buffer->head + len) % buffer->size : 0;
+}
+
+void frame_buffer_init(frame_buffer_t *buffer, char *storage, int size)
+{
+    buffer->data = storage;
+    buffer->size = size;
+    buffer->head = 0;
+    buffer->count = 0;
+}
+
+int frame_buffer_recv(frame_buffer_t *buffer, int sock)
+{
+    if (buffer->count == buffer->size) {
+        errno = ENOBUFS;
+        return -1;
+    }
+
+    // Receive into the contiguous free run that starts at the tail
+    int tail = (buffer->head + buffer->count) % buffer->size;
+    int space = tail >= buffer->head ? buffer->size - tail : buffer->head - tail;
+    if (buffer->count == 0) {
+        buffer->head = 0;
+        tail = 0;
+        space = buffer->size;
+    }
+
+    int len = recv(sock, buffer->data + tail, space, 0);
+    if (len > 0) {
+        buffer->count += len;
+    }
+    return len;
+}
+
+int frame_buffer_next(frame_buffer_t *buffer, const framer_options_t *options, char *scratch, int scratch_size,
+                      const char **message, int *message_len)
+{
+    int payload_offset = 0;
+    int payload_len = 0;
+    int limit = options->max_message_size > 0 && options->max_message_size < buffer->size
+        ? options->max_message_size : buffer->size;
+
+    if (buffer->count == 0) {
+        return 0;
+    }
+
+    // Fast path: frame the contiguous run at the head in place
+    int contiguous = buffer->size - buffer->head;
+    if (contiguous > buffer->count) {
+        contiguous = buffer->count;
+    }
+    const char *start = buffer->data + buffer->head;
+    int frame_len = find_frame(start, contiguous, &payload_offset, &payload_len, options);
+    if (frame_len < 0) {
+        return -1;
+    }
+
+    if (frame_len == 0 && contiguous < buffer->count) {
+        // The buffered data wraps around the end of the ring: linearize it and try again
+        if (scratch_size < buffer->count) {
+            return -1;
+        }
+        memcpy(scratch, start, contiguous);
+        memcpy(scratch + contiguous, buffer->data, buffer->count - contiguous);
+        start = scratch;
+        frame_len = find_frame(start, buffer->count, &payload_offset, &payload_len, options);
+        if (frame_len < 0) {
+            return -1;
+        }
+    }
+
+    if (frame_len == 0) {
+        // A frame that has already outgrown the limit, or a full ring, can never make progress
+        return buffer->count >= limit ? -1 : 0;
+    }
+    if (frame_len > limit) {
+        return -1;
+    }
+
+    *message = start + payload_offset;
+    *message_len = payload_len;
+    consume(buffer, frame_len);
+    return 1;
+}
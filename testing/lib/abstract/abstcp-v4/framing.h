@@ -0,0 +1,73 @@
+#ifndef ABSTCP_V4_FRAMING_H
+#define ABSTCP_V4_FRAMING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/// @brief Custom framer function type
+///
+/// @param data Start of the buffered data
+/// @param len Number of buffered bytes
+/// @param payload_offset Set to the offset of the message payload within the frame
+/// @param payload_len Set to the length of the message payload
+/// @param user_data User-provided data from `framer_options_t`
+/// @return Total length of the first complete frame, 0 if more data is needed, or -1 if the data is invalid
+typedef int (*framer_func_t)(const char *data, int len, int *payload_offset, int *payload_len, void *user_data);
+
+/// @brief Message framing strategies
+typedef enum {
+    FRAMER_NONE = 0,           ///< No framing: each recv() result is delivered as is
+    FRAMER_LENGTH_PREFIX,      ///< Each message is preceded by a big-endian length header
+    FRAMER_DELIMITER,          ///< Each message ends with a delimiter, which is not delivered
+    FRAMER_FIXED_SIZE,         ///< Every message has the same size
+    FRAMER_CUSTOM,             ///< Frames are found by a user-provided `framer_func_t`
+} framer_type_t;
+
+/// @brief Framing configuration
+typedef struct {
+    framer_type_t type;        ///< Framing strategy (FRAMER_NONE = disabled)
+    int length_bytes;          ///< Size of the length header for FRAMER_LENGTH_PREFIX: 1, 2 or 4 (0 = use default of 2)
+    const char *delimiter;     ///< Delimiter for FRAMER_DELIMITER (NULL = "\n")
+    int fixed_size;            ///< Message size for FRAMER_FIXED_SIZE
+    framer_func_t custom;      ///< Framer function for FRAMER_CUSTOM
+    void *custom_data;         ///< User data passed to the custom framer
+    int max_message_size;      ///< Largest frame accepted, headers and delimiter included; also sizes the receive ring where the owner has no other size for it (0 = use default of 1024)
+} framer_options_t;
+
+/// @brief Per-connection receive ring buffer
+typedef struct {
+    char *data;                ///< Ring storage
+    int size;                  ///< Capacity of the ring in bytes
+    int head;                  ///< Offset of the oldest buffered byte
+    int count;                 ///< Number of buffered bytes
+} frame_buffer_t;
+
+/// @brief Initialize a ring buffer over caller-provided storage
+/// @param buffer Ring buffer to initialize
+/// @param storage Storage for the ring
+/// @param size Size of the storage in bytes
+void frame_buffer_init(frame_buffer_t *buffer, char *storage, int size);
+
+/// @brief Receive from a socket into the free space of the ring with a single recv() call
+/// @param buffer Ring buffer to fill
+/// @param sock Socket to receive from
+/// @return Result of recv(): bytes received, 0 when the peer closed, or -1 on error (errno is set)
+int frame_buffer_recv(frame_buffer_t *buffer, int sock);
+
+/// @brief Extract the next complete message from the ring
+///
+/// The message is returned in place when it is contiguous in the ring; only a message that wraps
+/// around the end of the ring is copied into `scratch`. The returned pointer stays valid until the
+/// next call that modifies the ring.
+///
+/// @param buffer Ring buffer to read from
+/// @param options Framing configuration
+/// @param scratch Buffer used to linearize a message that wraps around the ring
+/// @param scratch_size Size of the scratch buffer, at least the ring size
+/// @param message Set to the start of the message payload
+/// @param message_len Set to the length of the message payload
+/// @return 1 if a message was extracted, 0 if more data is needed, or -1 on a framing error
+int frame_buffer_next(frame_buffer_t *buffer, const framer_options_t *options, char *scratch, int scratch_size,
+                      const char **message, int *message_len);
+
+#endif // ABSTCP_V4_FRAMING_H
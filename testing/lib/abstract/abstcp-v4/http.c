@@ -0,0 +1,311 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include "esp_log.h"
+
+#include "abstcp-v4/http.h"
+
+static const char *TAG = "abstcp-v4-http";
+
+// Default block size for HTTP servers; bounds a request including its headers and body
+#define HTTP_DEFAULT_BUFFER_SIZE 4096
+
+static bool view_equals_nocase(const char *data, int len, const char *text)
+{
+    return (int)strlen(text) == len && strncasecmp(data, text, len) == 0;
+}
+
+bool http_view_equals(http_view_t view, const char *text)
+{
+    return view.data && (int)strlen(text) == view.len && memcmp(view.data, text, view.len) == 0;
+}
+
+http_view_t http_request_header(const http_request_t *request, const char *name)
+{
+    for (int i = 0; i < request->header_count; i++) {
+        if (view_equals_nocase(request->headers[i].name.data, request->headers[i].name.len, name)) {
+            return request->headers[i].value;
+        }
+    }
+    http_view_t absent = { NULL, 0 };
+    return absent;
+}
+
+// Finds "\r\n\r\n". Returns the offset just past it, or 0 if the headers are incomplete.
+static int find_header_end(const char *data, int len)
+{
+    for (int i = 3; i < len; i++) {
+        if (data[i] == '\n' && data[i - 1] == '\r' && data[i - 2] == '\n' && data[i - 3] == '\r') {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+// Finds the Content-Length or chunked Transfer-Encoding in raw headers. Returns the body length,
+// or -1 for a chunked or invalid body.
+static int find_content_length(const char *data, int header_len)
+{
+    static const char content_length[] = "content-length:";
+    static const char transfer_encoding[] = "transfer-encoding:";
+
+    const char *line = data;
+    const char *end = data + header_len;
+    while (line < end) {
+        const char *eol = memchr(line, '\n', end - line);
+        if (!eol) {
+            break;
+        }
+        int line_len = eol - line;
+        if (line_len > (int)sizeof(content_length) - 1 &&
+            strncasecmp(line, content_length, sizeof(content_length) - 1) == 0) {
+            long value = 0;
+            const char *p = line + sizeof(content_length) - 1;
+            while (p < eol && (*p == ' ' || *p == '\t')) {
+                p++;
+            }
+            if (p == eol || *p < '0' || *p > '9') {
+                return -1;
+            }
+            while (p < eol && *p >= '0' && *p <= '9') {
+                value = value * 10 + (*p++ - '0');
+                if (value > INT32_MAX / 2) {
+                    return -1;
+                }
+            }
+            return (int)value;
+        }
+        if (line_len > (int)sizeof(transfer_encoding) - 1 &&
+            strncasecmp(line, transfer_encoding, sizeof(transfer_encoding) - 1) == 0) {
+            return -1;
+        }
+        line = eol + 1;
+    }
+    return 0;
+}
+
+// Custom framer: a request is its headers plus Content-Length bytes of body
+static int http_framer(const char *data, int len, int *payload_offset, int *payload_len, void *user_data)
+{
+    int header_len = find_header_end(data, len);
+    if (header_len == 0) {
+        return 0;
+    }
+    int body_len = find_content_length(data, header_len);
+    if (body_len < 0) {
+        return -1;
+    }
+    if (len < header_len + body_len) {
+        return 0;
+    }
+    *payload_offset = 0;
+    *payload_len = header_len + body_len;
+    return header_len + body_len;
+}
+
+// Splits off the text up to a separator. Returns the position after the separator, or NULL if it is missing.
+static const char *split(const char *p, const char *end, char separator, http_view_t *view)
+{
+    const char *found = memchr(p, separator, end - p);
+    if (!found) {
+        return NULL;
+    }
+    view->data = p;
+    view->len = found - p;
+    return found + 1;
+}
+
+static http_view_t trim(const char *start, const char *end)
+{
+    while (start < end && (*start == ' ' || *start == '\t')) {
+        start++;
+    }
+    while (end > start && (end[-1] == ' ' || end[-1] == '\t' || end[-1] == '\r')) {
+        end--;
+    }
+    http_view_t view = { start, end - start };
+    return view;
+}
+
+// Parses a complete framed request in place. Returns 0, or -1 if it is malformed.
+static int parse_request(const char *data, int len, http_request_t *request)
+{
+    memset(request, 0, sizeof(*request));
+    int header_len = find_header_end(data, len);
+    const char *p = data;
+    const char *end = data + header_len;
+
+    http_view_t version;
+    p = split(p, end, ' ', &request->method);
+    p = p ? split(p, end, ' ', &request->target) : NULL;
+    p = p ? split(p, end, '\n', &version) : NULL;
+    if (!p || request->method.len == 0 || request->target.len == 0) {
+        return -1;
+    }
+    version = trim(version.data, version.data + version.len);
+    if (version.len != 8 || memcmp(version.data, "HTTP/1.", 7) != 0 || version.data[7] < '0' || version.data[7] > '1') {
+        return -1;
+    }
+    request->version_minor = version.data[7] - '0';
+
+    request->path = request->target;
+    const char *query = memchr(request->target.data, '?', request->target.len);
+    if (query) {
+        request->path.len = query - request->target.data;
+        request->query.data = query + 1;
+        request->query.len = request->target.data + request->target.len - (query + 1);
+    }
+
+    // Header lines run up to the blank line that ends the headers
+    while (p < end) {
+        const char *eol = memchr(p, '\n', end - p);
+        if (!eol || eol - p <= 1) {
+            break;
+        }
+        const char *colon = memchr(p, ':', eol - p);
+        if (!colon) {
+            return -1;
+        }
+        if (request->header_count < HTTP_MAX_HEADERS) {
+            http_header_t *header = &request->headers[request->header_count++];
+            header->name = trim(p, colon);
+            header->value = trim(colon + 1, eol);
+        }
+        p = eol + 1;
+    }
+
+    request->body.data = data + header_len;
+    request->body.len = len - header_len;
+
+    // HTTP/1.1 keeps the connection open unless asked not to; HTTP/1.0 only when asked to
+    http_view_t connection = http_request_header(request, "Connection");
+    if (request->version_minor >= 1) {
+        request->keep_alive = !(connection.data && view_equals_nocase(connection.data, connection.len, "close"));
+    } else {
+        request->keep_alive = connection.data && view_equals_nocase(connection.data, connection.len, "keep-alive");
+    }
+    return 0;
+}
+
+static bool path_matches(const char *pattern, http_view_t path)
+{
+    int pattern_len = strlen(pattern);
+    if (pattern_len > 0 && pattern[pattern_len - 1] == '*') {
+        return path.len >= pattern_len - 1 && memcmp(path.data, pattern, pattern_len - 1) == 0;
+    }
+    return http_view_equals(path, pattern);
+}
+
+static const char *status_reason(int status)
+{
+    switch (status) {
+    case 200: return "OK";
+    case 201: return "Created";
+    case 204: return "No Content";
+    case 301: return "Moved Permanently";
+    case 302: return "Found";
+    case 304: return "Not Modified";
+    case 400: return "Bad Request";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 413: return "Content Too Large";
+    case 500: return "Internal Server Error";
+    case 503: return "Service Unavailable";
+    default:  return "";
+    }
+}
+
+// Looks up the route and runs its handler. Returns 0, or -1 to close without a response.
+static int dispatch(const http_router_t *router, const http_request_t *request, http_response_t *response)
+{
+    bool path_found = false;
+    for (int i = 0; i < router->route_count; i++) {
+        const http_route_t *route = &router->routes[i];
+        if (!path_matches(route->path, request->path)) {
+            continue;
+        }
+        path_found = true;
+        // HEAD is answered by the GET route, without the body
+        if (!route->method || http_view_equals(request->method, route->method) ||
+            (http_view_equals(request->method, "HEAD") && strcmp(route->method, "GET") == 0)) {
+            return route->handler(request, response, router->user_data);
+        }
+    }
+    response->status = path_found ? 405 : 404;
+    return 0;
+}
+
+// Scatter-gather callback of the TCP server: one call answers one request
+static int http_respond(const char *request_data, int request_len, server_response_t *response, void *user_data)
+{
+    const http_router_t *router = (const http_router_t *)user_data;
+
+    http_request_t request;
+    http_response_t reply = {
+        .status = 200,
+        .buffer = response->scratch + HTTP_HEADER_RESERVE,
+        .buffer_size = response->scratch_size - HTTP_HEADER_RESERVE,
+    };
+    bool keep_alive = false;
+    const char *connection = "Connection: close\r\n";
+    if (parse_request(request_data, request_len, &request) < 0) {
+        reply.status = 400;
+    } else {
+        keep_alive = request.keep_alive;
+        if (dispatch(router, &request, &reply) < 0) {
+            return -1;
+        }
+    }
+    if (keep_alive) {
+        // An HTTP/1.0 client only keeps the connection if the response confirms it
+        connection = request.version_minor >= 1 ? "" : "Connection: keep-alive\r\n";
+    }
+
+    int header_len = snprintf(response->scratch, HTTP_HEADER_RESERVE,
+                              "HTTP/1.1 %d %s\r\nContent-Length: %u\r\n%s%s%s%s%s\r\n",
+                              reply.status, status_reason(reply.status), (unsigned)reply.body_len,
+                              reply.content_type ? "Content-Type: " : "", reply.content_type ? reply.content_type : "",
+                              reply.content_type ? "\r\n" : "", connection,
+                              reply.headers ? reply.headers : "");
+    if (header_len < 0 || header_len >= HTTP_HEADER_RESERVE) {
+        ESP_LOGE(TAG, "Response headers exceed %d bytes", HTTP_HEADER_RESERVE);
+        return -1;
+    }
+
+    response->segments[0].data = response->scratch;
+    response->segments[0].len = header_len;
+    response->segment_count = 1;
+    if (reply.body && reply.body_len > 0 && !http_view_equals(request.method, "HEAD")) {
+        response->segments[1].data = reply.body;
+        response->segments[1].len = reply.body_len;
+        response->segment_count = 2;
+    }
+    response->close = !keep_alive;
+    return 0;
+}
+
+tcp_server_t *http_server_start(uint16_t port, const char *host, const http_router_t *router, server_options_t *options)
+{
+    if (!router) {
+        return NULL;
+    }
+
+    server_options_t http_options = {0};
+    if (options) {
+        http_options = *options;
+    }
+    memset(&http_options.framer, 0, sizeof(http_options.framer));
+    http_options.framer.type = FRAMER_CUSTOM;
+    http_options.framer.custom = http_framer;
+    http_options.response_iov_callback = http_respond;
+    if (http_options.buffer_size <= 0) {
+        http_options.buffer_size = HTTP_DEFAULT_BUFFER_SIZE;
+    }
+    if (http_options.buffer_size <= HTTP_HEADER_RESERVE) {
+        ESP_LOGE(TAG, "Buffer size %d leaves no room for responses", http_options.buffer_size);
+        return NULL;
+    }
+
+    return tcp_server_start(port, host, NULL, (void *)router, &http_options);
+}
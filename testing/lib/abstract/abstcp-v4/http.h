@@ -0,0 +1,103 @@
+#ifndef ABSTCP_V4_HTTP_H
+#define ABSTCP_V4_HTTP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "abstcp-v4/server.h"
+
+/// @brief Maximum number of request headers kept; further headers are ignored
+#define HTTP_MAX_HEADERS 16
+
+/// @brief Bytes at the start of the scratch buffer reserved for the response status line and headers
+#define HTTP_HEADER_RESERVE 256
+
+/// @brief Read-only view into the receive buffer; not NUL-terminated
+typedef struct {
+    const char *data;          ///< Start of the text (NULL when absent)
+    int len;                   ///< Length of the text
+} http_view_t;
+
+/// @brief One request header
+typedef struct {
+    http_view_t name;          ///< Header name as received
+    http_view_t value;         ///< Value without surrounding whitespace
+} http_header_t;
+
+/// @brief Request parsed in place; the views are only valid while the handler runs
+typedef struct {
+    http_view_t method;        ///< Request method, e.g. "GET"
+    http_view_t target;        ///< Full request target
+    http_view_t path;          ///< Target up to the query string
+    http_view_t query;         ///< Query string without the '?' (empty when absent)
+    int version_minor;         ///< 1 for HTTP/1.1, 0 for HTTP/1.0
+    http_header_t headers[HTTP_MAX_HEADERS]; ///< Headers in received order
+    int header_count;          ///< Number of valid entries in `headers`
+    http_view_t body;          ///< Request body, sized by Content-Length
+    bool keep_alive;           ///< Whether the connection stays open after the response
+} http_request_t;
+
+/// @brief Response filled in by a route handler
+typedef struct {
+    int status;                ///< Status code (preset to 200)
+    const char *content_type;  ///< Content-Type header (NULL = none)
+    const char *headers;       ///< Extra header lines, each ending in "\r\n" (NULL = none)
+    const void *body;          ///< Body, sent without copying; static data or `buffer` (NULL = empty)
+    size_t body_len;           ///< Length of the body
+    char *buffer;              ///< Server-owned buffer for generated bodies
+    int buffer_size;           ///< Size of `buffer`
+} http_response_t;
+
+/// @brief Route handler function type
+/// @param request Parsed request
+/// @param response Response to fill in
+/// @param user_data User data from the router
+/// @return 0 on success, or -1 to close the connection without a response
+typedef int (*http_handler_t)(const http_request_t *request, http_response_t *response, void *user_data);
+
+/// @brief One entry of a static route table
+typedef struct {
+    const char *method;        ///< Method to match (NULL = any)
+    const char *path;          ///< Exact path, or a prefix when it ends in '*'
+    http_handler_t handler;    ///< Handler for matching requests
+} http_route_t;
+
+/// @brief Routes served by an HTTP server; must outlive the server, e.g. a static constant
+typedef struct {
+    const http_route_t *routes; ///< Route table, searched in order
+    int route_count;           ///< Number of entries in `routes`
+    void *user_data;           ///< Passed to every handler
+} http_router_t;
+
+/// @brief Find the first header with a given name, ignoring case
+/// @param request Parsed request
+/// @param name Header name
+/// @return The header value, or a view with NULL data if the header is absent
+http_view_t http_request_header(const http_request_t *request, const char *name);
+
+/// @brief Compare a view with a C string
+/// @param view View to compare
+/// @param text NUL-terminated text
+/// @return True if both hold the same bytes
+bool http_view_equals(http_view_t view, const char *text);
+
+/// @brief Start an HTTP/1.1 server on top of the TCP server
+/// 
+/// Requests are framed by their headers and Content-Length and parsed in place in the connection's
+/// receive ring, so nothing is copied or allocated per request. Connections are kept alive unless
+/// the client asks otherwise, and pipelined requests are answered in order, with one send per
+/// response.
+/// Unknown paths are answered with 404, a known path with the wrong method with 405, and malformed
+/// requests with 400 before the connection is closed. Requests that cannot be framed, i.e. with a
+/// chunked body or larger than the buffer size, close the connection.
+/// 
+/// @param port The port number to listen on
+/// @param host The host address to bind to (NULL or empty string for INADDR_ANY)
+/// @param router Routes to serve
+/// @param options Optional server configuration (can be NULL for defaults); framing and the response
+///                callback are set by the HTTP layer, and `buffer_size` defaults to 4096, which bounds a request
+/// @return Handle of the running server, stopped with `tcp_server_stop()`, or NULL on failure
+tcp_server_t *http_server_start(uint16_t port, const char *host, const http_router_t *router, server_options_t *options);
+
+#endif // ABSTCP_V4_HTTP_H
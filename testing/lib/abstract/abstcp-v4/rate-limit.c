@@ -0,0 +1,73 @@
+#include <stdint.h>
+
+#include "abstcp-v4/rate-limit.h"
+
+// Bucket levels are kept in millionths of a token, so a refill is exact to the microsecond
+#define LEVEL_SCALE 1000000LL
+
+static int64_t capacity(const rate_limit_t *limit)
+{
+    return (int64_t)(limit->burst > 0 ? limit->burst : limit->rate) * LEVEL_SCALE;
+}
+
+static void refill(token_bucket_t *bucket, const rate_limit_t *limit, int64_t now_us)
+{
+    int64_t elapsed_us = now_us - bucket->updated_us;
+    bucket->updated_us = now_us;
+    if (elapsed_us <= 0) {
+        return;
+    }
+
+    // After a long enough pause the product would overflow; any debt is long paid off by then
+    int64_t full = capacity(limit);
+    if (elapsed_us > INT64_MAX / 4 / limit->rate) {
+        bucket->level = full;
+        return;
+    }
+    bucket->level += elapsed_us * limit->rate;
+    if (bucket->level > full) {
+        bucket->level = full;
+    }
+}
+
+bool rate_limit_enabled(const rate_limit_t *limit)
+{
+    return limit->rate > 0;
+}
+
+void token_bucket_init(token_bucket_t *bucket, const rate_limit_t *limit, int64_t now_us)
+{
+    bucket->level = capacity(limit);
+    bucket->updated_us = now_us;
+}
+
+bool token_bucket_take(token_bucket_t *bucket, const rate_limit_t *limit, uint32_t tokens, int64_t now_us)
+{
+    if (!rate_limit_enabled(limit)) {
+        return true;
+    }
+    refill(bucket, limit, now_us);
+    if (bucket->level < (int64_t)tokens * LEVEL_SCALE) {
+        return false;
+    }
+    bucket->level -= (int64_t)tokens * LEVEL_SCALE;
+    return true;
+}
+
+bool token_bucket_available(token_bucket_t *bucket, const rate_limit_t *limit, int64_t now_us)
+{
+    if (!rate_limit_enabled(limit)) {
+        return true;
+    }
+    refill(bucket, limit, now_us);
+    return bucket->level >= LEVEL_SCALE;
+}
+
+void token_bucket_charge(token_bucket_t *bucket, const rate_limit_t *limit, uint32_t tokens, int64_t now_us)
+{
+    if (!rate_limit_enabled(limit)) {
+        return;
+    }
+    refill(bucket, limit, now_us);
+    bucket->level -= (int64_t)tokens * LEVEL_SCALE;
+}
@@ -0,0 +1,56 @@
+#ifndef ABSTCP_V4_RATE_LIMIT_H
+#define ABSTCP_V4_RATE_LIMIT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/// @brief Token bucket configuration
+typedef struct {
+    uint32_t rate;             ///< Tokens added per second (0 = unlimited)
+    uint32_t burst;            ///< Capacity of the bucket (0 = one second's worth of tokens)
+} rate_limit_t;
+
+/// @brief Token bucket state; not thread safe, callers serialize access
+typedef struct {
+    int64_t level;             ///< Tokens in millionths, negative while paying off a debt
+    int64_t updated_us;        ///< Time of the last refill
+} token_bucket_t;
+
+/// @brief Check whether a limit is configured
+/// @param limit Limit to check
+/// @return True if the limit has a rate
+bool rate_limit_enabled(const rate_limit_t *limit);
+
+/// @brief Fill a bucket to its capacity
+/// @param bucket Bucket to initialize
+/// @param limit Limit of the bucket
+/// @param now_us Current time, e.g. from esp_timer_get_time()
+void token_bucket_init(token_bucket_t *bucket, const rate_limit_t *limit, int64_t now_us);
+
+/// @brief Take tokens only if the bucket holds enough of them, e.g. to admit a connection
+/// @param bucket Bucket to take from
+/// @param limit Limit of the bucket (unlimited always succeeds)
+/// @param tokens Number of tokens to take
+/// @param now_us Current time
+/// @return True if the tokens were taken
+bool token_bucket_take(token_bucket_t *bucket, const rate_limit_t *limit, uint32_t tokens, int64_t now_us);
+
+/// @brief Check whether the bucket has tokens left, e.g. before reading from a socket
+/// @param bucket Bucket to check
+/// @param limit Limit of the bucket (unlimited always has tokens)
+/// @param now_us Current time
+/// @return True if at least one token is available
+bool token_bucket_available(token_bucket_t *bucket, const rate_limit_t *limit, int64_t now_us);
+
+/// @brief Take tokens for work already done, going into debt if the bucket runs short
+/// 
+/// The debt is paid off by later refills, so a large read holds back the next one for as long as
+/// the rate demands.
+/// 
+/// @param bucket Bucket to charge
+/// @param limit Limit of the bucket (unlimited is ignored)
+/// @param tokens Number of tokens to charge
+/// @param now_us Current time
+void token_bucket_charge(token_bucket_t *bucket, const rate_limit_t *limit, uint32_t tokens, int64_t now_us);
+
+#endif // ABSTCP_V4_RATE_LIMIT_H
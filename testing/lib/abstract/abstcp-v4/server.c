@@ -1,13 +1,17 @@
+#include <stdio.h>
 #include <string.h>
 #include <sys/param.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
 #include "esp_system.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "esp_log.h"
 #include "nvs_flash.h"
 #include "esp_netif.h"
+#include "esp_timer.h"
 
 #include "lwip/err.h"
 #include "lwip/sockets.h"
@@ -15,6 +19,17 @@
 #include <lwip/netdb.h>
 
 #include "abstcp-v4/server.h"
+#include "abstcp-v4/buffer-pool.h"
+#include "abstcp-v4/socket-tuning.h"
+#include "abstcp-v4/timer-wheel.h"
+#include "abstcp-v4/rate-limit.h"
+
+// Set to 0 to compile the server's trace points out
+#ifndef CONFIG_ABSTCP_SERVER_TRACE
+#define CONFIG_ABSTCP_SERVER_TRACE 1
+#endif
+#define ABSTRACE_ENABLED CONFIG_ABSTCP_SERVER_TRACE
+#include "abssys/abstrace.h"
 
 static const char *TAG = "abstcp-v4-server";
 
@@ -23,82 +38,1299 @@ static const char *TAG = "abstcp-v4-server";
 #define DEFAULT_KEEPALIVE_INTERVAL 75
 #define DEFAULT_KEEPALIVE_COUNT    9
 
+// Default number of clients served concurrently by each event loop
+#define DEFAULT_MAX_CLIENTS        4
+
+// Default size of the pooled rx/tx blocks, which also bounds a framed message
+#define DEFAULT_BUFFER_SIZE        1024
+
+// Default server task settings
+#define DEFAULT_TASK_PRIORITY      5
+#define SERVER_TASK_STACK_SIZE     4096
+
+// How long a worker with open clients waits in select() before checking the queue for new ones
+#define WORKER_POLL_INTERVAL_MS    10
+
+// How often event loops wake up to check whether the server is being stopped
+#define STOP_POLL_INTERVAL_MS      100
+
+// Resolution of the idle and read timeouts; one timer wheel tick
+#define TIMEOUT_TICK_MS            100
+
+// How long a loop with throttled clients waits in select() before checking their buckets again
+#define THROTTLE_POLL_INTERVAL_MS  10
+
+// Number of client addresses tracked by admission control and the per-IP rate limits
+#define MAX_SOURCES                16
+
+// Lifecycle of the event loops, read by every server task
+typedef enum {
+    SERVER_RUNNING = 0,        // Accepting and serving connections
+    SERVER_DRAINING,           // No longer accepting; loops exit once their connections are closed
+    SERVER_CLOSING,            // Drain timed out; loops close their connections and exit
+} server_state_t;
+
 typedef struct {
+    int sock;
     uint16_t port;
-    const char *host;
+} server_listener_t;
+
+// Admission and rate limiting state of one client address, shared by every loop of the server
+typedef struct {
+    bool used;
+    uint32_t addr;             // Network order
+    int connections;           // Open connections from the address
+    int64_t last_seen_us;
+    token_bucket_t accepts;
+    token_bucket_t receive;
+} client_source_t;
+
+// Accepted socket handed from the accept task to a worker
+typedef struct {
+    int sock;
+    int source;                // Index in the server's sources, or -1 when untracked
+} queued_client_t;
+
+struct tcp_server {
+    server_listener_t listeners[SERVER_MAX_LISTENERS];
+    int listener_count;        // Published after the listener is set up, so loops may read it at any time
     response_func_t response_callback;
+    response_iov_func_t response_iov_callback;
     void *user_data;
     int keepalive_idle;
     int keepalive_interval;
     int keepalive_count;
     int max_connections;
-} server_config_t;
+    int max_clients;
+    int worker_count;
+    int core_mask;
+    int task_priority;
+    framer_options_t framer;
+    int buffer_size;
+    int buffer_count;
+    buffer_pool_t *pool;
+    bool owns_pool;
+    socket_tuning_t tuning;
+    int output_high_watermark; // Queued output at which a client stops being read
+    int output_low_watermark;  // Queued output at which reading resumes
+    uint32_t idle_timeout_ticks; // 0 = disabled
+    uint32_t read_timeout_ticks; // 0 = disabled
+    int max_connections_per_ip;
+    rate_limit_t accept_rate;
+    rate_limit_t ip_accept_rate;
+    rate_limit_t receive_rate;
+    rate_limit_t ip_receive_rate;
+    bool track_sources;        // Some per-IP or accept limit is configured
+    bool receive_limited;      // A receive rate is configured
+    client_source_t sources[MAX_SOURCES];
+    token_bucket_t accept_bucket;
+    token_bucket_t receive_bucket;
+    portMUX_TYPE limits_lock;  // Guards the sources and buckets, which every loop uses
+    QueueHandle_t accept_queue;
+    int state;                 // server_state_t
+    bool accepting;            // Cleared once the accept task of a worker pool has stopped queueing sockets
+    int tasks_running;
+    SemaphoreHandle_t tasks_done; // Given by the last server task to exit
+    tcp_server_stats_t *stats; // Slot 0 for the accept task, then one per worker; NULL while the loops are stopped
+    int stats_count;
+    int workers_started;
+    tcp_server_stats_t retired; // Counters of event loops stopped by tcp_server_update_options()
+    portMUX_TYPE stats_lock;   // Guards swapping `stats` against tcp_server_get_stats()
+};
+
+// Output waiting for a socket that was not writable, kept in a chain of pool blocks
+typedef struct output_block {
+    struct output_block *next;
+    int start;                 // Offset of the first unsent byte in `data`
+    int end;                   // Offset past the last queued byte
+    char data[];
+} output_block_t;
+
+// Per-connection state
+typedef struct {
+    int sock;                  // -1 when the slot is free
+    timer_entry_t timer;       // Armed at the connection's earliest timeout while timeouts are enabled
+    uint32_t last_activity;    // Tick of the last byte received or sent
+    uint32_t message_started_at; // Tick at which the partial message in the ring started to arrive
+    bool reading_message;      // The ring holds part of a message and the read timeout runs
+    int source;                // Index in the server's sources, or -1 when untracked
+    bool throttled;            // Reading is deferred until the receive buckets refill
+    frame_buffer_t rx;         // Receive ring over a pool block, only held while framing is enabled
+    int64_t opened_at;         // esp_timer_get_time() when the loop took the connection
+    output_block_t *out_head;  // Output queue, oldest block first
+    output_block_t *out_tail;
+    int queued;                // Bytes in the output queue
+    bool paused;               // Reading stopped at the high watermark until the queue drains to the low one
+    bool streaming;            // A streamed response is waiting for the output queue to drain
+    bool read_closed;          // The client closed its side; the connection closes once its output is sent
+    bool close_requested;      // A response asked to close the connection; it closes once its output is sent
+    server_response_t stream;  // State of that streamed response
+    const char *request;       // Request the streamed response answers
+    int request_len;
+    char *request_block;       // Pool block holding `request` when it is not in the receive ring
+    int stream_chunks;
+} server_conn_t;
+
+// State of one event loop: the accept task when there are no workers, or a single worker
+typedef struct {
+    tcp_server_t *server;
+    bool accepts;              // Accepts from the listeners itself; false for workers, which are fed by the accept queue
+    server_conn_t *conns;
+    int active;
+    tcp_server_stats_t *stats; // Owned by this loop's task
+    timer_wheel_t timers;      // Timeouts of this loop's connections
+    uint32_t now;              // Current tick, refreshed once per pass of the loop
+} server_loop_t;
+
+// Responses produced for the messages of one read, sent together
+typedef struct {
+    char *buffer;
+    int size;
+    int used;
+} response_batch_t;
+
+// Adds a sample to a histogram whose bucket i counts values in [2^i, 2^(i+1))
+static void histogram_add(uint32_t *histogram, uint32_t value)
+{
+    int bucket = value > 0 ? 31 - __builtin_clz(value) : 0;
+    if (bucket >= SERVER_HISTOGRAM_BUCKETS) {
+        bucket = SERVER_HISTOGRAM_BUCKETS - 1;
+    }
+    histogram[bucket]++;
+}
+
+// Returns the upper bound of the bucket holding the given percentile, or 0 without samples
+static uint32_t histogram_percentile(const uint32_t *histogram, int percent)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < SERVER_HISTOGRAM_BUCKETS; i++) {
+        total += histogram[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+
+    uint64_t rank = (total * percent + 99) / 100;
+    uint64_t seen = 0;
+    for (int i = 0; i < SERVER_HISTOGRAM_BUCKETS; i++) {
+        seen += histogram[i];
+        if (seen >= rank) {
+            return (uint32_t)((2ULL << i) - 1);
+        }
+    }
+    return UINT32_MAX;
+}
+
+static void record_callback_time(tcp_server_stats_t *stats, int64_t start)
+{
+    uint32_t elapsed = (uint32_t)(esp_timer_get_time() - start);
+    stats->callbacks++;
+    stats->callback_time_us += elapsed;
+    if (elapsed > stats->callback_max_us) {
+        stats->callback_max_us = elapsed;
+    }
+}
+
+// Finds the source of an address, taking a free slot or the least recently seen one without open
+// connections for a new address. Returns its index, or -1 if every slot is in use. Call with limits_lock held.
+static int find_source(tcp_server_t *server, uint32_t addr, int64_t now_us)
+{
+    int free_slot = -1;
+    for (int i = 0; i < MAX_SOURCES; i++) {
+        client_source_t *source = &server->sources[i];
+        if (source->used && source->addr == addr) {
+            return i;
+        }
+        if (!source->used || source->connections == 0) {
+            if (free_slot < 0 || !source->used ||
+                (server->sources[free_slot].used && source->last_seen_us < server->sources[free_slot].last_seen_us)) {
+                free_slot = i;
+            }
+        }
+    }
+    if (free_slot < 0) {
+        return -1;
+    }
+
+    client_source_t *source = &server->sources[free_slot];
+    source->used = true;
+    source->addr = addr;
+    source->connections = 0;
+    token_bucket_init(&source->accepts, &server->ip_accept_rate, now_us);
+    token_bucket_init(&source->receive, &server->ip_receive_rate, now_us);
+    return free_slot;
+}
 
-static void handle_client_connection(int sock, response_func_t response_callback, void *user_data)
+// Decides whether to serve a new connection from an address. Returns false to reject it; on
+// success `source` is set to the address's slot, which the connection holds until it is closed.
+static bool admit_connection(tcp_server_t *server, uint32_t addr, int *source)
 {
-    char rx_buffer[1024];
-    int len;
+    *source = -1;
+    if (!server->track_sources) {
+        return true;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    bool admitted = false;
+    portENTER_CRITICAL(&server->limits_lock);
+    int index = find_source(server, addr, now_us);
+    if (index >= 0) {
+        client_source_t *entry = &server->sources[index];
+        entry->last_seen_us = now_us;
+        admitted = (server->max_connections_per_ip <= 0 || entry->connections < server->max_connections_per_ip) &&
+                   token_bucket_take(&entry->accepts, &server->ip_accept_rate, 1, now_us) &&
+                   token_bucket_take(&server->accept_bucket, &server->accept_rate, 1, now_us);
+        if (admitted) {
+            entry->connections++;
+            *source = index;
+        }
+    }
+    portEXIT_CRITICAL(&server->limits_lock);
+    return admitted;
+}
+
+static void release_source(tcp_server_t *server, int source)
+{
+    if (source < 0) {
+        return;
+    }
+    portENTER_CRITICAL(&server->limits_lock);
+    server->sources[source].connections--;
+    portEXIT_CRITICAL(&server->limits_lock);
+}
+
+// Checks whether a connection may be read now, i.e. neither the global nor its address's receive bucket is empty
+static bool receive_allowed(tcp_server_t *server, server_conn_t *conn)
+{
+    if (!server->receive_limited) {
+        return true;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&server->limits_lock);
+    bool allowed = token_bucket_available(&server->receive_bucket, &server->receive_rate, now_us) &&
+                   (conn->source < 0 ||
+                    token_bucket_available(&server->sources[conn->source].receive, &server->ip_receive_rate, now_us));
+    portEXIT_CRITICAL(&server->limits_lock);
+    return allowed;
+}
 
+static void charge_receive(tcp_server_t *server, server_conn_t *conn, int len)
+{
+    if (!server->receive_limited) {
+        return;
+    }
+
+    int64_t now_us = esp_timer_get_time();
+    portENTER_CRITICAL(&server->limits_lock);
+    token_bucket_charge(&server->receive_bucket, &server->receive_rate, len, now_us);
+    if (conn->source >= 0) {
+        token_bucket_charge(&server->sources[conn->source].receive, &server->ip_receive_rate, len, now_us);
+    }
+    portEXIT_CRITICAL(&server->limits_lock);
+}
+
+static int output_block_capacity(tcp_server_t *server)
+{
+    return server->buffer_size - (int)sizeof(output_block_t);
+}
+
+// Copies bytes to the end of the output queue. Returns 0, or -1 if the buffer pool is exhausted.
+static int output_append(server_loop_t *loop, server_conn_t *conn, const char *data, int len)
+{
+    tcp_server_t *server = loop->server;
+    int capacity = output_block_capacity(server);
+
+    while (len > 0) {
+        output_block_t *block = conn->out_tail;
+        if (!block || block->end == capacity) {
+            block = (output_block_t *)buffer_pool_alloc(server->pool);
+            if (!block) {
+                ESP_LOGE(TAG, "Buffer pool exhausted, closing connection");
+                return -1;
+            }
+            block->next = NULL;
+            block->start = 0;
+            block->end = 0;
+            if (conn->out_tail) {
+                conn->out_tail->next = block;
+            } else {
+                conn->out_head = block;
+            }
+            conn->out_tail = block;
+        }
+
+        int chunk = MIN(len, capacity - block->end);
+        memcpy(block->data + block->end, data, chunk);
+        block->end += chunk;
+        data += chunk;
+        len -= chunk;
+        conn->queued += chunk;
+        loop->stats->queued_bytes += chunk;
+    }
+
+    if ((uint32_t)conn->queued > loop->stats->queue_max_bytes) {
+        loop->stats->queue_max_bytes = conn->queued;
+    }
+    return 0;
+}
+
+static void output_clear(server_loop_t *loop, server_conn_t *conn)
+{
+    while (conn->out_head) {
+        output_block_t *block = conn->out_head;
+        conn->out_head = block->next;
+        buffer_pool_free(loop->server->pool, (char *)block);
+    }
+    conn->out_tail = NULL;
+    loop->stats->queued_bytes -= conn->queued;
+    conn->queued = 0;
+}
+
+// Makes one sendmsg() call without blocking. Returns the bytes sent (0 if the socket is full) or -1 on error.
+static ssize_t send_nonblocking(server_loop_t *loop, server_conn_t *conn, struct iovec *iov, int iov_count)
+{
+    struct msghdr msg = {
+        .msg_iov = iov,
+        .msg_iovlen = iov_count,
+    };
+
+    ssize_t written;
     do {
-        len = recv(sock, rx_buffer, sizeof(rx_buffer) - 1, 0);
-        if (len < 0) {
+        written = sendmsg(conn->sock, &msg, 0);
+    } while (written < 0 && errno == EINTR);
+
+    if (written < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+        ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
+        return -1;
+    }
+    ABSTRACE(TRACE_TCP_SERVER_SEND, conn->sock, written);
+    loop->stats->bytes_out += written;
+    if (written > 0) {
+        conn->last_activity = loop->now;
+    }
+    return written;
+}
+
+// Sends the segments without blocking and copies whatever the socket does not take to the output
+// queue. Output that is already queued goes first, so nothing is sent out of order. Returns 0 or -1.
+static int send_segments(server_loop_t *loop, server_conn_t *conn, const server_segment_t *segments, int count)
+{
+    struct iovec iov[SERVER_MAX_SEGMENTS];
+    int iov_count = 0;
+
+    for (int i = 0; i < count && i < SERVER_MAX_SEGMENTS; i++) {
+        if (segments[i].len > 0) {
+            iov[iov_count].iov_base = (void *)segments[i].data;
+            iov[iov_count].iov_len = segments[i].len;
+            iov_count++;
+        }
+    }
+    if (iov_count == 0) {
+        return 0;
+    }
+
+    ssize_t written = 0;
+    if (conn->queued == 0) {
+        written = send_nonblocking(loop, conn, iov, iov_count);
+        if (written < 0) {
+            return -1;
+        }
+    }
+
+    for (int i = 0; i < iov_count; i++) {
+        size_t sent = MIN((size_t)written, iov[i].iov_len);
+        written -= sent;
+        if (output_append(loop, conn, (const char *)iov[i].iov_base + sent, iov[i].iov_len - sent) < 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Sends queued output until the queue is empty or the socket is full. Returns 0 or -1 on error.
+static int output_flush(server_loop_t *loop, server_conn_t *conn)
+{
+    while (conn->out_head) {
+        struct iovec iov[SERVER_MAX_SEGMENTS];
+        int iov_count = 0;
+        for (output_block_t *block = conn->out_head; block && iov_count < SERVER_MAX_SEGMENTS; block = block->next) {
+            iov[iov_count].iov_base = block->data + block->start;
+            iov[iov_count].iov_len = block->end - block->start;
+            iov_count++;
+        }
+
+        ssize_t written = send_nonblocking(loop, conn, iov, iov_count);
+        if (written <= 0) {
+            return written < 0 ? -1 : 0;
+        }
+        conn->queued -= written;
+        loop->stats->queued_bytes -= written;
+
+        // Free every block that went out completely and advance into the partially sent one
+        while (written > 0) {
+            output_block_t *block = conn->out_head;
+            int sent = MIN(written, block->end - block->start);
+            block->start += sent;
+            written -= sent;
+            if (block->start == block->end) {
+                conn->out_head = block->next;
+                if (!conn->out_head) {
+                    conn->out_tail = NULL;
+                }
+                buffer_pool_free(loop->server->pool, (char *)block);
+            }
+        }
+    }
+    return 0;
+}
+
+static int flush_batch(server_loop_t *loop, server_conn_t *conn, response_batch_t *batch)
+{
+    if (batch->used == 0) {
+        return 0;
+    }
+
+    server_segment_t segment = { .data = batch->buffer, .len = batch->used };
+    batch->used = 0;
+    return send_segments(loop, conn, &segment, 1);
+}
+
+static void finish_stream(server_loop_t *loop, server_conn_t *conn)
+{
+    conn->streaming = false;
+    conn->request = NULL;
+    conn->request_len = 0;
+    buffer_pool_free(loop->server->pool, conn->request_block);
+    conn->request_block = NULL;
+}
+
+// Runs the scatter-gather callback until the response is complete or the output queue reaches the
+// high watermark; the response then stays pending and resumes once the queue drains. Returns 0 or -1.
+static int continue_stream(server_loop_t *loop, server_conn_t *conn, response_batch_t *batch)
+{
+    tcp_server_t *server = loop->server;
+    server_response_t *response = &conn->stream;
+
+    // The tx block may differ between resumptions, so scratch contents are not kept between calls
+    response->scratch = batch->buffer;
+    response->scratch_size = batch->size;
+
+    while (conn->queued < server->output_high_watermark) {
+        response->segment_count = 0;
+        response->more = false;
+        response->close = false;
+
+        int64_t start = esp_timer_get_time();
+        int result = server->response_iov_callback(conn->request, conn->request_len, response, server->user_data);
+        record_callback_time(loop->stats, start);
+        if (result < 0) {
+            return -1;
+        }
+
+        // Uncork before the last chunk so it is pushed out rather than held back waiting for an ACK
+        if (!response->more) {
+            socket_uncork(conn->sock, &server->tuning);
+        }
+
+        if (send_segments(loop, conn, response->segments, response->segment_count) < 0) {
+            return -1;
+        }
+        conn->stream_chunks++;
+
+        if (!response->more) {
+            ABSTRACE(TRACE_TCP_SERVER_STREAM, conn->sock, conn->stream_chunks);
+            conn->close_requested |= response->close;
+            finish_stream(loop, conn);
+            return 0;
+        }
+    }
+    return 0;
+}
+
+static int start_stream(server_loop_t *loop, server_conn_t *conn, const char *request_data, int request_len,
+                        response_batch_t *batch)
+{
+    memset(&conn->stream, 0, sizeof(conn->stream));
+    conn->streaming = true;
+    conn->request = request_data;
+    conn->request_len = request_len;
+    conn->stream_chunks = 0;
+
+    // Corking lets the chunks fill whole segments instead of going out one partial segment each
+    socket_cork(conn->sock, &loop->server->tuning);
+    return continue_stream(loop, conn, batch);
+}
+
+// Runs the response callback for one message and appends its reply to the batch. Returns 0 or -1 on error.
+static int respond_to_message(server_loop_t *loop, server_conn_t *conn, const char *message, int message_len,
+                              response_batch_t *batch)
+{
+    tcp_server_t *server = loop->server;
+
+    if (server->response_iov_callback) {
+        // Streamed responses use the batch buffer as scratch, so anything batched goes out first
+        if (flush_batch(loop, conn, batch) < 0) {
+            return -1;
+        }
+        return start_stream(loop, conn, message, message_len, batch);
+    }
+
+    if (!server->response_callback) {
+        return 0;
+    }
+
+    int64_t start = esp_timer_get_time();
+    int response_len = server->response_callback(message, message_len, batch->buffer + batch->used,
+                                                  batch->size - batch->used, server->user_data);
+    record_callback_time(loop->stats, start);
+    if (response_len < 0 && batch->used > 0) {
+        // The callback may have run out of room behind earlier replies; retry with the whole buffer
+        if (flush_batch(loop, conn, batch) < 0) {
+            return -1;
+        }
+        start = esp_timer_get_time();
+        response_len = server->response_callback(message, message_len, batch->buffer, batch->size, server->user_data);
+        record_callback_time(loop->stats, start);
+    }
+    if (response_len > 0) {
+        batch->used += response_len;
+    }
+    return 0;
+}
+
+// Records the time from a read completing to its replies being sent, if any were sent
+static void record_latency(tcp_server_stats_t *stats, int64_t received_at, uint64_t bytes_out_before)
+{
+    if (stats->bytes_out != bytes_out_before) {
+        histogram_add(stats->latency_histogram, (uint32_t)(esp_timer_get_time() - received_at));
+    }
+}
+
+// Answers the complete messages in the connection's ring. Stops early while a streamed response or
+// a full output queue holds the connection back; the rest is answered once the queue drains.
+// Returns 0 or -1 to close.
+static int process_messages(server_loop_t *loop, server_conn_t *conn, response_batch_t *batch)
+{
+    tcp_server_t *server = loop->server;
+
+    // Only a message that wraps around the ring needs the scratch block
+    char *scratch = buffer_pool_alloc(server->pool);
+    if (!scratch) {
+        ESP_LOGE(TAG, "Buffer pool exhausted, closing connection");
+        return -1;
+    }
+
+    const char *message;
+    int message_len;
+    int found = 0;
+    int messages = 0;
+    int result = 0;
+    while (!conn->streaming && !conn->close_requested && conn->queued < server->output_high_watermark &&
+           (found = frame_buffer_next(&conn->rx, &server->framer, scratch, server->buffer_size,
+                                      &message, &message_len)) > 0) {
+        if (respond_to_message(loop, conn, message, message_len, batch) < 0) {
+            result = -1;
+            break;
+        }
+        messages++;
+    }
+    if (found < 0) {
+        ESP_LOGE(TAG, "Framing error, closing connection");
+        result = -1;
+    }
+
+    // A pending streamed response keeps the scratch block if its request was linearized into it;
+    // a request in the ring stays intact because the connection is not read until the response ends
+    if (conn->streaming && conn->request >= scratch && conn->request < scratch + server->buffer_size) {
+        conn->request_block = scratch;
+    } else {
+        buffer_pool_free(server->pool, scratch);
+    }
+
+    if (result == 0) {
+        ABSTRACE(TRACE_TCP_SERVER_FRAMES, conn->sock, messages);
+    }
+    return result;
+}
+
+// Checks whether a connection that is being closed has sent all of its output
+static bool closing_done(server_conn_t *conn)
+{
+    return (conn->read_closed || conn->close_requested) && conn->queued == 0 && !conn->streaming;
+}
+
+// Handles the client closing its side. Returns -1 to close now, or 0 to keep the connection until
+// its queued output is sent.
+static int finish_reading(server_conn_t *conn)
+{
+    if (conn->queued == 0 && !conn->streaming) {
+        return -1;
+    }
+    conn->read_closed = true;
+    return 0;
+}
+
+// Receives into the connection's ring and answers every complete message. Returns 0 or -1 to close.
+static int handle_framed_data(server_loop_t *loop, server_conn_t *conn, response_batch_t *batch)
+{
+    int len = frame_buffer_recv(&conn->rx, conn->sock);
+    ABSTRACE(TRACE_TCP_SERVER_RECV, conn->sock, len);
+    if (len < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        }
+        ESP_LOGE(TAG, "Error occurred during receiving: errno %d", errno);
+        return -1;
+    } else if (len == 0) {
+        ESP_LOGD(TAG, "Connection closed by client");
+        return finish_reading(conn);
+    }
+    int64_t received_at = esp_timer_get_time();
+    uint64_t bytes_out_before = loop->stats->bytes_out;
+    loop->stats->bytes_in += len;
+    conn->last_activity = loop->now;
+    charge_receive(loop->server, conn, len);
+
+    int result = process_messages(loop, conn, batch);
+    if (result == 0) {
+        result = flush_batch(loop, conn, batch);
+        record_latency(loop->stats, received_at, bytes_out_before);
+    }
+    return result;
+}
+
+static int handle_unframed_data(server_loop_t *loop, server_conn_t *conn, response_batch_t *batch)
+{
+    tcp_server_t *server = loop->server;
+
+    char *rx_buffer = buffer_pool_alloc(server->pool);
+    if (!rx_buffer) {
+        ESP_LOGE(TAG, "Buffer pool exhausted, closing connection");
+        return -1;
+    }
+
+    int result = -1;
+    int len = recv(conn->sock, rx_buffer, server->buffer_size - 1, 0);
+    ABSTRACE(TRACE_TCP_SERVER_RECV, conn->sock, len);
+    if (len < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            result = 0;
+        } else {
             ESP_LOGE(TAG, "Error occurred during receiving: errno %d", errno);
+        }
+    } else if (len == 0) {
+        ESP_LOGD(TAG, "Connection closed by client");
+        result = finish_reading(conn);
+    } else {
+        int64_t received_at = esp_timer_get_time();
+        uint64_t bytes_out_before = loop->stats->bytes_out;
+        loop->stats->bytes_in += len;
+        conn->last_activity = loop->now;
+        charge_receive(server, conn, len);
+        rx_buffer[len] = 0; // Null-terminate received data
+
+        if (respond_to_message(loop, conn, rx_buffer, len, batch) == 0) {
+            result = flush_batch(loop, conn, batch);
+            record_latency(loop->stats, received_at, bytes_out_before);
+        }
+    }
+
+    // A pending streamed response still needs its request
+    if (conn->streaming) {
+        conn->request_block = rx_buffer;
+    } else {
+        buffer_pool_free(server->pool, rx_buffer);
+    }
+    return result;
+}
+
+// Services one readable client socket. Returns 0 if the connection should stay open, -1 if it must be closed.
+static int handle_client_data(server_loop_t *loop, server_conn_t *conn)
+{
+    tcp_server_t *server = loop->server;
+
+    // The tx block is only borrowed while a read is being answered
+    char *response_buffer = buffer_pool_alloc(server->pool);
+    if (!response_buffer) {
+        ESP_LOGE(TAG, "Buffer pool exhausted, closing connection");
+        return -1;
+    }
+    response_batch_t batch = {
+        .buffer = response_buffer,
+        .size = server->buffer_size,
+        .used = 0,
+    };
+
+    int result;
+    if (server->framer.type != FRAMER_NONE) {
+        result = handle_framed_data(loop, conn, &batch);
+    } else {
+        result = handle_unframed_data(loop, conn, &batch);
+    }
+    if (result == 0 && closing_done(conn)) {
+        result = -1;
+    }
+
+    buffer_pool_free(server->pool, response_buffer);
+    return result;
+}
+
+// Flushes queued output on a writable socket. Once the queue drains to the low watermark, resumes a
+// pending streamed response and answers messages left in the ring. Returns 0 or -1 to close.
+static int handle_client_writable(server_loop_t *loop, server_conn_t *conn)
+{
+    tcp_server_t *server = loop->server;
+
+    if (output_flush(loop, conn) < 0) {
+        return -1;
+    }
+
+    bool framed = server->framer.type != FRAMER_NONE;
+    if (conn->queued > server->output_low_watermark || (!conn->streaming && !(framed && conn->rx.count > 0))) {
+        return closing_done(conn) ? -1 : 0;
+    }
+
+    char *response_buffer = buffer_pool_alloc(server->pool);
+    if (!response_buffer) {
+        ESP_LOGE(TAG, "Buffer pool exhausted, closing connection");
+        return -1;
+    }
+    response_batch_t batch = {
+        .buffer = response_buffer,
+        .size = server->buffer_size,
+        .used = 0,
+    };
+
+    int result = 0;
+    if (conn->streaming) {
+        result = continue_stream(loop, conn, &batch);
+    }
+    if (result == 0 && !conn->streaming && framed) {
+        result = process_messages(loop, conn, &batch);
+    }
+    if (result == 0) {
+        result = flush_batch(loop, conn, &batch);
+    }
+    if (result == 0 && closing_done(conn)) {
+        result = -1;
+    }
+
+    buffer_pool_free(server->pool, response_buffer);
+    return result;
+}
+
+// Stops reading from a client whose output queue reached the high watermark, and resumes once the
+// queue drains to the low watermark
+static void update_read_pause(server_loop_t *loop, server_conn_t *conn)
+{
+    tcp_server_t *server = loop->server;
+
+    if (!conn->paused && conn->queued >= server->output_high_watermark) {
+        conn->paused = true;
+        loop->stats->read_pauses++;
+    } else if (conn->paused && conn->queued <= server->output_low_watermark) {
+        conn->paused = false;
+    }
+}
+
+static uint32_t current_tick(void)
+{
+    return (uint32_t)(esp_timer_get_time() / (1000 * TIMEOUT_TICK_MS));
+}
+
+// Computes the tick at which a connection times out. Returns false if no timeout applies to it.
+static bool timeout_deadline(tcp_server_t *server, server_conn_t *conn, uint32_t *deadline)
+{
+    bool armed = false;
+    if (server->idle_timeout_ticks > 0) {
+        *deadline = conn->last_activity + server->idle_timeout_ticks;
+        armed = true;
+    }
+    if (server->read_timeout_ticks > 0 && conn->reading_message) {
+        uint32_t read_deadline = conn->message_started_at + server->read_timeout_ticks;
+        if (!armed || (int32_t)(read_deadline - *deadline) < 0) {
+            *deadline = read_deadline;
+        }
+        armed = true;
+    }
+    return armed;
+}
+
+static void schedule_timeout(server_loop_t *loop, server_conn_t *conn)
+{
+    uint32_t deadline;
+    if (timeout_deadline(loop->server, conn, &deadline)) {
+        timer_wheel_schedule(&loop->timers, &conn->timer, deadline);
+    } else {
+        timer_wheel_cancel(&loop->timers, &conn->timer);
+    }
+}
+
+// Starts the read timeout when a partial message is left in the ring, and stops it once the ring
+// holds no partial message. Messages held back by a full output queue are complete, so they do not count.
+static void update_read_timeout(server_loop_t *loop, server_conn_t *conn)
+{
+    bool partial = loop->server->read_timeout_ticks > 0 && conn->rx.count > 0 && !conn->paused && !conn->streaming;
+    if (partial && !conn->reading_message) {
+        conn->reading_message = true;
+        conn->message_started_at = loop->now;
+        schedule_timeout(loop, conn);
+    } else if (!partial) {
+        // The timer is not moved; it is re-armed from the current state when it fires
+        conn->reading_message = false;
+    }
+}
+
+// Accepts a pending connection, applies admission control and then the per-socket options. Returns
+// the socket, with its source slot in `source`, or -1 if accepting failed or the connection was rejected.
+static int accept_connection(int listen_sock, tcp_server_t *server, int *source)
+{
+    struct sockaddr_storage source_addr;
+    socklen_t addr_len = sizeof(source_addr);
+    int sock = accept(listen_sock, (struct sockaddr *)&source_addr, &addr_len);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Unable to accept connection: errno %d", errno);
+        return -1;
+    }
+    server->stats[0].accepted++;
+
+    uint32_t peer_addr = 0;
+    if (source_addr.ss_family == PF_INET) {
+        peer_addr = ((struct sockaddr_in *)&source_addr)->sin_addr.s_addr;
+    }
+    ABSTRACE(TRACE_TCP_SERVER_ACCEPT, sock, peer_addr);
+
+    // Rejecting before any socket setup keeps a flooding client as cheap as possible
+    if (!admit_connection(server, peer_addr, source)) {
+        ESP_LOGD(TAG, "Connection limit reached, closing socket %d", sock);
+        ABSTRACE(TRACE_TCP_SERVER_REJECT, sock, peer_addr);
+        server->stats[0].admission_rejected++;
+        server->stats[0].rejected++;
+        close(sock);
+        return -1;
+    }
+
+    // Set TCP keepalive options
+    int keepAlive = 1;
+    setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &keepAlive, sizeof(int));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &server->keepalive_idle, sizeof(int));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &server->keepalive_interval, sizeof(int));
+    setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &server->keepalive_count, sizeof(int));
+    socket_tuning_apply(sock, &server->tuning);
+
+    // Sends never block the event loop; output the socket cannot take waits in the connection's queue
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+
+    return sock;
+}
+
+static void add_client(server_loop_t *loop, int sock, int source)
+{
+    tcp_server_t *server = loop->server;
+
+    for (int i = 0; i < server->max_clients; i++) {
+        server_conn_t *conn = &loop->conns[i];
+        if (conn->sock >= 0) {
+            continue;
+        }
+
+        // A framed connection keeps its ring for its whole lifetime to hold partial messages
+        if (server->framer.type != FRAMER_NONE) {
+            char *storage = buffer_pool_alloc(server->pool);
+            if (!storage) {
+                ESP_LOGE(TAG, "Buffer pool exhausted, closing socket %d", sock);
+                loop->stats->rejected++;
+                release_source(server, source);
+                close(sock);
+                return;
+            }
+            frame_buffer_init(&conn->rx, storage, server->buffer_size);
+        }
+        conn->sock = sock;
+        conn->opened_at = esp_timer_get_time();
+        loop->now = current_tick();
+        conn->last_activity = loop->now;
+        conn->reading_message = false;
+        conn->source = source;
+        conn->throttled = false;
+        schedule_timeout(loop, conn);
+        loop->active++;
+        return;
+    }
+
+    // Callers only hand over sockets while a slot is free, so this should not happen
+    ESP_LOGW(TAG, "No free client slot, closing socket %d", sock);
+    loop->stats->rejected++;
+    release_source(server, source);
+    close(sock);
+}
+
+static void close_client(server_loop_t *loop, server_conn_t *conn)
+{
+    uint32_t lifetime_ms = (uint32_t)((esp_timer_get_time() - conn->opened_at) / 1000);
+    loop->stats->closed++;
+    loop->stats->lifetime_total_ms += lifetime_ms;
+    if (lifetime_ms > loop->stats->lifetime_max_ms) {
+        loop->stats->lifetime_max_ms = lifetime_ms;
+    }
+    histogram_add(loop->stats->lifetime_histogram, lifetime_ms);
+
+    ABSTRACE(TRACE_TCP_SERVER_CLOSE, conn->sock, 0);
+    timer_wheel_cancel(&loop->timers, &conn->timer);
+    shutdown(conn->sock, 0);
+    close(conn->sock);
+    conn->sock = -1;
+    buffer_pool_free(loop->server->pool, conn->rx.data);
+    frame_buffer_init(&conn->rx, NULL, 0);
+    output_clear(loop, conn);
+    finish_stream(loop, conn);
+    conn->paused = false;
+    conn->read_closed = false;
+    conn->close_requested = false;
+    release_source(loop->server, conn->source);
+    conn->source = -1;
+    loop->active--;
+}
+
+// Closes the connections whose timeout has passed. Activity only records a tick, so a timer that
+// fires for a connection that has been active since is just re-armed at its new deadline, and one
+// whose connection has no timeout left running (a read timeout whose message completed) is dropped.
+static void expire_connections(server_loop_t *loop)
+{
+    tcp_server_t *server = loop->server;
+
+    loop->now = current_tick();
+    timer_entry_t *entry = timer_wheel_advance(&loop->timers, loop->now);
+    while (entry) {
+        timer_entry_t *next = entry->next;
+        server_conn_t *conn = (server_conn_t *)((char *)entry - offsetof(server_conn_t, timer));
+
+        uint32_t deadline;
+        if (!timeout_deadline(server, conn, &deadline)) {
+            // Already disarmed by the wheel; the next partial message arms it again
+        } else if ((int32_t)(loop->now - deadline) < 0) {
+            timer_wheel_schedule(&loop->timers, &conn->timer, deadline);
+        } else {
+            bool read_timeout = conn->reading_message &&
+                                (int32_t)(loop->now - (conn->message_started_at + server->read_timeout_ticks)) >= 0;
+            if (read_timeout) {
+                loop->stats->read_timeouts++;
+            } else {
+                loop->stats->idle_timeouts++;
+            }
+            ESP_LOGD(TAG, "Closing socket %d after %s timeout", conn->sock, read_timeout ? "read" : "idle");
+            ABSTRACE(TRACE_TCP_SERVER_TIMEOUT, conn->sock, read_timeout);
+            close_client(loop, conn);
+        }
+        entry = next;
+    }
+}
+
+static int server_state(tcp_server_t *server)
+{
+    return __atomic_load_n(&server->state, __ATOMIC_ACQUIRE);
+}
+
+// Pulls one queued connection into a free slot, blocking briefly while the loop is idle. Taking one
+// at a time lets idle workers, which block on the queue, pick up the rest of a burst.
+static void take_queued_client(server_loop_t *loop)
+{
+    queued_client_t client;
+    TickType_t wait = loop->active == 0 ? pdMS_TO_TICKS(STOP_POLL_INTERVAL_MS) : 0;
+
+    if (loop->active < loop->server->max_clients &&
+        xQueueReceive(loop->server->accept_queue, &client, wait) == pdTRUE) {
+        add_client(loop, client.sock, client.source);
+    }
+}
+
+// Returns true once a stopping loop has nothing left to serve
+static bool server_loop_done(server_loop_t *loop)
+{
+    tcp_server_t *server = loop->server;
+
+    switch (server_state(server)) {
+    case SERVER_RUNNING:
+        return false;
+    case SERVER_DRAINING:
+        if (loop->active > 0) {
+            return false;
+        }
+        // Workers still serve the sockets the accept task queued before it stopped
+        return loop->accepts || (!__atomic_load_n(&server->accepting, __ATOMIC_ACQUIRE) &&
+                                 uxQueueMessagesWaiting(server->accept_queue) == 0);
+    default:
+        return true;
+    }
+}
+
+static void server_loop_run(server_loop_t *loop)
+{
+    tcp_server_t *server = loop->server;
+
+    while (!server_loop_done(loop)) {
+        if (!loop->accepts) {
+            take_queued_client(loop);
+        }
+        expire_connections(loop);
+
+        fd_set read_fds;
+        fd_set write_fds;
+        FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
+        int max_fd = -1;
+        bool throttling = false;
+
+        for (int i = 0; i < server->max_clients; i++) {
+            server_conn_t *conn = &loop->conns[i];
+            if (conn->sock < 0) {
+                continue;
+            }
+            // Clients held back by a full output queue are not read until it drains, and clients
+            // over their receive rate until their buckets refill
+            if (!conn->paused && !conn->streaming && !conn->read_closed && !conn->close_requested) {
+                bool allowed = receive_allowed(server, conn);
+                if (!allowed && !conn->throttled) {
+                    loop->stats->throttled++;
+                }
+                conn->throttled = !allowed;
+                if (allowed) {
+                    FD_SET(conn->sock, &read_fds);
+                } else {
+                    throttling = true;
+                }
+            }
+            if (conn->queued > 0) {
+                FD_SET(conn->sock, &write_fds);
+            }
+            max_fd = MAX(max_fd, conn->sock);
+        }
+        // Leave further connections in the listen backlog while every slot is busy or the server is stopping
+        int listener_count = 0;
+        if (loop->accepts && loop->active < server->max_clients && server_state(server) == SERVER_RUNNING) {
+            listener_count = __atomic_load_n(&server->listener_count, __ATOMIC_ACQUIRE);
+            for (int i = 0; i < listener_count; i++) {
+                FD_SET(server->listeners[i].sock, &read_fds);
+                max_fd = MAX(max_fd, server->listeners[i].sock);
+            }
+        }
+        if (max_fd < 0) {
+            continue;
+        }
+
+        // Wake up periodically to notice a stop request, and sooner on workers with spare slots so
+        // newly queued connections are picked up
+        struct timeval timeout = { .tv_sec = 0, .tv_usec = STOP_POLL_INTERVAL_MS * 1000 };
+        if (!loop->accepts && loop->active < server->max_clients) {
+            timeout.tv_usec = WORKER_POLL_INTERVAL_MS * 1000;
+        }
+        if (throttling) {
+            timeout.tv_usec = MIN(timeout.tv_usec, THROTTLE_POLL_INTERVAL_MS * 1000);
+        }
+
+        int ready = select(max_fd + 1, &read_fds, &write_fds, NULL, &timeout);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ESP_LOGE(TAG, "Error occurred during select: errno %d", errno);
             break;
-        } else if (len == 0) {
-            ESP_LOGW(TAG, "Connection closed by client");
+        }
+        loop->now = current_tick();
+
+        for (int i = 0; i < server->max_clients; i++) {
+            server_conn_t *conn = &loop->conns[i];
+            if (conn->sock < 0) {
+                continue;
+            }
+            int result = 0;
+            if (FD_ISSET(conn->sock, &write_fds)) {
+                result = handle_client_writable(loop, conn);
+            }
+            if (result == 0 && FD_ISSET(conn->sock, &read_fds)) {
+                result = handle_client_data(loop, conn);
+            }
+            if (result < 0) {
+                close_client(loop, conn);
+            } else {
+                update_read_pause(loop, conn);
+                update_read_timeout(loop, conn);
+            }
+        }
+
+        for (int i = 0; i < listener_count && loop->active < server->max_clients; i++) {
+            if (FD_ISSET(server->listeners[i].sock, &read_fds)) {
+                int source;
+                int sock = accept_connection(server->listeners[i].sock, server, &source);
+                if (sock >= 0) {
+                    add_client(loop, sock, source);
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < server->max_clients; i++) {
+        if (loop->conns[i].sock >= 0) {
+            close_client(loop, &loop->conns[i]);
+        }
+    }
+}
+
+static int server_loop_init(server_loop_t *loop, tcp_server_t *server, bool accepts, tcp_server_stats_t *stats)
+{
+    loop->server = server;
+    loop->accepts = accepts;
+    loop->active = 0;
+    loop->stats = stats;
+    loop->now = current_tick();
+    timer_wheel_init(&loop->timers, loop->now);
+    loop->conns = calloc(server->max_clients, sizeof(server_conn_t));
+    if (!loop->conns) {
+        ESP_LOGE(TAG, "Failed to allocate client slots");
+        return -1;
+    }
+    for (int i = 0; i < server->max_clients; i++) {
+        loop->conns[i].sock = -1;
+    }
+    return 0;
+}
+
+static void server_loop_deinit(server_loop_t *loop)
+{
+    free(loop->conns);
+}
+
+// Accepts from every listener and queues the sockets for the workers until the server stops
+static void accept_loop_run(tcp_server_t *server)
+{
+    while (server_state(server) == SERVER_RUNNING) {
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        int max_fd = -1;
+
+        int listener_count = __atomic_load_n(&server->listener_count, __ATOMIC_ACQUIRE);
+        for (int i = 0; i < listener_count; i++) {
+            FD_SET(server->listeners[i].sock, &read_fds);
+            max_fd = MAX(max_fd, server->listeners[i].sock);
+        }
+
+        struct timeval timeout = { .tv_sec = 0, .tv_usec = STOP_POLL_INTERVAL_MS * 1000 };
+        int ready = select(max_fd + 1, &read_fds, NULL, NULL, &timeout);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ESP_LOGE(TAG, "Error occurred during select: errno %d", errno);
             break;
-        } else {
-            rx_buffer[len] = 0; // Null-terminate received data
-            ESP_LOGI(TAG, "Received %d bytes: %s", len, rx_buffer);
-
-            // Call the response callback function
-            if (response_callback) {
-                char response_buffer[1024];
-                int response_len = response_callback(rx_buffer, len, response_buffer, sizeof(response_buffer), user_data);
-                
-                if (response_len > 0) {
-                    // Send response back to client
-                    int to_write = response_len;
-                    while (to_write > 0) {
-                        int written = send(sock, response_buffer + (response_len - to_write), to_write, 0);
-                        if (written < 0) {
-                            ESP_LOGE(TAG, "Error occurred during sending: errno %d", errno);
-                            return;
-                        }
-                        to_write -= written;
-                    }
-                    ESP_LOGI(TAG, "Sent %d bytes response", response_len);
+        }
+
+        for (int i = 0; i < listener_count; i++) {
+            if (!FD_ISSET(server->listeners[i].sock, &read_fds)) {
+                continue;
+            }
+            queued_client_t client;
+            client.sock = accept_connection(server->listeners[i].sock, server, &client.source);
+            if (client.sock < 0) {
+                continue;
+            }
+
+            // A full queue blocks here and leaves further connections in the backlog
+            while (xQueueSend(server->accept_queue, &client, pdMS_TO_TICKS(STOP_POLL_INTERVAL_MS)) != pdTRUE) {
+                if (server_state(server) != SERVER_RUNNING) {
+                    server->stats[0].rejected++;
+                    release_source(server, client.source);
+                    close(client.sock);
+                    break;
                 }
             }
         }
-    } while (len > 0);
+    }
+
+    __atomic_store_n(&server->accepting, false, __ATOMIC_RELEASE);
+}
+
+// Returns the core for the n-th task pinned under core_mask, or tskNO_AFFINITY when unpinned
+static BaseType_t pick_core(int core_mask, int n)
+{
+    int cores[portNUM_PROCESSORS];
+    int count = 0;
+
+    for (int core = 0; core < portNUM_PROCESSORS; core++) {
+        if (core_mask & (1 << core)) {
+            cores[count++] = core;
+        }
+    }
+    return count > 0 ? cores[n % count] : tskNO_AFFINITY;
+}
+
+// Called by every server task as it exits; the last one wakes up whoever is stopping the server
+static void server_task_exit(tcp_server_t *server)
+{
+    if (__atomic_sub_fetch(&server->tasks_running, 1, __ATOMIC_ACQ_REL) == 0) {
+        xSemaphoreGive(server->tasks_done);
+    }
+    vTaskDelete(NULL);
+}
+
+static void tcp_worker_task(void *pvParameters)
+{
+    tcp_server_t *server = (tcp_server_t *)pvParameters;
+    server_loop_t loop;
+
+    // Stats slot 0 belongs to the accept task; workers claim the following ones in start order
+    int slot = __atomic_add_fetch(&server->workers_started, 1, __ATOMIC_RELAXED);
+    if (server_loop_init(&loop, server, false, &server->stats[slot]) == 0) {
+        server_loop_run(&loop);
+        server_loop_deinit(&loop);
+    }
+    server_task_exit(server);
 }
 
 static void tcp_server_task(void *pvParameters)
 {
-    server_config_t *config = (server_config_t *)pvParameters;
-    char addr_str[128];
+    tcp_server_t *server = (tcp_server_t *)pvParameters;
+
+    if (server->worker_count > 0) {
+        accept_loop_run(server);
+    } else {
+        server_loop_t loop;
+        if (server_loop_init(&loop, server, true, &server->stats[0]) == 0) {
+            server_loop_run(&loop);
+            server_loop_deinit(&loop);
+        }
+    }
+    server_task_exit(server);
+}
+
+// Creates, binds and listens on a socket. Returns the socket or -1.
+static int open_listener(uint16_t port, const char *host, int backlog)
+{
     int addr_family = AF_INET;
     int ip_protocol = IPPROTO_IP;
     struct sockaddr_storage dest_addr;
+    memset(&dest_addr, 0, sizeof(dest_addr));
 
     // Configure IPv4 address
     struct sockaddr_in *dest_addr_ip4 = (struct sockaddr_in *)&dest_addr;
-    if (config->host && strlen(config->host) > 0) {
-        inet_pton(AF_INET, config->host, &dest_addr_ip4->sin_addr);
+    if (host && strlen(host) > 0) {
+        inet_pton(AF_INET, host, &dest_addr_ip4->sin_addr);
     } else {
         dest_addr_ip4->sin_addr.s_addr = htonl(INADDR_ANY);
     }
     dest_addr_ip4->sin_family = AF_INET;
-    dest_addr_ip4->sin_port = htons(config->port);
+    dest_addr_ip4->sin_port = htons(port);
 
     int listen_sock = socket(addr_family, SOCK_STREAM, ip_protocol);
     if (listen_sock < 0) {
         ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
-        vTaskDelete(NULL);
-        return;
+        return -1;
     }
-    
+
     // Set socket options
     int opt = 1;
     setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
@@ -107,85 +1339,376 @@ static void tcp_server_task(void *pvParameters)
     int err = bind(listen_sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
     if (err != 0) {
         ESP_LOGE(TAG, "Socket unable to bind: errno %d", errno);
-        goto CLEAN_UP;
+        close(listen_sock);
+        return -1;
     }
-    ESP_LOGI(TAG, "Socket bound, port %d", config->port);
+    ESP_LOGI(TAG, "Socket bound, port %d", port);
 
-    err = listen(listen_sock, config->max_connections);
+    err = listen(listen_sock, backlog);
     if (err != 0) {
         ESP_LOGE(TAG, "Error occurred during listen: errno %d", errno);
-        goto CLEAN_UP;
+        close(listen_sock);
+        return -1;
+    }
+    ESP_LOGI(TAG, "Socket listening on port %d", port);
+
+    return listen_sock;
+}
+
+static void apply_options(tcp_server_t *server, const server_options_t *options)
+{
+    if (options) {
+        server->keepalive_idle = options->keepalive_idle > 0 ? options->keepalive_idle : DEFAULT_KEEPALIVE_IDLE;
+        server->keepalive_interval = options->keepalive_interval > 0 ? options->keepalive_interval : DEFAULT_KEEPALIVE_INTERVAL;
+        server->keepalive_count = options->keepalive_count > 0 ? options->keepalive_count : DEFAULT_KEEPALIVE_COUNT;
+        server->max_connections = options->max_connections > 0 ? options->max_connections : 1;
+        server->max_clients = options->max_clients > 0 ? options->max_clients : DEFAULT_MAX_CLIENTS;
+        server->worker_count = options->worker_count > 0 ? options->worker_count : 0;
+        server->core_mask = options->core_mask > 0 ? options->core_mask : 0;
+        server->task_priority = options->task_priority > 0 ? options->task_priority : DEFAULT_TASK_PRIORITY;
+        server->response_iov_callback = options->response_iov_callback;
+        server->framer = options->framer;
+        server->pool = options->buffer_pool;
+        server->buffer_size = options->buffer_size > 0 ? options->buffer_size : server->framer.max_message_size;
+        server->buffer_count = options->buffer_count;
+        server->tuning = options->tuning;
+        server->output_high_watermark = options->output_high_watermark;
+        server->output_low_watermark = options->output_low_watermark;
+        server->idle_timeout_ticks = (MAX(options->idle_timeout_ms, 0) + TIMEOUT_TICK_MS - 1) / TIMEOUT_TICK_MS;
+        server->read_timeout_ticks = (MAX(options->read_timeout_ms, 0) + TIMEOUT_TICK_MS - 1) / TIMEOUT_TICK_MS;
+        server->max_connections_per_ip = options->max_connections_per_ip;
+        server->accept_rate = options->accept_rate;
+        server->ip_accept_rate = options->ip_accept_rate;
+        server->receive_rate = options->receive_rate;
+        server->ip_receive_rate = options->ip_receive_rate;
+    } else {
+        server->keepalive_idle = DEFAULT_KEEPALIVE_IDLE;
+        server->keepalive_interval = DEFAULT_KEEPALIVE_INTERVAL;
+        server->keepalive_count = DEFAULT_KEEPALIVE_COUNT;
+        server->max_connections = 1;
+        server->max_clients = DEFAULT_MAX_CLIENTS;
+        server->worker_count = 0;
+        server->core_mask = 0;
+        server->task_priority = DEFAULT_TASK_PRIORITY;
+        server->response_iov_callback = NULL;
+        memset(&server->framer, 0, sizeof(server->framer));
+        server->pool = NULL;
+        server->buffer_size = 0;
+        server->buffer_count = 0;
+        memset(&server->tuning, 0, sizeof(server->tuning));
+        server->output_high_watermark = 0;
+        server->output_low_watermark = 0;
+        server->idle_timeout_ticks = 0;
+        server->read_timeout_ticks = 0;
+        server->max_connections_per_ip = 0;
+        memset(&server->accept_rate, 0, sizeof(rate_limit_t));
+        memset(&server->ip_accept_rate, 0, sizeof(rate_limit_t));
+        memset(&server->receive_rate, 0, sizeof(rate_limit_t));
+        memset(&server->ip_receive_rate, 0, sizeof(rate_limit_t));
+    }
+    server->receive_limited = rate_limit_enabled(&server->receive_rate) || rate_limit_enabled(&server->ip_receive_rate);
+    server->track_sources = server->max_connections_per_ip > 0 || rate_limit_enabled(&server->accept_rate) ||
+                            rate_limit_enabled(&server->ip_accept_rate) || rate_limit_enabled(&server->ip_receive_rate);
+}
+
+// Adds the counters of one stats slot to a running total; derived fields are left alone
+static void stats_accumulate(tcp_server_stats_t *total, const tcp_server_stats_t *slot)
+{
+    total->accepted += slot->accepted;
+    total->rejected += slot->rejected;
+    total->closed += slot->closed;
+    total->bytes_in += slot->bytes_in;
+    total->bytes_out += slot->bytes_out;
+    total->queued_bytes += slot->queued_bytes;
+    total->queue_max_bytes = MAX(total->queue_max_bytes, slot->queue_max_bytes);
+    total->read_pauses += slot->read_pauses;
+    total->idle_timeouts += slot->idle_timeouts;
+    total->read_timeouts += slot->read_timeouts;
+    total->admission_rejected += slot->admission_rejected;
+    total->throttled += slot->throttled;
+    total->callbacks += slot->callbacks;
+    total->callback_time_us += slot->callback_time_us;
+    total->callback_max_us = MAX(total->callback_max_us, slot->callback_max_us);
+    total->lifetime_total_ms += slot->lifetime_total_ms;
+    total->lifetime_max_ms = MAX(total->lifetime_max_ms, slot->lifetime_max_ms);
+    for (int b = 0; b < SERVER_HISTOGRAM_BUCKETS; b++) {
+        total->latency_histogram[b] += slot->latency_histogram[b];
+        total->lifetime_histogram[b] += slot->lifetime_histogram[b];
+    }
+}
+
+// Frees what start_loops() set up, once no server task is running any more
+static void release_loops(tcp_server_t *server)
+{
+    if (server->accept_queue) {
+        // Sockets still queued when the workers stopped were never served
+        queued_client_t client;
+        while (xQueueReceive(server->accept_queue, &client, 0) == pdTRUE) {
+            server->stats[0].rejected++;
+            release_source(server, client.source);
+            close(client.sock);
+        }
+        vQueueDelete(server->accept_queue);
+        server->accept_queue = NULL;
+    }
+
+    portENTER_CRITICAL(&server->stats_lock);
+    for (int i = 0; i < server->stats_count; i++) {
+        stats_accumulate(&server->retired, &server->stats[i]);
+    }
+    tcp_server_stats_t *stats = server->stats;
+    buffer_pool_t *pool = server->pool;
+    server->stats = NULL;
+    server->stats_count = 0;
+    server->pool = NULL;
+    portEXIT_CRITICAL(&server->stats_lock);
+
+    free(stats);
+    if (server->owns_pool) {
+        buffer_pool_destroy(pool);
+    }
+}
+
+// Sets up the buffer pool and stats for the current options and starts the server tasks.
+// Returns 0 on success, or -1 with nothing left running.
+static int start_loops(tcp_server_t *server)
+{
+    // Each event loop answers one read at a time (rx or scratch plus tx block), every framed
+    // connection holds its receive ring, and every connection may queue one block of output
+    int loops = server->worker_count > 0 ? server->worker_count : 1;
+    if (server->buffer_count <= 0) {
+        server->buffer_count = loops * (2 + server->max_clients +
+                                        (server->framer.type != FRAMER_NONE ? server->max_clients : 0));
+    }
+    server->owns_pool = server->pool == NULL;
+    if (server->owns_pool) {
+        server->pool = buffer_pool_create(server->buffer_size > 0 ? server->buffer_size : DEFAULT_BUFFER_SIZE,
+                                          server->buffer_count);
+        if (!server->pool) {
+            ESP_LOGE(TAG, "Failed to create buffer pool");
+            return -1;
+        }
+    }
+    server->buffer_size = buffer_pool_block_size(server->pool);
+    // A frame cannot outgrow its ring, but a caller may ask for a smaller limit
+    if (server->framer.max_message_size <= 0 || server->framer.max_message_size > server->buffer_size) {
+        server->framer.max_message_size = server->buffer_size;
+    }
+    if (server->output_high_watermark <= 0) {
+        server->output_high_watermark = output_block_capacity(server);
+    }
+    if (server->output_low_watermark <= 0 || server->output_low_watermark >= server->output_high_watermark) {
+        server->output_low_watermark = server->output_high_watermark / 2;
+    }
+
+    tcp_server_stats_t *stats = calloc(1 + server->worker_count, sizeof(tcp_server_stats_t));
+    if (!stats) {
+        ESP_LOGE(TAG, "Failed to allocate server stats");
+        if (server->owns_pool) {
+            buffer_pool_destroy(server->pool);
+        }
+        server->pool = NULL;
+        return -1;
+    }
+    portENTER_CRITICAL(&server->stats_lock);
+    server->stats = stats;
+    server->stats_count = 1 + server->worker_count;
+    portEXIT_CRITICAL(&server->stats_lock);
+
+    if (server->worker_count > 0) {
+        // Room for every worker slot plus one pending socket per worker keeps accept() from stalling early
+        server->accept_queue = xQueueCreate(server->worker_count * (server->max_clients + 1), sizeof(queued_client_t));
+        if (!server->accept_queue) {
+            ESP_LOGE(TAG, "Failed to create accept queue");
+            release_loops(server);
+            return -1;
+        }
     }
 
-    while (1) {
-        ESP_LOGI(TAG, "Socket listening on port %d", config->port);
+    // No connection is open while the loops are stopped, so the limits start over with full buckets
+    int64_t now_us = esp_timer_get_time();
+    memset(server->sources, 0, sizeof(server->sources));
+    token_bucket_init(&server->accept_bucket, &server->accept_rate, now_us);
+    token_bucket_init(&server->receive_bucket, &server->receive_rate, now_us);
 
-        struct sockaddr_storage source_addr;
-        socklen_t addr_len = sizeof(source_addr);
-        int sock = accept(listen_sock, (struct sockaddr *)&source_addr, &addr_len);
-        if (sock < 0) {
-            ESP_LOGE(TAG, "Unable to accept connection: errno %d", errno);
+    server->state = SERVER_RUNNING;
+    server->accepting = server->worker_count > 0;
+    server->workers_started = 0;
+    server->tasks_running = 1 + server->worker_count;
+
+    int started = 0;
+    for (int i = 0; i < server->worker_count; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "tcp_worker_%d", i);
+        BaseType_t result = xTaskCreatePinnedToCore(tcp_worker_task, name, SERVER_TASK_STACK_SIZE, server,
+                                                    server->task_priority, NULL, pick_core(server->core_mask, i + 1));
+        if (result != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create worker task %d", i);
             break;
         }
+        started++;
+    }
+    if (started == server->worker_count) {
+        BaseType_t result = xTaskCreatePinnedToCore(tcp_server_task, "tcp_server", SERVER_TASK_STACK_SIZE, server,
+                                                    server->task_priority, NULL, pick_core(server->core_mask, 0));
+        if (result != pdPASS) {
+            ESP_LOGE(TAG, "Failed to create TCP server task");
+        } else {
+            started++;
+        }
+    }
 
-        // Set TCP keepalive options
-        int keepAlive = 1;
-        setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &keepAlive, sizeof(int));
-        setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &config->keepalive_idle, sizeof(int));
-        setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &config->keepalive_interval, sizeof(int));
-        setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &config->keepalive_count, sizeof(int));
-        
-        // Convert client IP address to string
-        if (source_addr.ss_family == PF_INET) {
-            inet_ntoa_r(((struct sockaddr_in *)&source_addr)->sin_addr, addr_str, sizeof(addr_str) - 1);
+    if (started < 1 + server->worker_count) {
+        // Let the tasks that did start exit at once, then undo the rest
+        __atomic_store_n(&server->state, SERVER_CLOSING, __ATOMIC_RELEASE);
+        int missing = 1 + server->worker_count - started;
+        if (__atomic_sub_fetch(&server->tasks_running, missing, __ATOMIC_ACQ_REL) == 0) {
+            xSemaphoreGive(server->tasks_done);
         }
-        ESP_LOGI(TAG, "Socket accepted from IP address: %s", addr_str);
+        xSemaphoreTake(server->tasks_done, portMAX_DELAY);
+        release_loops(server);
+        return -1;
+    }
 
-        handle_client_connection(sock, config->response_callback, config->user_data);
+    if (server->worker_count > 0) {
+        ESP_LOGI(TAG, "Started %d worker tasks", server->worker_count);
+    }
+    return 0;
+}
 
-        shutdown(sock, 0);
-        close(sock);
+// Stops accepting, lets open connections finish for up to drain_timeout_ms, then closes the rest
+// and waits for every server task to exit
+static void stop_loops(tcp_server_t *server, int drain_timeout_ms)
+{
+    __atomic_store_n(&server->state, SERVER_DRAINING, __ATOMIC_RELEASE);
+    if (drain_timeout_ms <= 0 || xSemaphoreTake(server->tasks_done, pdMS_TO_TICKS(drain_timeout_ms)) != pdTRUE) {
+        __atomic_store_n(&server->state, SERVER_CLOSING, __ATOMIC_RELEASE);
+        xSemaphoreTake(server->tasks_done, portMAX_DELAY);
     }
+    release_loops(server);
+}
 
-CLEAN_UP:
-    close(listen_sock);
-    vTaskDelete(NULL);
+static void free_server(tcp_server_t *server)
+{
+    for (int i = 0; i < server->listener_count; i++) {
+        close(server->listeners[i].sock);
+    }
+    if (server->tasks_done) {
+        vSemaphoreDelete(server->tasks_done);
+    }
+    free(server);
+}
+
+tcp_server_t *tcp_server_start(uint16_t port, const char *host, response_func_t response_callback, void *user_data, server_options_t *options)
+{
+    tcp_server_t *server = calloc(1, sizeof(tcp_server_t));
+    if (!server) {
+        ESP_LOGE(TAG, "Failed to allocate memory for server");
+        return NULL;
+    }
+
+    server->response_callback = response_callback;
+    server->user_data = user_data;
+    portMUX_INITIALIZE(&server->stats_lock);
+    portMUX_INITIALIZE(&server->limits_lock);
+    apply_options(server, options);
+
+    server->tasks_done = xSemaphoreCreateBinary();
+    if (!server->tasks_done) {
+        ESP_LOGE(TAG, "Failed to create server semaphore");
+        free_server(server);
+        return NULL;
+    }
+
+    if (tcp_server_add_listener(server, port, host) != 0 || start_loops(server) != 0) {
+        free_server(server);
+        return NULL;
+    }
+
+    ESP_LOGI(TAG, "TCP server started on %s:%d", host ? host : "0.0.0.0", port);
+    return server;
 }
 
-int tcp_server_start(uint16_t port, const char *host, response_func_t response_callback, void *user_data, server_options_t *options)
+int tcp_server_add_listener(tcp_server_t *server, uint16_t port, const char *host)
 {
-    server_config_t *config = malloc(sizeof(server_config_t));
-    if (!config) {
-        ESP_LOGE(TAG, "Failed to allocate memory for server config");
+    if (!server) {
+        return -1;
+    }
+    int count = server->listener_count;
+    if (count >= SERVER_MAX_LISTENERS) {
+        ESP_LOGE(TAG, "Unable to listen on port %d: already %d listeners", port, count);
         return -1;
     }
 
-    config->port = port;
-    config->host = host;
-    config->response_callback = response_callback;
-    config->user_data = user_data;
-    
-    // Apply options or use defaults
-    if (options) {
-        config->keepalive_idle = options->keepalive_idle > 0 ? options->keepalive_idle : DEFAULT_KEEPALIVE_IDLE;
-        config->keepalive_interval = options->keepalive_interval > 0 ? options->keepalive_interval : DEFAULT_KEEPALIVE_INTERVAL;
-        config->keepalive_count = options->keepalive_count > 0 ? options->keepalive_count : DEFAULT_KEEPALIVE_COUNT;
-        config->max_connections = options->max_connections > 0 ? options->max_connections : 1;
-    } else {
-        config->keepalive_idle = DEFAULT_KEEPALIVE_IDLE;
-        config->keepalive_interval = DEFAULT_KEEPALIVE_INTERVAL;
-        config->keepalive_count = DEFAULT_KEEPALIVE_COUNT;
-        config->max_connections = 1;
+    int sock = open_listener(port, host, server->max_connections);
+    if (sock < 0) {
+        return -1;
     }
+    server->listeners[count].sock = sock;
+    server->listeners[count].port = port;
+    __atomic_store_n(&server->listener_count, count + 1, __ATOMIC_RELEASE);
+    return 0;
+}
 
-    // Create server task
-    BaseType_t result = xTaskCreate(tcp_server_task, "tcp_server", 4096, config, 5, NULL);
-    if (result != pdPASS) {
-        ESP_LOGE(TAG, "Failed to create TCP server task");
-        free(config);
+int tcp_server_update_options(tcp_server_t *server, server_options_t *options, int drain_timeout_ms)
+{
+    if (!server) {
         return -1;
     }
 
-    ESP_LOGI(TAG, "TCP server started on %s:%d", host ? host : "0.0.0.0", port);
+    // The loops are already stopped if an earlier update failed to restart them
+    if (server->stats) {
+        stop_loops(server, drain_timeout_ms);
+    }
+    apply_options(server, options);
+
+    // Listening sockets stay open across the restart; listen() again picks up a new backlog size
+    for (int i = 0; i < server->listener_count; i++) {
+        listen(server->listeners[i].sock, server->max_connections);
+    }
+
+    if (start_loops(server) != 0) {
+        ESP_LOGE(TAG, "Failed to restart TCP server with new options");
+        return -1;
+    }
+    ESP_LOGI(TAG, "TCP server options updated");
+    return 0;
+}
+
+void tcp_server_stop(tcp_server_t *server, int drain_timeout_ms)
+{
+    if (!server) {
+        return;
+    }
+
+    if (server->stats) {
+        stop_loops(server, drain_timeout_ms);
+    }
+    for (int i = 0; i < server->listener_count; i++) {
+        ESP_LOGI(TAG, "TCP server stopped on port %d", server->listeners[i].port);
+    }
+    free_server(server);
+}
+
+int tcp_server_get_stats(tcp_server_t *server, tcp_server_stats_t *stats)
+{
+    if (!server || !stats) {
+        return -1;
+    }
+
+    // Counters are summed without stopping the loops; a sample taken while the server runs may be slightly skewed
+    portENTER_CRITICAL(&server->stats_lock);
+    *stats = server->retired;
+    for (int i = 0; i < server->stats_count; i++) {
+        stats_accumulate(stats, &server->stats[i]);
+    }
+    if (server->stats) {
+        buffer_pool_get_stats(server->pool, &stats->buffers);
+    }
+    portEXIT_CRITICAL(&server->stats_lock);
+
+    stats->active = stats->accepted - stats->rejected - stats->closed;
+    stats->latency_p50_us = histogram_percentile(stats->latency_histogram, 50);
+    stats->latency_p99_us = histogram_percentile(stats->latency_histogram, 99);
     return 0;
 }
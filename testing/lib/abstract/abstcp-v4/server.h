@@ -1,11 +1,33 @@
 #ifndef ABSTCP_V4_SERVER_H
 #define ABSTCP_V4_SERVER_H
 
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <sys/types.h>
 
+#include "abstcp-v4/framing.h"
+#include "abstcp-v4/buffer-pool.h"
+#include "abstcp-v4/socket-tuning.h"
+#include "abstcp-v4/rate-limit.h"
+
+/// @brief Maximum number of segments in one scatter-gather response
+#define SERVER_MAX_SEGMENTS 8
+
+/// @brief Maximum number of listening sockets served by one server
+#define SERVER_MAX_LISTENERS 4
+
+/// @brief Number of buckets in the server histograms; bucket i counts values in [2^i, 2^(i+1))
+#define SERVER_HISTOGRAM_BUCKETS 24
+
+/// @brief Handle of a running TCP server
+typedef struct tcp_server tcp_server_t;
+
 /// @brief Response callback function type
 /// 
+/// With framing enabled the callback runs once per complete message, and `request_data` points into
+/// the connection's receive ring without a terminating NUL.
+/// 
 /// @param request_data Pointer to the received data
 /// @param request_len Length of the received data
 /// @param response_buffer Buffer to write the response to
@@ -14,22 +36,162 @@
 /// @return Length of the response data, or 0 if no response should be sent, or -1 on error
 typedef int (*response_func_t)(const char *request_data, int request_len, char *response_buffer, int response_buffer_size, void *user_data);
 
+/// @brief One buffer of a scatter-gather response
+typedef struct {
+    const void *data;          ///< Start of the buffer (static, flash-resident or caller-owned)
+    size_t len;                ///< Number of bytes to send from the buffer
+} server_segment_t;
+
+/// @brief Scatter-gather response filled in by a `response_iov_func_t`
+/// 
+/// Segments are sent with a single `sendmsg()`; whatever the socket does not take at once is copied
+/// to the connection's output queue, so segments only need to stay valid until the callback returns.
+/// Setting `more` asks the server to call the callback again for the next chunk, which lets large
+/// payloads go out in chunks. Once the output queue reaches the high watermark the next call waits
+/// until the client has read enough; `scratch` contents are not kept between calls.
+typedef struct {
+    server_segment_t segments[SERVER_MAX_SEGMENTS]; ///< Segments to send, in order
+    int segment_count;         ///< Number of valid entries in `segments`
+    bool more;                 ///< Set to true to be called again for the next chunk
+    bool close;                ///< Set with the last chunk to close the connection once the response is sent
+    void *cursor;              ///< Callback-owned state kept between chunk calls (NULL on the first call)
+    char *scratch;             ///< Server-owned buffer for small generated data such as headers
+    int scratch_size;          ///< Size of the scratch buffer
+} server_response_t;
+
+/// @brief Scatter-gather response callback function type
+/// 
+/// @param request_data Pointer to the received data
+/// @param request_len Length of the received data
+/// @param response Response to fill in; `segment_count`, `more` and `close` are reset before every call
+/// @param user_data User-provided data passed to the callback
+/// @return 0 on success, or -1 to close the connection
+typedef int (*response_iov_func_t)(const char *request_data, int request_len, server_response_t *response, void *user_data);
+
 /// @brief Server configuration options
 typedef struct {
     int keepalive_idle;        ///< TCP keepalive idle time in seconds (0 = use default)
     int keepalive_interval;    ///< TCP keepalive interval in seconds (0 = use default)
     int keepalive_count;       ///< TCP keepalive count (0 = use default)
     int max_connections;       ///< Maximum number of pending connections (0 = use default of 1)
+    int max_clients;           ///< Maximum number of clients served at once by each event loop (0 = use default of 4)
+    int worker_count;          ///< Number of worker tasks serving accepted connections (0 = serve from the accept task)
+    int core_mask;             ///< Bitmask of cores the server tasks are pinned to, round-robin (0 = no affinity)
+    int task_priority;         ///< FreeRTOS priority of the server tasks (0 = use default of 5)
+    response_iov_func_t response_iov_callback; ///< Scatter-gather callback used instead of the response callback (NULL = unused)
+    framer_options_t framer;   ///< Message framing; response callback replies to the messages of one read are sent together, scatter-gather responses with one send each (zeroed = disabled)
+    int buffer_size;           ///< Size of the pooled rx/tx blocks; bounds a request, a reply and a framed message (0 = framer.max_message_size or 1024)
+    int buffer_count;          ///< Number of pooled blocks (0 = enough for every loop plus one ring per framed connection)
+    buffer_pool_t *buffer_pool; ///< Existing pool to borrow blocks from, e.g. shared between servers (NULL = create one)
+    socket_tuning_t tuning;    ///< Applied to every accepted connection, e.g. from `socket_tuning_profile()` (zeroed = stack defaults); `send_timeout_ms` has no effect as server sockets never block
+    int output_high_watermark; ///< Bytes of queued output at which a client stops being read (0 = one pool block)
+    int output_low_watermark;  ///< Bytes of queued output at which reading resumes (0 = half the high watermark)
+    int idle_timeout_ms;       ///< Close a connection after this long without a byte received or sent (0 = disabled)
+    int read_timeout_ms;       ///< Close a connection whose partially received framed message is not complete within this long (0 = disabled)
+    int max_connections_per_ip; ///< Connections served at once from one client address; more are rejected right after accept (0 = unlimited)
+    rate_limit_t accept_rate;  ///< New connections per second from all clients; more are rejected right after accept (zeroed = unlimited)
+    rate_limit_t ip_accept_rate; ///< New connections per second from one client address (zeroed = unlimited)
+    rate_limit_t receive_rate; ///< Bytes per second read from all clients; a client is not read while the bucket is empty (zeroed = unlimited)
+    rate_limit_t ip_receive_rate; ///< Bytes per second read from one client address (zeroed = unlimited)
 } server_options_t;
 
+/// @brief Server statistics
+/// 
+/// Every event loop keeps its own counters, written only by its task, so collecting them costs no
+/// locking on the data path. `tcp_server_get_stats()` sums them on demand.
+typedef struct {
+    uint32_t accepted;         ///< Connections accepted
+    uint32_t active;           ///< Connections currently open
+    uint32_t rejected;         ///< Connections closed right after accept (no free slot or buffer, or refused by admission control)
+    uint32_t admission_rejected; ///< Connections refused by the per-IP or accept rate limits, included in `rejected`
+    uint32_t closed;           ///< Connections closed after being served
+    uint64_t bytes_in;         ///< Bytes received from clients
+    uint64_t bytes_out;        ///< Bytes sent to clients
+    uint32_t queued_bytes;     ///< Output currently queued for clients that are not reading fast enough
+    uint32_t queue_max_bytes;  ///< Largest output queue of a single connection
+    uint32_t read_pauses;      ///< Times a client stopped being read because its output queue reached the high watermark
+    uint32_t idle_timeouts;    ///< Connections closed by the idle timeout
+    uint32_t read_timeouts;    ///< Connections closed by the read timeout
+    uint32_t throttled;        ///< Times a client stopped being read because a receive bucket was empty
+    uint32_t callbacks;        ///< Response callback invocations
+    uint64_t callback_time_us; ///< Total time spent in response callbacks
+    uint32_t callback_max_us;  ///< Longest single response callback
+    uint32_t latency_histogram[SERVER_HISTOGRAM_BUCKETS]; ///< Time from a read to its replies being sent, in us
+    uint32_t latency_p50_us;   ///< Median recv-to-send latency (upper bound of its bucket)
+    uint32_t latency_p99_us;   ///< 99th percentile recv-to-send latency (upper bound of its bucket)
+    uint32_t lifetime_histogram[SERVER_HISTOGRAM_BUCKETS]; ///< Lifetime of closed connections, in ms
+    uint64_t lifetime_total_ms; ///< Summed lifetime of closed connections
+    uint32_t lifetime_max_ms;  ///< Longest lifetime of a closed connection
+    buffer_pool_stats_t buffers; ///< Usage of the server's buffer pool
+} tcp_server_stats_t;
+
 /// @brief Start a TCP server
 /// 
+/// The server runs a single select() event loop that keeps up to `max_clients` connections open
+/// and calls the response callback for whichever client has data ready. Further connections wait
+/// in the listen backlog until a slot frees up.
+/// 
+/// Sends never block: output a client does not read fast enough is queued in pool blocks, and the
+/// client is not read again until its queue drains below `output_low_watermark`, so one slow reader
+/// neither stalls the event loop nor grows without bound.
+/// 
+/// The idle and read timeouts are checked by a timer wheel in each event loop with a resolution of
+/// 100 ms, so a silent or half-open client gives its slot and buffers back long before TCP
+/// keepalive would notice it.
+/// 
+/// Admission control and the receive rate limits use token buckets per client address, tracked for
+/// up to 16 addresses at once, and for the server as a whole. Throttling a client only defers
+/// reading from it, so one flooding device cannot starve the callbacks of the others.
+/// 
+/// With `worker_count` > 0 the listening task only accepts; connections are handed to a pool of
+/// worker tasks through a FreeRTOS queue, and each worker runs its own event loop, so a slow
+/// callback only holds up the clients of that worker.
+/// 
+/// The listening socket is bound before this function returns, so a port already in use is
+/// reported here rather than by the server task.
+/// 
 /// @param port The port number to listen on
 /// @param host The host address to bind to (NULL or empty string for INADDR_ANY)
 /// @param response_callback Function to call when data is received from clients
 /// @param user_data User data to pass to the response callback
 /// @param options Optional server configuration (can be NULL for defaults)
-/// @return 0 on success, -1 on failure
-int tcp_server_start(uint16_t port, const char *host, response_func_t response_callback, void *user_data, server_options_t *options);
+/// @return Handle of the running server, or NULL on failure
+tcp_server_t *tcp_server_start(uint16_t port, const char *host, response_func_t response_callback, void *user_data, server_options_t *options);
+
+/// @brief Listen on a further port, served by the same event loops and callbacks
+/// 
+/// @param server Running server
+/// @param port The port number to listen on
+/// @param host The host address to bind to (NULL or empty string for INADDR_ANY)
+/// @return 0 on success, -1 on failure or when `SERVER_MAX_LISTENERS` are already open
+int tcp_server_add_listener(tcp_server_t *server, uint16_t port, const char *host);
+
+/// @brief Replace the options of a running server without closing its listening sockets
+/// 
+/// The event loops are drained and restarted with the new options; clients connecting meanwhile
+/// wait in the listen backlog. Statistics are carried over.
+/// 
+/// @param server Running server
+/// @param options New server configuration (can be NULL for defaults)
+/// @param drain_timeout_ms How long open connections may finish before they are closed
+/// @return 0 on success, -1 if the server could not be restarted (it is then stopped but must still be freed with `tcp_server_stop()`)
+int tcp_server_update_options(tcp_server_t *server, server_options_t *options, int drain_timeout_ms);
+
+/// @brief Stop a server and free it
+/// 
+/// New connections are no longer accepted. Open connections are served until their clients close
+/// them or the drain timeout passes, then the remaining ones are closed along with the listening
+/// sockets. The handle is invalid afterwards.
+/// 
+/// @param server Server to stop (NULL is ignored)
+/// @param drain_timeout_ms How long open connections may finish before they are closed (0 = close at once)
+void tcp_server_stop(tcp_server_t *server, int drain_timeout_ms);
+
+/// @brief Read the statistics of a running server
+/// 
+/// @param server Running server
+/// @param stats Filled in with the summed counters and derived percentiles
+/// @return 0 on success, -1 on invalid arguments
+int tcp_server_get_stats(tcp_server_t *server, tcp_server_stats_t *stats);
 
-#endif // ABSTCP_V4_SERVER_H
\ No newline at end of file
+#endif // ABSTCP_V4_SERVER_H
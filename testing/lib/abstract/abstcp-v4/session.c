@@ -0,0 +1,300 @@
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+
+#include "lwip/sockets.h"
+
+#include "abstcp-v4/session.h"
+#include "abstcp-v4/client.h"
+
+static const char *TAG = "abstcp-v4-session";
+
+// Default session settings
+#define DEFAULT_INITIAL_BACKOFF_MS 250
+#define DEFAULT_MAX_BACKOFF_MS     30000
+#define DEFAULT_CONNECT_TIMEOUT_MS 3000
+#define DEFAULT_SEND_TIMEOUT_MS    5000
+#define DEFAULT_QUEUE_SIZE         4096
+#define DEFAULT_TASK_PRIORITY      5
+#define SESSION_TASK_STACK_SIZE    4096
+
+// A connection that drops sooner than this does not reset the backoff, so a server that accepts
+// and immediately closes is not hammered either
+#define STABLE_CONNECTION_MS       10000
+
+// Size of the receive buffer on the session task's stack
+#define SESSION_RX_BUFFER_SIZE     512
+
+struct tcp_session {
+    char *host;
+    uint16_t port;
+    tcp_session_options_t options;
+    SemaphoreHandle_t send_lock; // Held across sends so messages stay whole and in order; taken before `lock`
+    SemaphoreHandle_t lock;    // Guards everything below; never held across a send
+    SemaphoreHandle_t wake;    // Given to cut a backoff wait short when stopping
+    SemaphoreHandle_t task_done; // Given by the session task when it exits
+    tcp_client_t *conn;        // NULL while disconnected; changed with both locks held
+    volatile bool stopping;
+    char *queue;               // Messages held during an outage, in order; changed with both locks held
+    int queue_used;
+    int queue_messages;
+    int64_t down_since_us;     // Start of the current outage
+    tcp_session_stats_t stats;
+};
+
+// Waits `backoff_ms` with up to half of it taken off at random, so clients dropped together do not
+// reconnect together. Returns early when the session is being stopped.
+static void wait_backoff(tcp_session_t *session, int backoff_ms)
+{
+    int half = backoff_ms / 2;
+    int wait_ms = backoff_ms - half + (int)(esp_random() % (uint32_t)(half + 1));
+    xSemaphoreTake(session->wake, pdMS_TO_TICKS(wait_ms));
+}
+
+// Sends the held messages on a new connection. Call with the send lock held, which keeps the queue
+// unchanged while it is sent. Returns 0, or -1 if the connection failed again.
+static int replay_queue(tcp_session_t *session, tcp_client_t *conn)
+{
+    if (session->queue_used == 0) {
+        return 0;
+    }
+    return tcp_client_send(conn, session->queue, session->queue_used) < 0 ? -1 : 0;
+}
+
+static void tcp_session_task(void *pvParameters)
+{
+    tcp_session_t *session = (tcp_session_t *)pvParameters;
+    int backoff_ms = session->options.initial_backoff_ms;
+    bool ever_connected = false;
+    char buffer[SESSION_RX_BUFFER_SIZE];
+
+    while (!session->stopping) {
+        tcp_client_t *conn = tcp_client_connect(session->host, session->port, &session->options.tuning,
+                                                session->options.connect_timeout_ms);
+        if (conn) {
+            xSemaphoreTake(session->send_lock, portMAX_DELAY);
+            if (session->stopping || replay_queue(session, conn) < 0) {
+                xSemaphoreGive(session->send_lock);
+                tcp_client_close(conn);
+                conn = NULL;
+            } else {
+                int64_t now = esp_timer_get_time();
+                xSemaphoreTake(session->lock, portMAX_DELAY);
+                session->stats.replayed += session->queue_messages;
+                session->queue_used = 0;
+                session->queue_messages = 0;
+                session->conn = conn;
+                session->stats.connected = true;
+                session->stats.downtime_ms += (now - session->down_since_us) / 1000;
+                if (ever_connected) {
+                    session->stats.reconnects++;
+                }
+                ever_connected = true;
+                xSemaphoreGive(session->lock);
+                xSemaphoreGive(session->send_lock);
+                ESP_LOGI(TAG, "Connected to %s:%d", session->host, session->port);
+            }
+        }
+        if (!conn) {
+            if (session->stopping) {
+                break;
+            }
+            xSemaphoreTake(session->lock, portMAX_DELAY);
+            session->stats.connect_failures++;
+            xSemaphoreGive(session->lock);
+            wait_backoff(session, backoff_ms);
+            backoff_ms = MIN(backoff_ms * 2, session->options.max_backoff_ms);
+            continue;
+        }
+
+        // Serve the connection until it drops; senders detect failures and shut it down too
+        int64_t connected_at = esp_timer_get_time();
+        for (;;) {
+            ssize_t len = tcp_client_recv(conn, buffer, sizeof(buffer), 0);
+            if (len <= 0) {
+                break;
+            }
+            if (session->options.recv_callback) {
+                session->options.recv_callback(buffer, len, session->options.user_data);
+            }
+        }
+
+        // Waiting for the send lock lets a sender finish with the connection before it is closed
+        xSemaphoreTake(session->send_lock, portMAX_DELAY);
+        xSemaphoreTake(session->lock, portMAX_DELAY);
+        session->conn = NULL;
+        session->stats.connected = false;
+        session->down_since_us = esp_timer_get_time();
+        xSemaphoreGive(session->lock);
+        xSemaphoreGive(session->send_lock);
+        tcp_client_close(conn);
+        if (session->stopping) {
+            break;
+        }
+        ESP_LOGW(TAG, "Connection to %s:%d lost", session->host, session->port);
+
+        if ((session->down_since_us - connected_at) / 1000 >= STABLE_CONNECTION_MS) {
+            backoff_ms = session->options.initial_backoff_ms;
+        } else {
+            wait_backoff(session, backoff_ms);
+            backoff_ms = MIN(backoff_ms * 2, session->options.max_backoff_ms);
+        }
+    }
+
+    xSemaphoreGive(session->task_done);
+    vTaskDelete(NULL);
+}
+
+static void free_session(tcp_session_t *session)
+{
+    if (session->send_lock) {
+        vSemaphoreDelete(session->send_lock);
+    }
+    if (session->lock) {
+        vSemaphoreDelete(session->lock);
+    }
+    if (session->wake) {
+        vSemaphoreDelete(session->wake);
+    }
+    if (session->task_done) {
+        vSemaphoreDelete(session->task_done);
+    }
+    free(session->queue);
+    free(session->host);
+    free(session);
+}
+
+tcp_session_t *tcp_session_start(const char *host, uint16_t port, const tcp_session_options_t *options)
+{
+    if (!host) {
+        return NULL;
+    }
+
+    tcp_session_t *session = calloc(1, sizeof(tcp_session_t));
+    if (!session) {
+        ESP_LOGE(TAG, "Failed to allocate memory for session");
+        return NULL;
+    }
+    if (options) {
+        session->options = *options;
+    }
+    if (session->options.initial_backoff_ms <= 0) {
+        session->options.initial_backoff_ms = DEFAULT_INITIAL_BACKOFF_MS;
+    }
+    if (session->options.max_backoff_ms < session->options.initial_backoff_ms) {
+        session->options.max_backoff_ms = MAX(DEFAULT_MAX_BACKOFF_MS, session->options.initial_backoff_ms);
+    }
+    if (session->options.connect_timeout_ms <= 0) {
+        session->options.connect_timeout_ms = DEFAULT_CONNECT_TIMEOUT_MS;
+    }
+    if (session->options.send_timeout_ms <= 0) {
+        session->options.send_timeout_ms = DEFAULT_SEND_TIMEOUT_MS;
+    }
+    session->options.tuning.send_timeout_ms = session->options.send_timeout_ms;
+    if (session->options.queue_size <= 0) {
+        session->options.queue_size = DEFAULT_QUEUE_SIZE;
+    }
+    if (session->options.task_priority <= 0) {
+        session->options.task_priority = DEFAULT_TASK_PRIORITY;
+    }
+
+    session->port = port;
+    session->host = strdup(host);
+    session->queue = malloc(session->options.queue_size);
+    session->send_lock = xSemaphoreCreateMutex();
+    session->lock = xSemaphoreCreateMutex();
+    session->wake = xSemaphoreCreateBinary();
+    session->task_done = xSemaphoreCreateBinary();
+    if (!session->host || !session->queue || !session->send_lock || !session->lock || !session->wake || !session->task_done) {
+        ESP_LOGE(TAG, "Failed to allocate memory for session");
+        free_session(session);
+        return NULL;
+    }
+    session->down_since_us = esp_timer_get_time();
+
+    if (xTaskCreate(tcp_session_task, "tcp_session", SESSION_TASK_STACK_SIZE, session,
+                    session->options.task_priority, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create session task");
+        free_session(session);
+        return NULL;
+    }
+    return session;
+}
+
+ssize_t tcp_session_send(tcp_session_t *session, const void *data, size_t len)
+{
+    if (!session) {
+        return -1;
+    }
+
+    // The send lock keeps the connection open and the queue unchanged. Its holder may block for
+    // send_timeout_ms on a stalled peer, and waiting senders block behind it for as long.
+    xSemaphoreTake(session->send_lock, portMAX_DELAY);
+    // Anything queued goes out first, and only the session task replays it
+    if (session->conn && session->queue_used == 0) {
+        if (tcp_client_send(session->conn, data, len) >= 0) {
+            xSemaphoreGive(session->send_lock);
+            return len;
+        }
+        // Make the session task notice the drop; the message is held for the next connection
+        shutdown(tcp_client_socket(session->conn), SHUT_RDWR);
+    }
+
+    ssize_t result = len;
+    xSemaphoreTake(session->lock, portMAX_DELAY);
+    if (len > (size_t)(session->options.queue_size - session->queue_used)) {
+        session->stats.dropped++;
+        result = -1;
+    } else {
+        memcpy(session->queue + session->queue_used, data, len);
+        session->queue_used += len;
+        session->queue_messages++;
+    }
+    xSemaphoreGive(session->lock);
+    xSemaphoreGive(session->send_lock);
+    if (result < 0) {
+        ESP_LOGW(TAG, "Session queue full, dropping %d byte(s)", (int)len);
+    }
+    return result;
+}
+
+int tcp_session_get_stats(tcp_session_t *session, tcp_session_stats_t *stats)
+{
+    if (!session || !stats) {
+        return -1;
+    }
+
+    xSemaphoreTake(session->lock, portMAX_DELAY);
+    *stats = session->stats;
+    stats->queued_bytes = session->queue_used;
+    if (!session->conn) {
+        stats->downtime_ms += (esp_timer_get_time() - session->down_since_us) / 1000;
+    }
+    xSemaphoreGive(session->lock);
+    return 0;
+}
+
+void tcp_session_stop(tcp_session_t *session)
+{
+    if (!session) {
+        return;
+    }
+
+    xSemaphoreTake(session->lock, portMAX_DELAY);
+    session->stopping = true;
+    if (session->conn) {
+        shutdown(tcp_client_socket(session->conn), SHUT_RDWR);
+    }
+    xSemaphoreGive(session->lock);
+    xSemaphoreGive(session->wake);
+
+    xSemaphoreTake(session->task_done, portMAX_DELAY);
+    free_session(session);
+}
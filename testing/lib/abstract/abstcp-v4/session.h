@@ -0,0 +1,85 @@
+#ifndef ABSTCP_V4_SESSION_H
+#define ABSTCP_V4_SESSION_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "abstcp-v4/socket-tuning.h"
+
+/// @brief Handle of a persistent client session
+typedef struct tcp_session tcp_session_t;
+
+/// @brief Receive callback of a session
+/// @param data Received bytes, valid only during the call
+/// @param len Number of received bytes
+/// @param user_data User data from `tcp_session_options_t`
+typedef void (*tcp_session_recv_func_t)(const char *data, int len, void *user_data);
+
+/// @brief Session configuration options
+typedef struct {
+    int initial_backoff_ms;    ///< Wait before the first reconnect attempt (0 = use default of 250)
+    int max_backoff_ms;        ///< Longest wait between attempts; the wait doubles up to it (0 = use default of 30000)
+    int connect_timeout_ms;    ///< Deadline of each connect attempt (0 = use default of 3000)
+    int send_timeout_ms;       ///< Longest a send may block before the connection is treated as lost; overrides `tuning.send_timeout_ms` (0 = use default of 5000)
+    int queue_size;            ///< Bytes of outbound messages held during an outage (0 = use default of 4096)
+    socket_tuning_t tuning;    ///< Applied to every connection of the session (zeroed = stack defaults)
+    tcp_session_recv_func_t recv_callback; ///< Called with incoming data on the session task (NULL = discard it)
+    void *user_data;           ///< Passed to the receive callback
+    int task_priority;         ///< FreeRTOS priority of the session task (0 = use default of 5)
+} tcp_session_options_t;
+
+/// @brief Session statistics
+typedef struct {
+    bool connected;            ///< Whether the session is connected right now
+    uint32_t reconnects;       ///< Connections re-established after a drop
+    uint32_t connect_failures; ///< Connect attempts that failed
+    uint64_t downtime_ms;      ///< Time spent without a connection, including the current outage
+    uint32_t queued_bytes;     ///< Bytes waiting for the next connection
+    uint32_t replayed;         ///< Messages sent after being held during an outage
+    uint32_t dropped;          ///< Messages refused because the queue was full
+} tcp_session_stats_t;
+
+/// @brief Start a session that keeps a connection to one server open
+/// 
+/// A session task connects and reconnects whenever the connection drops, waiting a jittered,
+/// exponentially growing time between failed attempts so a lost server is not hammered. Messages
+/// sent during an outage are held in a bounded queue and replayed in order once connected again.
+/// A message interrupted by the drop is replayed whole, so the server may see part of it twice.
+/// Delivery is not guaranteed: a message counts as sent once the socket takes it, so one still in
+/// the socket's send buffer when the connection drops is lost. Protocols that cannot lose messages
+/// need acknowledgements on top.
+/// 
+/// @param host The host name or IP address to connect to
+/// @param port The port number to connect to
+/// @param options Optional session configuration (can be NULL for defaults)
+/// @return Handle of the session, or NULL on failure; the first connect happens in the background
+tcp_session_t *tcp_session_start(const char *host, uint16_t port, const tcp_session_options_t *options);
+
+/// @brief Send a message, or queue it while the session is not connected
+/// 
+/// Safe to call from several tasks at once. A send that blocks for `send_timeout_ms` is treated
+/// as a lost connection and the message is queued for the next one.
+/// 
+/// Sends are serialised, so a call also waits for the send of another task, or for the replay of
+/// queued messages after a reconnect. Against a stalled peer that wait lasts up to `send_timeout_ms`
+/// (5000 ms by default); lower it where callers cannot block that long.
+/// 
+/// @param session Running session
+/// @param data Message to send
+/// @param len Length of the message
+/// @return Number of bytes sent or queued, or -1 if the queue has no room for the message
+ssize_t tcp_session_send(tcp_session_t *session, const void *data, size_t len);
+
+/// @brief Read the statistics of a session
+/// @param session Running session
+/// @param stats Filled in with the current counters
+/// @return 0 on success, -1 on invalid arguments
+int tcp_session_get_stats(tcp_session_t *session, tcp_session_stats_t *stats);
+
+/// @brief Stop a session, close its connection and free it; queued messages are discarded
+/// @param session Session to stop (NULL is ignored)
+void tcp_session_stop(tcp_session_t *session);
+
+#endif // ABSTCP_V4_SESSION_H
@@ -0,0 +1,115 @@
+#include <string.h>
+#include <errno.h>
+#include "esp_log.h"
+#include "lwip/sockets.h"
+
+#include "abstcp-v4/socket-tuning.h"
+
+static const char *TAG = "abstcp-v4-tuning";
+
+// Send timeouts of the profiles that fail fast instead of blocking on a stalled peer
+#define LOW_LATENCY_SEND_TIMEOUT_MS 1000
+#define BALANCED_SEND_TIMEOUT_MS    5000
+
+// Buffer size requested by the bulk profile. lwIP has no SO_SNDBUF and only uses SO_RCVBUF as a cap,
+// so there the window comes from CONFIG_LWIP_TCP_SND_BUF_DEFAULT and CONFIG_LWIP_TCP_WND_DEFAULT
+#define BULK_BUFFER_SIZE            (64 * 1024)
+
+// Every profile turns Nagle's algorithm off: it stalls split writes behind the peer's delayed ACK,
+// and batching is left to corking instead
+void socket_tuning_profile(socket_profile_t profile, socket_tuning_t *tuning)
+{
+    memset(tuning, 0, sizeof(*tuning));
+
+    switch (profile) {
+    case SOCKET_PROFILE_LOW_LATENCY:
+        tuning->nodelay = true;
+        tuning->send_timeout_ms = LOW_LATENCY_SEND_TIMEOUT_MS;
+        break;
+    case SOCKET_PROFILE_BALANCED:
+        tuning->nodelay = true;
+        tuning->send_timeout_ms = BALANCED_SEND_TIMEOUT_MS;
+        tuning->cork = true;
+        break;
+    case SOCKET_PROFILE_BULK:
+        tuning->nodelay = true;
+        tuning->cork = true;
+        tuning->send_buffer = BULK_BUFFER_SIZE;
+        tuning->recv_buffer = BULK_BUFFER_SIZE;
+        break;
+    default:
+        break;
+    }
+}
+
+const char *socket_profile_name(socket_profile_t profile)
+{
+    switch (profile) {
+    case SOCKET_PROFILE_LOW_LATENCY: return "low-latency";
+    case SOCKET_PROFILE_BALANCED:    return "balanced";
+    case SOCKET_PROFILE_BULK:        return "bulk";
+    default:                         return "default";
+    }
+}
+
+static int set_option(int sock, int level, int option, const void *value, socklen_t len, const char *name)
+{
+    if (setsockopt(sock, level, option, value, len) != 0) {
+        ESP_LOGD(TAG, "Socket %d does not support %s: errno %d", sock, name, errno);
+        return -1;
+    }
+    return 0;
+}
+
+int socket_tuning_apply(int sock, const socket_tuning_t *tuning)
+{
+    if (!tuning) {
+        return 0;
+    }
+
+    // TCP_NODELAY is always written so re-tuning an open socket can turn it back off
+    int nodelay = tuning->nodelay ? 1 : 0;
+    int result = set_option(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay), "TCP_NODELAY");
+    if (tuning->send_buffer > 0) {
+        result |= set_option(sock, SOL_SOCKET, SO_SNDBUF, &tuning->send_buffer, sizeof(int), "SO_SNDBUF");
+    }
+    if (tuning->recv_buffer > 0) {
+        result |= set_option(sock, SOL_SOCKET, SO_RCVBUF, &tuning->recv_buffer, sizeof(int), "SO_RCVBUF");
+    }
+    if (tuning->send_timeout_ms > 0) {
+        struct timeval timeout = {
+            .tv_sec = tuning->send_timeout_ms / 1000,
+            .tv_usec = (tuning->send_timeout_ms % 1000) * 1000,
+        };
+        result |= set_option(sock, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout), "SO_SNDTIMEO");
+    }
+    return result;
+}
+
+void socket_cork(int sock, const socket_tuning_t *tuning)
+{
+    if (!tuning || !tuning->cork) {
+        return;
+    }
+#ifdef TCP_CORK
+    int on = 1;
+    set_option(sock, IPPROTO_TCP, TCP_CORK, &on, sizeof(on), "TCP_CORK");
+#else
+    int off = 0;
+    set_option(sock, IPPROTO_TCP, TCP_NODELAY, &off, sizeof(off), "TCP_NODELAY");
+#endif
+}
+
+void socket_uncork(int sock, const socket_tuning_t *tuning)
+{
+    if (!tuning || !tuning->cork) {
+        return;
+    }
+#ifdef TCP_CORK
+    int off = 0;
+    set_option(sock, IPPROTO_TCP, TCP_CORK, &off, sizeof(off), "TCP_CORK");
+#else
+    int nodelay = tuning->nodelay ? 1 : 0;
+    set_option(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay), "TCP_NODELAY");
+#endif
+}
@@ -0,0 +1,60 @@
+#ifndef ABSTCP_V4_SOCKET_TUNING_H
+#define ABSTCP_V4_SOCKET_TUNING_H
+
+#include <stdbool.h>
+
+/// @brief Named socket tuning profiles
+typedef enum {
+    SOCKET_PROFILE_DEFAULT = 0,    ///< Leave every option at the stack default
+    SOCKET_PROFILE_LOW_LATENCY,    ///< Small request/response traffic: Nagle off, short send timeout
+    SOCKET_PROFILE_BALANCED,       ///< Nagle off, but multi-part responses are corked into full segments
+    SOCKET_PROFILE_BULK,           ///< Large transfers: corked, larger buffers, no send timeout
+} socket_profile_t;
+
+/// @brief Per-socket tuning; a zeroed struct leaves every option at the stack default
+typedef struct {
+    bool nodelay;              ///< Set TCP_NODELAY to send small writes without waiting for an ACK
+    int send_buffer;           ///< SO_SNDBUF in bytes (0 = default; lwIP sizes it with CONFIG_LWIP_TCP_SND_BUF_DEFAULT instead)
+    int recv_buffer;           ///< SO_RCVBUF in bytes (0 = default; needs CONFIG_LWIP_SO_RCVBUF)
+    int send_timeout_ms;       ///< SO_SNDTIMEO, after which a blocked send fails (0 = block forever)
+    bool cork;                 ///< Hold back partial segments between `socket_cork()` and `socket_uncork()`
+} socket_tuning_t;
+
+/// @brief Get the tuning of a named profile
+/// @param profile Profile to look up
+/// @param tuning Filled in with the profile's settings
+void socket_tuning_profile(socket_profile_t profile, socket_tuning_t *tuning);
+
+/// @brief Get the name of a profile, e.g. for benchmark output
+/// @param profile Profile to look up
+/// @return Static profile name
+const char *socket_profile_name(socket_profile_t profile);
+
+/// @brief Apply a tuning to a connected or listening socket
+/// 
+/// Options the stack does not support are skipped, so a failure never leaves the socket unusable.
+/// 
+/// @param sock Socket to tune
+/// @param tuning Tuning to apply (NULL is ignored)
+/// @return 0 if every requested option was applied, -1 if any was rejected
+int socket_tuning_apply(int sock, const socket_tuning_t *tuning);
+
+/// @brief Start batching writes on a socket whose tuning enables `cork`
+/// 
+/// Uses TCP_CORK where available. lwIP has no TCP_CORK, so there Nagle's algorithm is turned back
+/// on to coalesce small writes while corked.
+/// 
+/// @param sock Socket to cork
+/// @param tuning Tuning the socket was set up with; nothing happens unless `cork` is set
+void socket_cork(int sock, const socket_tuning_t *tuning);
+
+/// @brief Stop batching writes and restore the socket's configured TCP_NODELAY setting
+/// 
+/// With the lwIP fallback, data already held back is only released by the next write or ACK, so
+/// uncork before the last write of a batch rather than after it.
+/// 
+/// @param sock Socket to uncork
+/// @param tuning Tuning the socket was set up with; nothing happens unless `cork` is set
+void socket_uncork(int sock, const socket_tuning_t *tuning);
+
+#endif // ABSTCP_V4_SOCKET_TUNING_H
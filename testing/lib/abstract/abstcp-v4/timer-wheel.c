@@ -0,0 +1,91 @@
+#include <string.h>
+
+#include "abstcp-v4/timer-wheel.h"
+
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+
+_Static_assert((TIMER_WHEEL_SLOTS & SLOT_MASK) == 0, "TIMER_WHEEL_SLOTS must be a power of two");
+
+// Tick comparison that keeps working when the tick counter wraps around
+static bool tick_reached(uint32_t tick, uint32_t now)
+{
+    return (int32_t)(now - tick) >= 0;
+}
+
+void timer_wheel_init(timer_wheel_t *wheel, uint32_t now)
+{
+    memset(wheel->slots, 0, sizeof(wheel->slots));
+    wheel->now = now;
+}
+
+// Removes an armed entry from its slot
+static void unlink_entry(timer_entry_t **slot, timer_entry_t *entry)
+{
+    if (entry->prev) {
+        entry->prev->next = entry->next;
+    } else {
+        *slot = entry->next;
+    }
+    if (entry->next) {
+        entry->next->prev = entry->prev;
+    }
+    entry->next = NULL;
+    entry->prev = NULL;
+    entry->armed = false;
+}
+
+void timer_wheel_cancel(timer_wheel_t *wheel, timer_entry_t *entry)
+{
+    if (entry->armed) {
+        unlink_entry(&wheel->slots[entry->slot], entry);
+    }
+}
+
+void timer_wheel_schedule(timer_wheel_t *wheel, timer_entry_t *entry, uint32_t deadline)
+{
+    timer_wheel_cancel(wheel, entry);
+
+    // A deadline that has already passed goes in the next slot to be visited
+    uint32_t tick = tick_reached(deadline, wheel->now) ? wheel->now + 1 : deadline;
+    timer_entry_t **slot = &wheel->slots[tick & SLOT_MASK];
+
+    entry->deadline = deadline;
+    entry->slot = tick & SLOT_MASK;
+    entry->armed = true;
+    entry->prev = NULL;
+    entry->next = *slot;
+    if (*slot) {
+        (*slot)->prev = entry;
+    }
+    *slot = entry;
+}
+
+timer_entry_t *timer_wheel_advance(timer_wheel_t *wheel, uint32_t now)
+{
+    timer_entry_t *expired = NULL;
+
+    // After a long stall a single turn visits every slot once
+    uint32_t steps = now - wheel->now;
+    if ((int32_t)steps <= 0) {
+        return NULL;
+    }
+    if (steps > TIMER_WHEEL_SLOTS) {
+        steps = TIMER_WHEEL_SLOTS;
+    }
+
+    for (uint32_t i = 1; i <= steps; i++) {
+        timer_entry_t **slot = &wheel->slots[(wheel->now + i) & SLOT_MASK];
+        timer_entry_t *entry = *slot;
+        while (entry) {
+            timer_entry_t *next = entry->next;
+            if (tick_reached(entry->deadline, now)) {
+                unlink_entry(slot, entry);
+                entry->next = expired;
+                expired = entry;
+            }
+            entry = next;
+        }
+    }
+    wheel->now = now;
+    return expired;
+}
@@ -0,0 +1,50 @@
+#ifndef ABSTCP_V4_TIMER_WHEEL_H
+#define ABSTCP_V4_TIMER_WHEEL_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/// @brief Number of slots in a timer wheel (must be a power of two)
+#define TIMER_WHEEL_SLOTS 64
+
+/// @brief Timer embedded in the object it times, so scheduling never allocates
+typedef struct timer_entry {
+    struct timer_entry *next;  ///< Next entry in the same slot, or in the expired list
+    struct timer_entry *prev;  ///< Previous entry in the same slot
+    uint32_t deadline;         ///< Tick at which the timer expires
+    uint16_t slot;             ///< Index of the slot holding the entry while armed
+    bool armed;                ///< True while the entry sits in the wheel
+} timer_entry_t;
+
+/// @brief Hashed timer wheel: an entry waits in the slot of its deadline tick
+///
+/// Scheduling and cancelling are O(1). Each tick visits a single slot, where entries whose deadline
+/// lies one or more turns ahead are simply skipped. Not thread safe; meant to be owned by one task.
+typedef struct {
+    timer_entry_t *slots[TIMER_WHEEL_SLOTS]; ///< Head of each slot's list
+    uint32_t now;              ///< Last tick the wheel was advanced to
+} timer_wheel_t;
+
+/// @brief Initialize an empty wheel
+/// @param wheel Wheel to initialize
+/// @param now Current tick
+void timer_wheel_init(timer_wheel_t *wheel, uint32_t now);
+
+/// @brief Arm a timer, or move it if it is already armed
+/// @param wheel Wheel to schedule on
+/// @param entry Timer to arm
+/// @param deadline Tick at which the timer expires; a tick already passed expires on the next advance
+void timer_wheel_schedule(timer_wheel_t *wheel, timer_entry_t *entry, uint32_t deadline);
+
+/// @brief Disarm a timer
+/// @param wheel Wheel the timer was scheduled on
+/// @param entry Timer to disarm (ignored if not armed)
+void timer_wheel_cancel(timer_wheel_t *wheel, timer_entry_t *entry);
+
+/// @brief Advance the wheel and take out every timer that has expired
+/// @param wheel Wheel to advance
+/// @param now Current tick
+/// @return Expired timers linked through `next`, already disarmed, or NULL if none expired
+timer_entry_t *timer_wheel_advance(timer_wheel_t *wheel, uint32_t now);
+
+#endif // ABSTCP_V4_TIMER_WHEEL_H
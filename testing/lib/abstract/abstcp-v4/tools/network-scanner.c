@@ -1,18 +1,97 @@
-#include "abstcp-v4/client.h"
 #include "abstcp-v4/tools/network-scanner.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <errno.h>
 #ifdef ESP_PLATFORM
+#include "sdkconfig.h"
 #include "lwip/inet.h"
 #include "lwip/sockets.h"
+#include "lwip/etharp.h"
+#include "lwip/netif.h"
+#include "lwip/tcpip.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "esp_netif_sta_list.h"
 #include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 #include "freertos/task.h"
 #else
 #include <arpa/inet.h>
+#include <netinet/in.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <time.h>
 #endif
 
+// Default number of connects kept in flight
+#define DEFAULT_SCAN_CONCURRENCY 8
+
+// Default deadline of one probe
+#define DEFAULT_SCAN_TIMEOUT_MS  1000
+
+// Default time to wait for ARP and ping replies
+#define DEFAULT_DISCOVERY_TIMEOUT_MS 200
+
+// Default number of connects kept in flight by the sweep of a delta rescan
+#define DEFAULT_SWEEP_CONCURRENCY 2
+
+// Size of the arena chunks of a compact result; a larger host record gets a chunk of its own
+#define SCAN_ARENA_CHUNK_SIZE    512
+
+// Upper bound of the window; on lwIP half the sockets are left to the rest of the firmware
+#if defined(CONFIG_LWIP_MAX_SOCKETS)
+#define MAX_SCAN_CONCURRENCY     (CONFIG_LWIP_MAX_SOCKETS / 2)
+#else
+#define MAX_SCAN_CONCURRENCY     64
+#endif
+
+// One connect in flight
+typedef struct {
+    int sock;                  // -1 for a free slot
+    uint32_t probe;            // Index into the host x port sequence
+    int attempt;
+    int64_t deadline_us;
+} scan_slot_t;
+
+// An open port, collected in completion order and sorted into devices once its host is done
+typedef struct {
+    uint32_t probe;
+} scan_hit_t;
+
+// A MAC address learnt during discovery
+typedef struct {
+    uint32_t ip;
+    uint8_t mac[6];
+} scan_mac_t;
+
+// Hosts of the range found alive, as bitmaps indexed by offset from the start address
+typedef struct {
+    uint32_t start_ip;
+    uint32_t host_count;
+    uint8_t *live;
+    uint8_t *checked;          // Settled by ARP or the station list, so not pinged
+    int alive;
+    scan_mac_t *macs;
+    int mac_count;
+    int mac_capacity;
+} scan_discovery_t;
+
+static int64_t now_us(void) {
+#ifdef ESP_PLATFORM
+    return esp_timer_get_time();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
 // Helper function to convert IP string to integer
 static uint32_t ip_to_int(const char *ip) {
     struct in_addr addr;
@@ -29,63 +108,969 @@ static void int_to_ip(uint32_t ip, char *buffer) {
     strcpy(buffer, inet_ntoa(addr));
 }
 
-// Callback function for handling received data during port scan
-static ssize_t scan_recv_callback(int sockfd, void *buf, size_t len, int flags) {
-    // For network scanning, we just need to know if connection succeeded
-    // We don't need to process the received data
-    return 0;
+static bool bit_is_set(const uint8_t *bits, uint32_t index) {
+    return bits[index >> 3] & (1u << (index & 7));
+}
+
+static void set_bit(uint8_t *bits, uint32_t index) {
+    bits[index >> 3] |= 1u << (index & 7);
+}
+
+// Marks an address of the range alive, remembering its MAC address if one is known
+static void mark_alive(scan_discovery_t *discovery, uint32_t ip, const uint8_t *mac) {
+    if (ip < discovery->start_ip || ip - discovery->start_ip >= discovery->host_count) {
+        return;
+    }
+    uint32_t host = ip - discovery->start_ip;
+    set_bit(discovery->checked, host);
+    if (bit_is_set(discovery->live, host)) {
+        return;
+    }
+    set_bit(discovery->live, host);
+    discovery->alive++;
+
+    if (!mac) {
+        return;
+    }
+    if (discovery->mac_count == discovery->mac_capacity) {
+        int capacity = discovery->mac_capacity ? discovery->mac_capacity * 2 : 8;
+        scan_mac_t *grown = realloc(discovery->macs, capacity * sizeof(scan_mac_t));
+        if (!grown) {
+            return;
+        }
+        discovery->macs = grown;
+        discovery->mac_capacity = capacity;
+    }
+    scan_mac_t *entry = &discovery->macs[discovery->mac_count++];
+    entry->ip = ip;
+    memcpy(entry->mac, mac, sizeof(entry->mac));
+}
+
+#ifdef ESP_PLATFORM
+// One batch of the ARP sweep, run in the tcpip thread as etharp is not thread-safe
+typedef struct {
+    scan_discovery_t *discovery;
+    uint32_t first;
+    uint32_t count;
+    bool read_back;            // false = send the requests, true = collect the replies from the ARP table
+    struct netif *ap_netif;
+    bool ap_settled;           // Every soft-AP station already has a known address
+    int requests;              // ARP requests sent for the batch
+    SemaphoreHandle_t done;
+} arp_batch_t;
+
+static void arp_batch_in_tcpip(void *arg) {
+    arp_batch_t *batch = arg;
+    scan_discovery_t *discovery = batch->discovery;
+
+    if (batch->read_back) {
+        for (size_t i = 0; i < ARP_TABLE_SIZE; i++) {
+            ip4_addr_t *ip;
+            struct netif *netif;
+            struct eth_addr *eth;
+            if (etharp_get_entry(i, &ip, &netif, &eth)) {
+                mark_alive(discovery, ntohl(ip4_addr_get_u32(ip)), eth->addr);
+            }
+        }
+        xSemaphoreGive(batch->done);
+        return;
+    }
+
+    batch->requests = 0;
+    for (uint32_t host = batch->first; host < batch->first + batch->count; host++) {
+        if (bit_is_set(discovery->checked, host)) {
+            continue;
+        }
+        uint32_t target = htonl(discovery->start_ip + host);
+        struct netif *netif;
+        NETIF_FOREACH(netif) {
+            if (!netif_is_up(netif) || !(netif->flags & NETIF_FLAG_ETHARP)) {
+                continue;
+            }
+            uint32_t own = ip4_addr_get_u32(netif_ip4_addr(netif));
+            uint32_t mask = ip4_addr_get_u32(netif_ip4_netmask(netif));
+            if (target == own) {
+                // ARP never resolves our own address, but our own ports are worth scanning
+                mark_alive(discovery, discovery->start_ip + host, netif->hwaddr);
+                break;
+            }
+            if ((target & mask) == (own & mask)) {
+                // The only peers of the soft-AP are its stations, so a complete station list settles its subnet
+                if (netif != batch->ap_netif || !batch->ap_settled) {
+                    ip4_addr_t request;
+                    ip4_addr_set_u32(&request, target);
+                    etharp_request(netif, &request);
+                    batch->requests++;
+                }
+                set_bit(discovery->checked, host);
+                break;
+            }
+        }
+    }
+    xSemaphoreGive(batch->done);
+}
+
+// Adds the stations associated to our soft-AP that the DHCP server knows the address of. Returns
+// true if every station was accounted for.
+static bool discover_ap_stations(scan_discovery_t *discovery) {
+    wifi_sta_list_t stations;
+    if (esp_wifi_ap_get_sta_list(&stations) != ESP_OK) {
+        return false;
+    }
+    esp_netif_sta_list_t addresses;
+    if (esp_netif_get_sta_list(&stations, &addresses) != ESP_OK) {
+        return false;
+    }
+    bool settled = true;
+    for (int i = 0; i < addresses.num; i++) {
+        uint32_t ip = ntohl(addresses.sta[i].ip.addr);
+        if (ip == 0) {
+            // Statically addressed station, left to the ARP sweep
+            settled = false;
+            continue;
+        }
+        mark_alive(discovery, ip, addresses.sta[i].mac);
+    }
+    return settled;
+}
+
+// Sends ARP requests for every on-link address of the range, a table's worth at a time so replies
+// are read back before lwIP recycles their entries
+static void discover_arp(scan_discovery_t *discovery, bool ap_settled, int timeout_ms) {
+    arp_batch_t batch = {
+        .discovery = discovery,
+        .ap_settled = ap_settled,
+        .done = xSemaphoreCreateBinary(),
+    };
+    if (!batch.done) {
+        return;
+    }
+    esp_netif_t *ap = esp_netif_get_handle_from_ifkey("WIFI_AP_DEF");
+    batch.ap_netif = ap ? esp_netif_get_netif_impl(ap) : NULL;
+
+    for (uint32_t first = 0; first < discovery->host_count; first += ARP_TABLE_SIZE) {
+        batch.first = first;
+        batch.count = discovery->host_count - first < ARP_TABLE_SIZE ? discovery->host_count - first : ARP_TABLE_SIZE;
+        batch.read_back = false;
+        if (tcpip_callback(arp_batch_in_tcpip, &batch) != ERR_OK) {
+            break;
+        }
+        xSemaphoreTake(batch.done, portMAX_DELAY);
+
+        // Nothing to wait for when the whole batch was settled or off-link
+        if (batch.requests > 0) {
+            vTaskDelay(pdMS_TO_TICKS(timeout_ms));
+        }
+
+        batch.read_back = true;
+        if (tcpip_callback(arp_batch_in_tcpip, &batch) != ERR_OK) {
+            break;
+        }
+        xSemaphoreTake(batch.done, portMAX_DELAY);
+    }
+    vSemaphoreDelete(batch.done);
+}
+#endif
+
+static uint16_t icmp_checksum(const uint8_t *data, size_t len) {
+    uint32_t sum = 0;
+    for (size_t i = 0; i + 1 < len; i += 2) {
+        sum += (uint32_t)data[i] << 8 | data[i + 1];
+    }
+    if (len & 1) {
+        sum += (uint32_t)data[len - 1] << 8;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return (uint16_t)~sum;
+}
+
+// Collects whatever echo replies are queued on the ping socket
+static void read_echo_replies(int sock, scan_discovery_t *discovery) {
+    uint8_t reply[64];
+    struct sockaddr_in from;
+    socklen_t from_len = sizeof(from);
+    int len;
+    while ((len = recvfrom(sock, reply, sizeof(reply), 0, (struct sockaddr *)&from, &from_len)) > 0) {
+        // Raw sockets deliver the IP header, datagram ICMP sockets do not
+        int offset = (reply[0] >> 4) == 4 ? (reply[0] & 0x0f) * 4 : 0;
+        if (len > offset && reply[offset] == 0) {
+            mark_alive(discovery, ntohl(from.sin_addr.s_addr), NULL);
+        }
+        from_len = sizeof(from);
+    }
+}
+
+// Pings every address not settled by ARP, e.g. hosts beyond a router or on loopback. Returns false
+// if no ICMP socket is available.
+static bool discover_ping(scan_discovery_t *discovery, int timeout_ms) {
+    int sock = socket(AF_INET, SOCK_RAW, IPPROTO_ICMP);
+#ifndef ESP_PLATFORM
+    if (sock < 0) {
+        // Unprivileged ping sockets
+        sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_ICMP);
+    }
+#endif
+    if (sock < 0) {
+        return false;
+    }
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+
+    uint16_t id = (uint16_t)now_us();
+    int expected = discovery->alive;
+    for (uint32_t host = 0; host < discovery->host_count; host++) {
+        if (bit_is_set(discovery->checked, host)) {
+            continue;
+        }
+        uint8_t echo[16] = {8, 0, 0, 0, id >> 8, id & 0xff, host >> 8, host & 0xff};
+        uint16_t checksum = icmp_checksum(echo, sizeof(echo));
+        echo[2] = checksum >> 8;
+        echo[3] = checksum & 0xff;
+
+        struct sockaddr_in dest_addr;
+        memset(&dest_addr, 0, sizeof(dest_addr));
+        dest_addr.sin_family = AF_INET;
+        dest_addr.sin_addr.s_addr = htonl(discovery->start_ip + host);
+        if (sendto(sock, echo, sizeof(echo), 0, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) > 0) {
+            expected++;
+        }
+        read_echo_replies(sock, discovery);
+    }
+
+    // Stop early once every pinged host has answered
+    int64_t deadline = now_us() + (int64_t)timeout_ms * 1000;
+    for (int64_t wait_us; discovery->alive < expected && (wait_us = deadline - now_us()) > 0; ) {
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(sock, &read_fds);
+        struct timeval timeout = {
+            .tv_sec = wait_us / 1000000,
+            .tv_usec = wait_us % 1000000,
+        };
+        if (select(sock + 1, &read_fds, NULL, NULL, &timeout) <= 0) {
+            break;
+        }
+        read_echo_replies(sock, discovery);
+    }
+    close(sock);
+    return true;
+}
+
+// Finds the live hosts among the `candidates` of the range (NULL = all): soft-AP stations, ARP
+// replies for on-link addresses and ping replies for the rest. Returns false if memory ran out.
+static bool discover_hosts(scan_discovery_t *discovery, uint32_t start_ip, uint32_t host_count,
+                           const uint8_t *candidates, int timeout_ms) {
+    size_t bitmap_size = (host_count + 7) / 8;
+    memset(discovery, 0, sizeof(*discovery));
+    discovery->start_ip = start_ip;
+    discovery->host_count = host_count;
+    discovery->live = calloc(bitmap_size, 1);
+    discovery->checked = calloc(bitmap_size, 1);
+    if (!discovery->live || !discovery->checked) {
+        free(discovery->live);
+        free(discovery->checked);
+        return false;
+    }
+    if (candidates) {
+        // Addresses that are not candidates count as settled, so they are neither ARPed nor pinged
+        for (size_t i = 0; i < bitmap_size; i++) {
+            discovery->checked[i] = ~candidates[i];
+        }
+    }
+
+#ifdef ESP_PLATFORM
+    bool ap_settled = discover_ap_stations(discovery);
+    discover_arp(discovery, ap_settled, timeout_ms);
+#endif
+    if (!discover_ping(discovery, timeout_ms)) {
+        // Without ICMP silence proves nothing, so unsettled addresses still get their ports probed
+        for (uint32_t host = 0; host < host_count; host++) {
+            if (!bit_is_set(discovery->checked, host) && !bit_is_set(discovery->live, host)) {
+                set_bit(discovery->live, host);
+                discovery->alive++;
+            }
+        }
+    }
+    if (candidates) {
+        // Station lists and the ARP table may name hosts that were not asked for
+        discovery->alive = 0;
+        for (uint32_t host = 0; host < host_count; host++) {
+            if (bit_is_set(discovery->live, host) && !bit_is_set(candidates, host)) {
+                discovery->live[host >> 3] &= ~(1u << (host & 7));
+            }
+            discovery->alive += bit_is_set(discovery->live, host);
+        }
+    }
+    return true;
+}
+
+// Starts a non-blocking connect. Returns the socket with the connect in progress or done (*done
+// set), or -1 if the probe failed at once, e.g. refused on loopback.
+static int start_probe(uint32_t ip, uint16_t port, bool *done) {
+    struct sockaddr_in dest_addr;
+    memset(&dest_addr, 0, sizeof(dest_addr));
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_port = htons(port);
+    dest_addr.sin_addr.s_addr = htonl(ip);
+
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (sock < 0) {
+        return -1;
+    }
+    int flags = fcntl(sock, F_GETFL, 0);
+    fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+
+    *done = false;
+    if (connect(sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) == 0) {
+        *done = true;
+    } else if (errno != EINPROGRESS) {
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+// Arena chunk holding compact hosts and interned strings; allocations never move
+struct scan_arena_chunk {
+    struct scan_arena_chunk *next;
+    size_t size;
+    size_t used;
+    max_align_t data[];
+};
+
+// Interned string, kept in the arena with the ones before it
+struct scan_string {
+    struct scan_string *next;
+    char text[];
+};
+
+static size_t arena_align(size_t size) {
+    return (size + sizeof(max_align_t) - 1) & ~(sizeof(max_align_t) - 1);
+}
+
+// Takes `size` bytes from the newest chunk, starting a new chunk when it is full
+static void *arena_alloc(network_scan_compact_t *result, size_t size) {
+    size = arena_align(size);
+    scan_arena_chunk_t *chunk = result->chunks;
+    if (chunk->size - chunk->used < size) {
+        size_t chunk_size = size > SCAN_ARENA_CHUNK_SIZE ? size : SCAN_ARENA_CHUNK_SIZE;
+        chunk = malloc(sizeof(scan_arena_chunk_t) + chunk_size);
+        if (!chunk) {
+            return NULL;
+        }
+        chunk->next = result->chunks;
+        chunk->size = chunk_size;
+        chunk->used = 0;
+        result->chunks = chunk;
+        result->arena_bytes += sizeof(scan_arena_chunk_t) + chunk_size;
+    }
+    void *memory = (uint8_t *)chunk->data + chunk->used;
+    chunk->used += size;
+    return memory;
+}
+
+// Allocates an empty compact result, itself the first allocation of its own arena
+static network_scan_compact_t *arena_create(void) {
+    size_t header_size = arena_align(sizeof(network_scan_compact_t));
+    scan_arena_chunk_t *chunk = malloc(sizeof(scan_arena_chunk_t) + SCAN_ARENA_CHUNK_SIZE);
+    if (!chunk) {
+        return NULL;
+    }
+    chunk->next = NULL;
+    chunk->size = SCAN_ARENA_CHUNK_SIZE;
+    chunk->used = header_size;
+
+    network_scan_compact_t *result = (network_scan_compact_t *)chunk->data;
+    memset(result, 0, sizeof(network_scan_compact_t));
+    result->chunks = chunk;
+    result->arena_bytes = sizeof(scan_arena_chunk_t) + SCAN_ARENA_CHUNK_SIZE;
+    return result;
+}
+
+const char *network_scan_intern(network_scan_compact_t *result, const char *string) {
+    if (!result || !string) {
+        return NULL;
+    }
+    for (struct scan_string *interned = result->strings; interned; interned = interned->next) {
+        if (strcmp(interned->text, string) == 0) {
+            return interned->text;
+        }
+    }
+    size_t len = strlen(string);
+    struct scan_string *interned = arena_alloc(result, sizeof(struct scan_string) + len + 1);
+    if (!interned) {
+        return NULL;
+    }
+    memcpy(interned->text, string, len + 1);
+    interned->next = result->strings;
+    result->strings = interned;
+    return interned->text;
+}
+
+void network_scan_compact_free(network_scan_compact_t *result) {
+    if (!result) return;
+
+    // The result lives in the oldest chunk, which is freed last
+    scan_arena_chunk_t *chunk = result->chunks;
+    while (chunk) {
+        scan_arena_chunk_t *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+}
+
+static char *copy_string(const char *string) {
+    if (!string) {
+        return NULL;
+    }
+    char *copy = malloc(strlen(string) + 1);
+    if (copy) {
+        strcpy(copy, string);
+    }
+    return copy;
+}
+
+static bool mac_is_known(const uint8_t *mac) {
+    static const uint8_t unknown[6] = {0};
+    return memcmp(mac, unknown, sizeof(unknown)) != 0;
+}
+
+// Formats a MAC address as a heap string (NULL if unknown or memory ran out)
+static char *format_mac(const uint8_t *mac) {
+    if (!mac_is_known(mac)) {
+        return NULL;
+    }
+    char *text = malloc(18);
+    if (text) {
+        snprintf(text, 18, "%02x:%02x:%02x:%02x:%02x:%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+    }
+    return text;
+}
+
+// Expands a compact host into the heap-allocated device form. Returns false if memory ran out.
+static bool host_to_device(const network_host_t *host, time_t seen, network_device_t *device) {
+    memset(device, 0, sizeof(network_device_t));
+
+    char ip_str[16];
+    int_to_ip(host->ipv4, ip_str);
+    device->ipv4 = copy_string(ip_str);
+    device->open_ports = malloc((host->port_count ? host->port_count : 1) * sizeof(int));
+    if (!device->ipv4 || !device->open_ports) {
+        free(device->ipv4);
+        free(device->open_ports);
+        return false;
+    }
+    for (int i = 0; i < host->port_count; i++) {
+        device->open_ports[i] = host->ports[i];
+    }
+    device->port_count = host->port_count;
+
+    device->mac_address = format_mac(host->mac);
+    device->hostname = copy_string(host->hostname);
+    device->vendor = copy_string(host->vendor);
+    device->device_type = copy_string(host->device_type);
+    device->online = true;
+    device->first_seen = seen;
+    device->last_seen = seen;
+    return true;
 }
 
-// Function to scan a single port on a host
-static bool scan_port(const char *host, uint16_t port, int timeout) {
-    send_func_t send_func = client(host, NULL, port, scan_recv_callback);
+// State shared by the probe loop and the code turning its hits into hosts
+typedef struct {
+    network_scan_options_t *options;
+    network_scan_result_t *result;      // Legacy result, or NULL for a compact or inventory scan
+    network_scan_compact_t *compact;    // Compact result, or NULL for a legacy or inventory scan
+    network_inventory_t *inventory;     // Inventory merged into, or NULL for a one-off scan
+    uint8_t *seen;                      // Hosts of the range merged into the inventory by this scan
+    network_host_t *last_host;          // Tail of the compact host list
+    network_host_t *scratch;            // Reused host record of a legacy scan
+    const scan_discovery_t *discovery;
+    uint32_t start_ip;
+    const int *ports;
+    int port_count;
+    scan_hit_t *hits;          // Open ports of hosts not handed out yet
+    int hit_count;
+    int hit_capacity;
+    int hosts_alive;
+    int64_t discovery_time_us;
+    int64_t probe_time_us;
+} scan_sink_t;
+
+static int compare_hits(const void *a, const void *b) {
+    uint32_t left = ((const scan_hit_t *)a)->probe;
+    uint32_t right = ((const scan_hit_t *)b)->probe;
+    return left < right ? -1 : left > right;
+}
+
+// Records an open port and reports it right away. Returns false if the hit list could not grow.
+static bool add_hit(scan_sink_t *sink, uint32_t probe) {
+    if (sink->hit_count == sink->hit_capacity) {
+        int capacity = sink->hit_capacity ? sink->hit_capacity * 2 : 16;
+        scan_hit_t *grown = realloc(sink->hits, capacity * sizeof(scan_hit_t));
+        if (!grown) {
+            return false;
+        }
+        sink->hits = grown;
+        sink->hit_capacity = capacity;
+    }
+    sink->hits[sink->hit_count++].probe = probe;
+
+    if (sink->options->port_callback) {
+        char ip_str[16];
+        int_to_ip(sink->start_ip + probe / sink->port_count, ip_str);
+        sink->options->port_callback(ip_str, sink->ports[probe % sink->port_count], sink->options->user_data);
+    }
+    return true;
+}
+
+// Frees everything a device points to, but not the device itself
+static void free_device_fields(network_device_t *device) {
+    free(device->ipv4);
+    free(device->ipv6);
+    free(device->open_ports);
+    free(device->hostname);
+    free(device->mac_address);
+    free(device->vendor);
+    free(device->device_type);
+    free(device->os_fingerprint);
     
-    if (send_func != NULL) {
-        // Connection successful - port is open
-        client_cleanup();
+    if (device->services) {
+        // Free service strings if they exist
+        for (int j = 0; device->services[j]; j++) {
+            free(device->services[j]);
+        }
+        free(device->services);
+    }
+}
+
+// Appends a device to the result array, which takes over its allocations
+static bool keep_device(network_scan_result_t *result, network_device_t *device) {
+    // Expand results array if needed
+    if (result->device_count >= result->max_devices) {
+        network_device_t *devices = realloc(result->devices,
+            (result->max_devices * 2) * sizeof(network_device_t));
+        if (!devices) {
+            return false;
+        }
+        result->devices = devices;
+        result->max_devices *= 2;
+    }
+
+    memcpy(&result->devices[result->device_count], device, sizeof(network_device_t));
+    result->device_count++;
+    return true;
+}
+
+// Finds the device with address `ip`, or the index it would be inserted at to keep the order
+static int inventory_find(const network_inventory_t *inventory, uint32_t ip, bool *found) {
+    int low = 0;
+    int high = inventory->device_count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        uint32_t mid_ip = ip_to_int(inventory->devices[mid].ipv4);
+        if (mid_ip == ip) {
+            *found = true;
+            return mid;
+        }
+        if (mid_ip < ip) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    *found = false;
+    return low;
+}
+
+// Updates the device of a host that answered, adding it if it is new. Returns the device, or NULL
+// if memory ran out.
+static network_device_t *inventory_merge(network_inventory_t *inventory, const network_host_t *host, time_t now) {
+    bool found;
+    int index = inventory_find(inventory, host->ipv4, &found);
+    if (!found) {
+        if (inventory->device_count >= inventory->max_devices) {
+            int capacity = inventory->max_devices ? inventory->max_devices * 2 : 16;
+            network_device_t *devices = realloc(inventory->devices, capacity * sizeof(network_device_t));
+            if (!devices) {
+                return NULL;
+            }
+            inventory->devices = devices;
+            inventory->max_devices = capacity;
+        }
+        network_device_t device;
+        if (!host_to_device(host, now, &device)) {
+            return NULL;
+        }
+        memmove(&inventory->devices[index + 1], &inventory->devices[index],
+                (inventory->device_count - index) * sizeof(network_device_t));
+        inventory->devices[index] = device;
+        inventory->device_count++;
+        inventory->discovered++;
+        return &inventory->devices[index];
+    }
+
+    network_device_t *device = &inventory->devices[index];
+    int *ports = realloc(device->open_ports, (host->port_count ? host->port_count : 1) * sizeof(int));
+    if (!ports) {
+        return NULL;
+    }
+    for (int i = 0; i < host->port_count; i++) {
+        ports[i] = host->ports[i];
+    }
+    device->open_ports = ports;
+    device->port_count = host->port_count;
+    if (!device->mac_address) {
+        device->mac_address = format_mac(host->mac);
+    }
+    if (!device->online) {
+        inventory->returned++;
+    }
+    device->online = true;
+    device->last_seen = now;
+    return device;
+}
+
+// Turns the hits of every host below `end_host` into hosts and hands them out in address order.
+// Returns false if memory ran out, rather than leave a host out of the result.
+static bool flush_hosts(scan_sink_t *sink, uint32_t end_host) {
+    if (sink->hit_count == 0) {
         return true;
     }
-    
+    qsort(sink->hits, sink->hit_count, sizeof(scan_hit_t), compare_hits);
+
+    int port_count = sink->port_count;
+    int h = 0;
+    while (h < sink->hit_count && sink->hits[h].probe / port_count < end_host) {
+        uint32_t host_index = sink->hits[h].probe / port_count;
+        int first = h;
+        for (; h < sink->hit_count && sink->hits[h].probe / port_count == host_index; h++);
+
+        network_host_t *host = sink->compact
+            ? arena_alloc(sink->compact, sizeof(network_host_t) + (h - first) * sizeof(uint16_t))
+            : sink->scratch;
+        if (!host) {
+            return false;
+        }
+        memset(host, 0, sizeof(network_host_t));
+        host->ipv4 = sink->start_ip + host_index;
+        for (int m = 0; m < sink->discovery->mac_count; m++) {
+            if (sink->discovery->macs[m].ip == host->ipv4) {
+                memcpy(host->mac, sink->discovery->macs[m].mac, sizeof(host->mac));
+                break;
+            }
+        }
+
+        char ip_str[16];
+        int_to_ip(host->ipv4, ip_str);
+        for (int i = first; i < h; i++) {
+            // Insertion keeps the span sorted; a host has at most a handful of open ports
+            uint16_t port = sink->ports[sink->hits[i].probe % port_count];
+            int j = host->port_count++;
+            for (; j > 0 && host->ports[j - 1] > port; j--) {
+                host->ports[j] = host->ports[j - 1];
+            }
+            host->ports[j] = port;
+            printf("  %s port %d: OPEN\n", ip_str, port);
+        }
+
+        if (sink->options->host_callback) {
+            sink->options->host_callback(host, sink->options->user_data);
+        }
+        if (sink->inventory) {
+            // A host left out here would be marked offline by a pass that looked complete
+            network_device_t *device = inventory_merge(sink->inventory, host, time(NULL));
+            if (!device) {
+                return false;
+            }
+            set_bit(sink->seen, host_index);
+            if (sink->options->device_callback) {
+                sink->options->device_callback(device, sink->options->user_data);
+            }
+            continue;
+        }
+        if (sink->compact) {
+            if (sink->last_host) {
+                sink->last_host->next = host;
+            } else {
+                sink->compact->hosts = host;
+            }
+            sink->last_host = host;
+            sink->compact->host_count++;
+            continue;
+        }
+
+        network_scan_result_t *result = sink->result;
+        result->devices_found++;
+        if (!sink->options->device_callback && sink->options->discard_devices) {
+            continue;
+        }
+        network_device_t device;
+        if (!host_to_device(host, time(NULL), &device)) {
+            return false;
+        }
+        if (sink->options->device_callback) {
+            sink->options->device_callback(&device, sink->options->user_data);
+        }
+        if (sink->options->discard_devices) {
+            free_device_fields(&device);
+        } else if (!keep_device(result, &device)) {
+            free_device_fields(&device);
+            return false;
+        }
+    }
+
+    memmove(sink->hits, sink->hits + h, (sink->hit_count - h) * sizeof(scan_hit_t));
+    sink->hit_count -= h;
+    return true;
+}
+
+// Probes every host x port pair of the hosts set in `live` (NULL = all) with up to `concurrency`
+// non-blocking connects in flight, multiplexed with select(). A probe that times out is retried up
+// to `retries` times; a refused one is final. Open ports are reported as they are found, and each
+// host is handed out as soon as its last probe finished. Returns false if memory ran out or select()
+// failed.
+static bool run_probes(scan_sink_t *sink, uint32_t host_count, const uint8_t *live, int concurrency,
+                       int timeout_ms, int retries) {
+    scan_slot_t slots[MAX_SCAN_CONCURRENCY];
+    for (int i = 0; i < concurrency; i++) {
+        slots[i].sock = -1;
+    }
+
+    uint32_t start_ip = sink->start_ip;
+    const int *ports = sink->ports;
+    int port_count = sink->port_count;
+    uint32_t probe_count = host_count * (uint32_t)port_count;
+    uint32_t next_probe = 0;
+    int in_flight = 0;
+
+    while (next_probe < probe_count || in_flight > 0) {
+        // Fill free slots with new probes, or with retries of the ones that just timed out
+        for (int i = 0; i < concurrency && next_probe < probe_count; i++) {
+            if (slots[i].sock >= 0) {
+                continue;
+            }
+            while (live && next_probe < probe_count && !bit_is_set(live, next_probe / port_count)) {
+                next_probe = (next_probe / port_count + 1) * port_count;
+            }
+            if (next_probe >= probe_count) {
+                break;
+            }
+            uint32_t probe = next_probe++;
+            bool done;
+            int sock = start_probe(start_ip + probe / port_count, ports[probe % port_count], &done);
+            if (sock < 0) {
+                continue;
+            }
+            if (done) {
+                close(sock);
+                if (!add_hit(sink, probe)) {
+                    goto fail;
+                }
+                continue;
+            }
+            slots[i].sock = sock;
+            slots[i].probe = probe;
+            slots[i].attempt = 0;
+            slots[i].deadline_us = now_us() + (int64_t)timeout_ms * 1000;
+            in_flight++;
+        }
+        if (in_flight == 0) {
+            continue;
+        }
+
+        fd_set write_fds;
+        FD_ZERO(&write_fds);
+        int max_fd = -1;
+        int64_t earliest = INT64_MAX;
+        for (int i = 0; i < concurrency; i++) {
+            if (slots[i].sock >= 0) {
+                FD_SET(slots[i].sock, &write_fds);
+                max_fd = slots[i].sock > max_fd ? slots[i].sock : max_fd;
+                earliest = slots[i].deadline_us < earliest ? slots[i].deadline_us : earliest;
+            }
+        }
+        int64_t wait_us = earliest - now_us();
+        if (wait_us < 0) {
+            wait_us = 0;
+        }
+        struct timeval timeout = {
+            .tv_sec = wait_us / 1000000,
+            .tv_usec = wait_us % 1000000,
+        };
+        int ready = select(max_fd + 1, NULL, &write_fds, NULL, &timeout);
+        if (ready < 0 && errno != EINTR) {
+            printf("select() failed during scan: errno %d\n", errno);
+            goto fail;
+        }
+
+        int64_t now = now_us();
+        for (int i = 0; i < concurrency; i++) {
+            scan_slot_t *slot = &slots[i];
+            if (slot->sock < 0) {
+                continue;
+            }
+            if (ready > 0 && FD_ISSET(slot->sock, &write_fds)) {
+                // Writability only says the handshake finished; SO_ERROR says whether it succeeded
+                int error = 0;
+                socklen_t error_len = sizeof(error);
+                getsockopt(slot->sock, SOL_SOCKET, SO_ERROR, &error, &error_len);
+                close(slot->sock);
+                slot->sock = -1;
+                in_flight--;
+                if (error == 0 && !add_hit(sink, slot->probe)) {
+                    goto fail;
+                }
+            } else if (now >= slot->deadline_us) {
+                close(slot->sock);
+                slot->sock = -1;
+                if (slot->attempt + 1 < retries) {
+                    // Only silence is retried; the slot starts the next attempt right away
+                    bool done;
+                    uint32_t probe = slot->probe;
+                    int sock = start_probe(start_ip + probe / port_count, ports[probe % port_count], &done);
+                    if (sock >= 0 && done) {
+                        close(sock);
+                        in_flight--;
+                        if (!add_hit(sink, probe)) {
+                            goto fail;
+                        }
+                    } else if (sock >= 0) {
+                        slot->sock = sock;
+                        slot->attempt++;
+                        slot->deadline_us = now + (int64_t)timeout_ms * 1000;
+                    } else {
+                        in_flight--;
+                    }
+                } else {
+                    in_flight--;
+                }
+            }
+        }
+
+        // Hosts below the lowest one with a probe still to start or in flight are complete
+        uint32_t end_host = next_probe / port_count;
+        for (int i = 0; i < concurrency; i++) {
+            if (slots[i].sock >= 0 && slots[i].probe / port_count < end_host) {
+                end_host = slots[i].probe / port_count;
+            }
+        }
+        if (!flush_hosts(sink, end_host)) {
+            goto fail;
+        }
+    }
+
+    if (!flush_hosts(sink, host_count)) {
+        goto fail;
+    }
+    return true;
+
+fail:
+    for (int i = 0; i < concurrency; i++) {
+        if (slots[i].sock >= 0) {
+            close(slots[i].sock);
+        }
+    }
     return false;
 }
 
-// Function to create a new network device entry
-static network_device_t *create_network_device(const char *ip) {
-    network_device_t *device = malloc(sizeof(network_device_t));
-    if (!device) return NULL;
-    
-    // Initialize device structure
-    memset(device, 0, sizeof(network_device_t));
+// Range, ports and window of a scan, resolved from its options
+typedef struct {
+    uint32_t start_ip;
+    uint32_t host_count;
+    const int *ports;
+    int port_count;
+    int concurrency;
+} scan_plan_t;
+
+// Default ports to scan if none specified
+static const int default_ports[] = {22, 23, 25, 53, 80, 110, 143, 443, 993, 995, 0};
+
+// Applies the defaults of `options`. Returns false for an invalid range.
+static bool plan_scan(network_scan_options_t *options, scan_plan_t *plan) {
+    // Convert IP range to integers for iteration
+    uint32_t start_ip = ip_to_int(options->start_ip);
+    uint32_t end_ip = ip_to_int(options->end_ip);
     
-    // Set IP address
-    device->ipv4 = malloc(strlen(ip) + 1);
-    if (device->ipv4) {
-        strcpy(device->ipv4, ip);
+    if (start_ip == 0 || end_ip == 0 || start_ip > end_ip) {
+        return false;
     }
+    plan->start_ip = start_ip;
+    plan->host_count = end_ip - start_ip + 1;
     
-    device->online = false;
-    device->port_count = 0;
-    device->open_ports = NULL;
-    device->hostname = NULL;
-    device->mac_address = NULL;
-    device->vendor = NULL;
-    device->device_type = NULL;
-    device->os_fingerprint = NULL;
-    device->services = NULL;
-    device->signal_strength = 0;
-    device->first_seen = time(NULL);
-    device->last_seen = time(NULL);
+    plan->ports = options->ports ? options->ports : default_ports;
+    plan->port_count = 0;
+    while (plan->ports[plan->port_count] != 0) {
+        plan->port_count++;
+    }
     
-    return device;
+    plan->concurrency = options->concurrency > 0 ? options->concurrency : DEFAULT_SCAN_CONCURRENCY;
+    if (plan->concurrency > MAX_SCAN_CONCURRENCY) {
+        plan->concurrency = MAX_SCAN_CONCURRENCY;
+    }
+    return true;
 }
 
-// Function to add an open port to a device
-static void add_open_port(network_device_t *device, uint16_t port) {
-    device->port_count++;
-    device->open_ports = realloc(device->open_ports, device->port_count * sizeof(int));
-    if (device->open_ports) {
-        device->open_ports[device->port_count - 1] = port;
+// Runs discovery (unless `discover` is false) and the port probes over the hosts of the plan set in
+// `candidates` (NULL = all), handing hosts to the sink. Returns false when memory ran out or the
+// probes failed.
+static bool run_pass(network_scan_options_t *options, scan_sink_t *sink, const scan_plan_t *plan,
+                     const uint8_t *candidates, bool discover) {
+    int timeout_ms = options->timeout > 0 ? options->timeout : DEFAULT_SCAN_TIMEOUT_MS;
+    int retries = options->retry_count > 0 ? options->retry_count : 1;
+
+    // Dead addresses would each cost the full timeout for every port and retry, so find the live ones first
+    scan_discovery_t discovery = {0};
+    const uint8_t *live = candidates;
+    sink->hosts_alive = -1;
+    int64_t discovery_start = now_us();
+    if (discover) {
+        int discovery_timeout_ms = options->discovery_timeout > 0 ? options->discovery_timeout : DEFAULT_DISCOVERY_TIMEOUT_MS;
+        if (!discover_hosts(&discovery, plan->start_ip, plan->host_count, candidates, discovery_timeout_ms)) {
+            return false;
+        }
+        live = discovery.live;
+        sink->hosts_alive = discovery.alive;
+        printf("Discovery found %d live host(s)\n", discovery.alive);
+    }
+    int64_t probe_start = now_us();
+    sink->discovery_time_us = probe_start - discovery_start;
+
+    sink->discovery = &discovery;
+    sink->start_ip = plan->start_ip;
+    sink->ports = plan->ports;
+    sink->port_count = plan->port_count;
+    if (!sink->compact) {
+        sink->scratch = malloc(sizeof(network_host_t) + plan->port_count * sizeof(uint16_t));
     }
+    bool completed = (sink->compact || sink->scratch)
+        && run_probes(sink, plan->host_count, live, plan->concurrency, timeout_ms, retries);
+    sink->probe_time_us = now_us() - probe_start;
+    free(sink->scratch);
+    free(sink->hits);
+    sink->scratch = NULL;
+    sink->hits = NULL;
+    sink->hit_count = 0;
+    sink->hit_capacity = 0;
+    sink->discovery = NULL;
+    free(discovery.live);
+    free(discovery.checked);
+    free(discovery.macs);
+    return completed;
+}
+
+// Scans the whole range of `options`, handing hosts to the sink. Returns false on invalid options,
+// when memory ran out or when the probes failed.
+static bool scan_range(network_scan_options_t *options, scan_sink_t *sink) {
+    scan_plan_t plan;
+    if (!plan_scan(options, &plan)) {
+        return false;
+    }
+
+    printf("Starting network scan from %s to %s, %d probes in flight\n", options->start_ip, options->end_ip, plan.concurrency);
+
+    return run_pass(options, sink, &plan, NULL, !options->skip_discovery);
 }
 
 network_scan_result_t *network_scan(network_scan_options_t *options) {
@@ -97,109 +1082,281 @@ network_scan_result_t *network_scan(network_scan_options_t *options) {
     network_scan_result_t *result = malloc(sizeof(network_scan_result_t));
     if (!result) return NULL;
     
-    result->device_count = 0;
-    result->max_devices = 256; // Initial capacity
-    result->devices = malloc(result->max_devices * sizeof(network_device_t));
-    if (!result->devices) {
-        free(result);
+    memset(result, 0, sizeof(network_scan_result_t));
+    if (!options->discard_devices) {
+        result->max_devices = 256; // Initial capacity
+        result->devices = malloc(result->max_devices * sizeof(network_device_t));
+        if (!result->devices) {
+            free(result);
+            return NULL;
+        }
+    }
+
+    scan_sink_t sink = {
+        .options = options,
+        .result = result,
+    };
+    if (!scan_range(options, &sink)) {
+        free_scan_result(result);
         return NULL;
     }
+    result->hosts_alive = sink.hosts_alive;
+    result->discovery_time_us = sink.discovery_time_us;
+    result->probe_time_us = sink.probe_time_us;
     
-    // Convert IP range to integers for iteration
-    uint32_t start_ip = ip_to_int(options->start_ip);
-    uint32_t end_ip = ip_to_int(options->end_ip);
+    printf("Network scan completed. Found %d responsive devices.\n", result->devices_found);
     
-    if (start_ip == 0 || end_ip == 0 || start_ip > end_ip) {
-        free(result->devices);
+    return result;
+}
+
+network_scan_compact_t *network_scan_compact(network_scan_options_t *options) {
+    if (!options || !options->start_ip || !options->end_ip) {
+        return NULL;
+    }
+
+    network_scan_compact_t *result = arena_create();
+    if (!result) return NULL;
+
+    scan_sink_t sink = {
+        .options = options,
+        .compact = result,
+    };
+    if (!scan_range(options, &sink)) {
+        network_scan_compact_free(result);
+        return NULL;
+    }
+    result->hosts_alive = sink.hosts_alive;
+    result->discovery_time_us = sink.discovery_time_us;
+    result->probe_time_us = sink.probe_time_us;
+    result->scanned_at = time(NULL);
+
+    printf("Network scan completed. Found %d responsive devices.\n", result->host_count);
+
+    return result;
+}
+
+network_scan_result_t *network_scan_expand(const network_scan_compact_t *compact) {
+    if (!compact) {
+        return NULL;
+    }
+
+    network_scan_result_t *result = malloc(sizeof(network_scan_result_t));
+    if (!result) return NULL;
+
+    memset(result, 0, sizeof(network_scan_result_t));
+    result->max_devices = compact->host_count > 0 ? compact->host_count : 1;
+    result->devices = malloc(result->max_devices * sizeof(network_device_t));
+    if (!result->devices) {
         free(result);
         return NULL;
     }
-    
-    // Default ports to scan if none specified
-    int default_ports[] = {22, 23, 25, 53, 80, 110, 143, 443, 993, 995};
-    int *ports_to_scan = options->ports ? options->ports : default_ports;
-    int port_count = options->ports ? 0 : 10; // Count ports if using default
-    
-    // Count ports if custom list provided
-    if (options->ports) {
-        while (options->ports[port_count] != 0) {
-            port_count++;
+
+    for (const network_host_t *host = compact->hosts; host; host = host->next) {
+        if (!host_to_device(host, compact->scanned_at, &result->devices[result->device_count])) {
+            free_scan_result(result);
+            return NULL;
         }
+        result->device_count++;
     }
-    
-    printf("Starting network scan from %s to %s\n", options->start_ip, options->end_ip);
-    
-    // Scan each IP in the range
-    for (uint32_t current_ip = start_ip; current_ip <= end_ip; current_ip++) {
-        char ip_str[16];
-        int_to_ip(current_ip, ip_str);
-        
-        printf("Scanning %s...\n", ip_str);
-        
-        network_device_t *device = NULL;
-        bool host_responsive = false;
-        
-        // Scan each port for this IP
-        for (int p = 0; p < port_count; p++) {
-            uint16_t port = ports_to_scan[p];
-            
-            // Try to connect with retry logic
-            bool port_open = false;
-            int retries = options->retry_count > 0 ? options->retry_count : 1;
-            
-            for (int retry = 0; retry < retries && !port_open; retry++) {
-                if (scan_port(ip_str, port, options->timeout)) {
-                    port_open = true;
-                    host_responsive = true;
-                    
-                    // Create device entry if this is the first open port found
-                    if (!device) {
-                        device = create_network_device(ip_str);
-                        if (!device) continue;
-                        device->online = true;
-                    }
-                    
-                    // Add the open port
-                    add_open_port(device, port);
-                    printf("  Port %d: OPEN\n", port);
-                }
-                
-                if (retry < retries - 1) {
-#ifdef ESP_PLATFORM
-                    vTaskDelay(pdMS_TO_TICKS(100)); // 100ms delay between retries
-#else
-                    usleep(100000); // 100ms delay between retries
-#endif
-                }
+    result->devices_found = result->device_count;
+    result->hosts_alive = compact->hosts_alive;
+    result->discovery_time_us = compact->discovery_time_us;
+    result->probe_time_us = compact->probe_time_us;
+    return result;
+}
+
+network_inventory_t *network_inventory_create(void) {
+    network_inventory_t *inventory = malloc(sizeof(network_inventory_t));
+    if (inventory) {
+        memset(inventory, 0, sizeof(network_inventory_t));
+    }
+    return inventory;
+}
+
+static void inventory_reset_stats(network_inventory_t *inventory) {
+    inventory->rechecked = 0;
+    inventory->swept = 0;
+    inventory->discovered = 0;
+    inventory->returned = 0;
+    inventory->went_offline = 0;
+    inventory->recheck_time_us = 0;
+    inventory->sweep_time_us = 0;
+}
+
+// Marks the online devices of the plan's range that are set in `hosts` (NULL = all) but were not
+// seen by this scan as offline
+static void inventory_mark_offline(scan_sink_t *sink, const scan_plan_t *plan, const uint8_t *hosts) {
+    network_inventory_t *inventory = sink->inventory;
+    for (int i = 0; i < inventory->device_count; i++) {
+        network_device_t *device = &inventory->devices[i];
+        uint32_t host = ip_to_int(device->ipv4) - plan->start_ip;
+        if (!device->online || host >= plan->host_count || (hosts && !bit_is_set(hosts, host))
+            || bit_is_set(sink->seen, host)) {
+            continue;
+        }
+        device->online = false;
+        inventory->went_offline++;
+        if (sink->options->device_callback) {
+            sink->options->device_callback(device, sink->options->user_data);
+        }
+    }
+}
+
+int network_inventory_scan(network_inventory_t *inventory, network_scan_options_t *options) {
+    scan_plan_t plan;
+    if (!inventory || !options || !options->start_ip || !options->end_ip || !plan_scan(options, &plan)) {
+        return -1;
+    }
+    inventory_reset_stats(inventory);
+
+    scan_sink_t sink = {
+        .options = options,
+        .inventory = inventory,
+        .seen = calloc((plan.host_count + 7) / 8, 1),
+    };
+    if (!sink.seen) {
+        return -1;
+    }
+
+    int64_t start = now_us();
+    bool completed = run_pass(options, &sink, &plan, NULL, !options->skip_discovery);
+    if (completed) {
+        inventory_mark_offline(&sink, &plan, NULL);
+    }
+    inventory->swept = plan.host_count;
+    inventory->sweep_time_us = now_us() - start;
+    inventory->sweep_next = 0;
+    free(sink.seen);
+    return completed ? 0 : -1;
+}
+
+int network_inventory_rescan(network_inventory_t *inventory, network_scan_options_t *options) {
+    scan_plan_t plan;
+    if (!inventory || !options || !options->start_ip || !options->end_ip || !plan_scan(options, &plan)) {
+        return -1;
+    }
+    inventory_reset_stats(inventory);
+
+    size_t bitmap_size = (plan.host_count + 7) / 8;
+    uint8_t *known = calloc(bitmap_size, 1);
+    int *known_ports = NULL;
+    scan_sink_t sink = {
+        .options = options,
+        .inventory = inventory,
+        .seen = calloc(bitmap_size, 1),
+    };
+    bool completed = known && sink.seen;
+
+    // The ports that were open on any known host of the range, deduplicated
+    int known_port_count = 0;
+    int port_capacity = 0;
+    for (int i = 0; completed && i < inventory->device_count; i++) {
+        network_device_t *device = &inventory->devices[i];
+        uint32_t host = ip_to_int(device->ipv4) - plan.start_ip;
+        if (!device->online || host >= plan.host_count) {
+            continue;
+        }
+        set_bit(known, host);
+        inventory->rechecked++;
+        port_capacity += device->port_count;
+        int *grown = realloc(known_ports, (port_capacity + 1) * sizeof(int));
+        if (!grown) {
+            completed = false;
+            break;
+        }
+        known_ports = grown;
+        for (int p = 0; p < device->port_count; p++) {
+            int j = 0;
+            while (j < known_port_count && known_ports[j] != device->open_ports[p]) {
+                j++;
+            }
+            if (j == known_port_count) {
+                known_ports[known_port_count++] = device->open_ports[p];
             }
         }
-        
-        // Add device to results if any ports were found open
-        if (device && host_responsive) {
-            // Expand results array if needed
-            if (result->device_count >= result->max_devices) {
-                result->max_devices *= 2;
-                result->devices = realloc(result->devices, 
-                    result->max_devices * sizeof(network_device_t));
-                if (!result->devices) {
-                    // Handle realloc failure
-                    free(device->ipv4);
-                    free(device->open_ports);
-                    free(device);
-                    break;
-                }
+    }
+
+    int64_t recheck_start = now_us();
+    if (completed && inventory->rechecked > 0 && known_port_count > 0) {
+        // Known hosts on their known ports first, with no discovery as they are expected to be up
+        known_ports[known_port_count] = 0;
+        scan_plan_t recheck = plan;
+        recheck.ports = known_ports;
+        recheck.port_count = known_port_count;
+        completed = run_pass(options, &sink, &recheck, known, false);
+
+        // Hosts that stopped answering there may only have moved ports, so they get the full list
+        uint8_t *missing = calloc(bitmap_size, 1);
+        bool any_missing = false;
+        for (size_t i = 0; completed && missing && i < bitmap_size; i++) {
+            missing[i] = known[i] & ~sink.seen[i];
+            any_missing |= missing[i] != 0;
+        }
+        if (completed && !missing) {
+            completed = false;
+        } else if (completed && any_missing) {
+            completed = run_pass(options, &sink, &plan, missing, !options->skip_discovery);
+        }
+        free(missing);
+    }
+    if (completed) {
+        inventory_mark_offline(&sink, &plan, known);
+    }
+    inventory->recheck_time_us = now_us() - recheck_start;
+
+    // Then the next slice of the rest of the range, gently, so a periodic rescan stays cheap
+    uint32_t first = inventory->sweep_next < plan.host_count ? inventory->sweep_next : 0;
+    uint32_t slice = plan.host_count - first;
+    if (options->sweep_hosts > 0 && (uint32_t)options->sweep_hosts < slice) {
+        slice = options->sweep_hosts;
+    }
+    int64_t sweep_start = now_us();
+    if (completed && slice > 0) {
+        // The known hosts were settled above, so their bitmap is reused for the addresses left
+        uint8_t *candidates = known;
+        for (size_t i = 0; i < bitmap_size; i++) {
+            candidates[i] = ~known[i];
+        }
+        for (uint32_t host = 0; host < plan.host_count; host++) {
+            if (host < first || host >= first + slice) {
+                candidates[host >> 3] &= ~(1u << (host & 7));
             }
-            
-            // Copy device to results
-            memcpy(&result->devices[result->device_count], device, sizeof(network_device_t));
-            result->device_count++;
-            free(device); // Free the temporary device structure
         }
+
+        scan_plan_t sweep = plan;
+        sweep.concurrency = options->sweep_concurrency > 0 ? options->sweep_concurrency : DEFAULT_SWEEP_CONCURRENCY;
+        if (sweep.concurrency > MAX_SCAN_CONCURRENCY) {
+            sweep.concurrency = MAX_SCAN_CONCURRENCY;
+        }
+#ifdef ESP_PLATFORM
+        UBaseType_t priority = uxTaskPriorityGet(NULL);
+        if (options->sweep_priority > 0) {
+            vTaskPrioritySet(NULL, options->sweep_priority);
+        }
+#endif
+        completed = run_pass(options, &sink, &sweep, candidates, !options->skip_discovery);
+#ifdef ESP_PLATFORM
+        vTaskPrioritySet(NULL, priority);
+#endif
+        inventory->swept = slice;
+        inventory->sweep_next = first + slice < plan.host_count ? first + slice : 0;
     }
-    
-    printf("Network scan completed. Found %d responsive devices.\n", result->device_count);
-    
-    return result;
+    inventory->sweep_time_us = now_us() - sweep_start;
+
+    free(known);
+    free(known_ports);
+    free(sink.seen);
+    return completed ? 0 : -1;
+}
+
+void network_inventory_free(network_inventory_t *inventory) {
+    if (!inventory) return;
+
+    for (int i = 0; i < inventory->device_count; i++) {
+        free_device_fields(&inventory->devices[i]);
+    }
+    free(inventory->devices);
+    free(inventory);
 }
 
 // Function to free scan results
@@ -207,23 +1364,7 @@ void free_scan_result(network_scan_result_t *result) {
     if (!result) return;
     
     for (int i = 0; i < result->device_count; i++) {
-        network_device_t *device = &result->devices[i];
-        free(device->ipv4);
-        free(device->ipv6);
-        free(device->open_ports);
-        free(device->hostname);
-        free(device->mac_address);
-        free(device->vendor);
-        free(device->device_type);
-        free(device->os_fingerprint);
-        
-        if (device->services) {
-            // Free service strings if they exist
-            for (int j = 0; device->services[j]; j++) {
-                free(device->services[j]);
-            }
-            free(device->services);
-        }
+        free_device_fields(&result->devices[i]);
     }
     
     free(result->devices);
@@ -2,6 +2,8 @@
 #define NETWORK_SCANNER_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <time.h>
 
 typedef struct {
@@ -28,18 +30,120 @@ typedef struct {
     network_device_t *devices;
     int device_count;
     int max_devices;
+    int devices_found;         // Devices handed to the callback, including those not kept in `devices`
+    int hosts_alive;           // Hosts found by discovery, with or without open ports (-1 = discovery skipped)
+    int64_t discovery_time_us; // Time spent finding live hosts
+    int64_t probe_time_us;     // Time spent probing the ports of live hosts
 } network_scan_result_t;
 
+// One host of a compact scan result. Hosts, their ports and their strings share one arena, so a
+// host costs a single record instead of an allocation per field.
+typedef struct network_host {
+    struct network_host *next; // Next host in address order (NULL = last)
+    uint32_t ipv4;             // Address in host byte order
+    uint8_t mac[6];            // MAC address learnt during discovery (all zero = unknown)
+    uint16_t port_count;       // Number of entries in `ports`
+    const char *hostname;      // Interned with network_scan_intern() (NULL = unknown)
+    const char *vendor;        // Interned with network_scan_intern() (NULL = unknown)
+    const char *device_type;   // Interned with network_scan_intern() (NULL = unknown)
+    uint16_t ports[];          // Open ports, ascending
+} network_host_t;
+
+typedef struct scan_arena_chunk scan_arena_chunk_t;
+
+// Compact scan result, allocated in the first chunk of its own arena and freed in one call
 typedef struct {
-    int timeout;
+    network_host_t *hosts;     // Hosts with open ports in address order (NULL = none)
+    int host_count;
+    int hosts_alive;           // Hosts found by discovery, with or without open ports (-1 = discovery skipped)
+    int64_t discovery_time_us; // Time spent finding live hosts
+    int64_t probe_time_us;     // Time spent probing the ports of live hosts
+    time_t scanned_at;         // When the scan finished
+    size_t arena_bytes;        // Heap held by the result, chunk headers included
+    scan_arena_chunk_t *chunks; // Arena chunks, newest first
+    struct scan_string *strings; // Interned strings, newest first
+} network_scan_compact_t;
+
+// Called with each host as soon as the last of its ports is probed, in address order. Hosts of a
+// compact scan stay valid until the result is freed, those of network_scan() only during the call.
+typedef void (*network_scan_host_callback_t)(const network_host_t *host, void *user_data);
+
+// Called with each device as soon as the last of its ports is probed, in address order. The
+// device and everything it points to are only valid during the call.
+typedef void (*network_scan_device_callback_t)(const network_device_t *device, void *user_data);
+
+// Called for each open port as soon as its connect succeeds, before the host's other ports are done
+typedef void (*network_scan_port_callback_t)(const char *ipv4, int port, void *user_data);
+
+typedef struct {
+    int timeout; // Connect timeout per probe in milliseconds (0 = 1000)
     char *start_ip;
     char *end_ip;
     int *ports;
-    int retry_count;
+    int retry_count; // Attempts for a probe that times out; a refused connect is not retried (0 = 1)
+    int concurrency; // Connects kept in flight at once (0 = 8; capped at half of CONFIG_LWIP_MAX_SOCKETS)
+    bool skip_discovery; // Probe every address, not only hosts found by the soft-AP station list, ARP or ping
+    int discovery_timeout; // Wait for ARP and ping replies in milliseconds (0 = 200)
+    network_scan_device_callback_t device_callback; // Streams devices while the scan runs (NULL = unused)
+    network_scan_port_callback_t port_callback; // Streams open ports while the scan runs (NULL = unused)
+    network_scan_host_callback_t host_callback; // Streams compact hosts while the scan runs (NULL = unused)
+    void *user_data; // Passed to the callbacks
+    int sweep_hosts; // Addresses a delta rescan sweeps for new hosts, continuing where the last one stopped (0 = the rest of the range)
+    int sweep_concurrency; // Connects kept in flight by the sweep of a delta rescan (0 = 2)
+    int sweep_priority; // FreeRTOS priority of the calling task during the sweep of a delta rescan (0 = unchanged)
+    bool discard_devices; // Keep no device array, so memory stays flat however large the range; `devices` is then NULL (network_scan() only)
 } network_scan_options_t;
 
+// Hosts seen across scans. A device keeps `first_seen` from the scan that found it, `last_seen`
+// from the latest scan it answered and `online` from the latest scan that checked it.
+typedef struct network_inventory {
+    network_device_t *devices; // Known hosts in address order, online or not
+    int device_count;
+    int max_devices;
+    uint32_t sweep_next;       // Offset into the range where the next delta sweep starts
+    int rechecked;             // Known hosts rechecked by the last scan
+    int swept;                 // Addresses swept by the last scan
+    int discovered;            // Hosts added by the last scan
+    int returned;              // Offline hosts found back online by the last scan
+    int went_offline;          // Hosts marked offline by the last scan
+    int64_t recheck_time_us;   // Time the last scan spent rechecking known hosts
+    int64_t sweep_time_us;     // Time the last scan spent sweeping the range
+} network_inventory_t;
+
 // Function declarations
 network_scan_result_t *network_scan(network_scan_options_t *options);
 void free_scan_result(network_scan_result_t *result);
 
+// Scans like network_scan() into the compact form; `device_callback` and `discard_devices` are ignored
+network_scan_compact_t *network_scan_compact(network_scan_options_t *options);
+
+// Copies a string into the result's arena once and returns the shared copy, e.g. for a host's
+// `vendor` (NULL if memory ran out)
+const char *network_scan_intern(network_scan_compact_t *result, const char *string);
+
+// Converts a compact result to the heap-allocated form, to be freed with free_scan_result()
+network_scan_result_t *network_scan_expand(const network_scan_compact_t *compact);
+
+// Frees a compact result with all its hosts and strings
+void network_scan_compact_free(network_scan_compact_t *result);
+
+// Creates an empty inventory (NULL if memory ran out)
+network_inventory_t *network_inventory_create(void);
+
+// Scans the whole range of `options` into the inventory; known hosts of the range that no longer
+// answer are marked offline. `device_callback` sees every device that was updated, added or marked
+// offline. Returns 0 on success, or -1 on invalid options, when memory ran out or when the probes
+// failed; no host is marked offline by a failed scan.
+int network_inventory_scan(network_inventory_t *inventory, network_scan_options_t *options);
+
+// Delta rescan: rechecks the online hosts of the range on the ports known to be open, gives the
+// ones that stopped answering the full port list before marking them offline, then sweeps the
+// next `sweep_hosts` other addresses for new hosts at `sweep_concurrency`. Returns 0 on success,
+// or -1 on invalid options, when memory ran out or when the probes failed; hosts are only marked
+// offline once their recheck completed.
+int network_inventory_rescan(network_inventory_t *inventory, network_scan_options_t *options);
+
+// Frees an inventory with all its devices
+void network_inventory_free(network_inventory_t *inventory);
+
 #endif // NETWORK_SCANNER_H
\ No newline at end of file
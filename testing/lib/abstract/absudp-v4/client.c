@@ -0,0 +1,143 @@
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include "esp_log.h"
+
+#include "absudp-v4/client.h"
+#include "absudp-v4/server.h"
+
+// Set to 0 to compile the client's trace points out
+#ifndef CONFIG_ABSUDP_CLIENT_TRACE
+#define CONFIG_ABSUDP_CLIENT_TRACE 1
+#endif
+#define ABSTRACE_ENABLED CONFIG_ABSUDP_CLIENT_TRACE
+#include "abssys/abstrace.h"
+
+static const char *TAG = "absudp-v4-client";
+
+struct udp_client {
+    int sock;
+    bool sequenced;
+    uint32_t sequence;
+};
+
+udp_client_t *udp_client_open(const char *host, uint16_t port, const udp_client_options_t *options)
+{
+    struct sockaddr_in dest_addr;
+    memset(&dest_addr, 0, sizeof(dest_addr));
+    if (inet_pton(AF_INET, host, &dest_addr.sin_addr) != 1) {
+        ESP_LOGE(TAG, "Invalid address %s", host);
+        return NULL;
+    }
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_port = htons(port);
+
+    udp_client_t *client = calloc(1, sizeof(udp_client_t));
+    if (!client) {
+        ESP_LOGE(TAG, "Failed to allocate memory for client");
+        return NULL;
+    }
+    client->sequenced = options && options->sequenced;
+
+    client->sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (client->sock < 0) {
+        ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+        free(client);
+        return NULL;
+    }
+
+    int send_buffer = options ? options->send_buffer : 0;
+    if (send_buffer > 0 && setsockopt(client->sock, SOL_SOCKET, SO_SNDBUF, &send_buffer, sizeof(send_buffer)) != 0) {
+        ESP_LOGD(TAG, "SO_SNDBUF not supported: errno %d", errno);
+    }
+
+    // Connecting a datagram socket only fixes the destination; no packet is sent
+    if (connect(client->sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) != 0) {
+        ESP_LOGE(TAG, "Socket unable to connect: errno %d", errno);
+        close(client->sock);
+        free(client);
+        return NULL;
+    }
+    return client;
+}
+
+ssize_t udp_client_send(udp_client_t *client, const void *data, size_t len)
+{
+    if (!client) {
+        return -1;
+    }
+
+    // The sequence number goes out as its own iovec, so the payload is never copied
+    uint8_t header[UDP_SEQUENCE_HEADER_SIZE] = {
+        (uint8_t)(client->sequence >> 24), (uint8_t)(client->sequence >> 16),
+        (uint8_t)(client->sequence >> 8), (uint8_t)client->sequence,
+    };
+    struct iovec iov[2];
+    int iov_count = 0;
+    if (client->sequenced) {
+        iov[iov_count].iov_base = header;
+        iov[iov_count].iov_len = sizeof(header);
+        iov_count++;
+    }
+    iov[iov_count].iov_base = (void *)data;
+    iov[iov_count].iov_len = len;
+    iov_count++;
+
+    struct msghdr msg = {
+        .msg_iov = iov,
+        .msg_iovlen = iov_count,
+    };
+    ssize_t sent = sendmsg(client->sock, &msg, 0);
+
+    // A datagram that failed to send still uses up its number, so the server counts it as lost
+    client->sequence++;
+    if (sent < 0) {
+        ESP_LOGD(TAG, "Error occurred during sending: errno %d", errno);
+        return -1;
+    }
+    ABSTRACE(TRACE_UDP_CLIENT_SEND, client->sock, sent);
+    return client->sequenced ? sent - UDP_SEQUENCE_HEADER_SIZE : sent;
+}
+
+ssize_t udp_client_recv(udp_client_t *client, void *buffer, size_t len, int timeout_ms)
+{
+    if (!client) {
+        return -1;
+    }
+
+    fd_set read_fds;
+    FD_ZERO(&read_fds);
+    FD_SET(client->sock, &read_fds);
+    struct timeval timeout = {
+        .tv_sec = timeout_ms / 1000,
+        .tv_usec = (timeout_ms % 1000) * 1000,
+    };
+    int ready = select(client->sock + 1, &read_fds, NULL, NULL, &timeout);
+    if (ready <= 0) {
+        return ready;
+    }
+
+    ssize_t received = recv(client->sock, buffer, len, 0);
+    if (received < 0) {
+        ESP_LOGD(TAG, "Error occurred during receiving: errno %d", errno);
+    }
+    return received;
+}
+
+uint32_t udp_client_sequence(const udp_client_t *client)
+{
+    return client ? client->sequence : 0;
+}
+
+void udp_client_close(udp_client_t *client)
+{
+    if (!client) {
+        return;
+    }
+    close(client->sock);
+    free(client);
+}
@@ -0,0 +1,52 @@
+#ifndef ABSUDP_V4_CLIENT_H
+#define ABSUDP_V4_CLIENT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+/// @brief Handle of a UDP client
+typedef struct udp_client udp_client_t;
+
+/// @brief UDP client configuration options
+typedef struct {
+    bool sequenced;            ///< Prefix every datagram with a big-endian sequence number, matching a sequenced server
+    int send_buffer;           ///< Send buffer size in bytes (0 = stack default)
+} udp_client_options_t;
+
+/// @brief Open a UDP client bound to one server address
+/// 
+/// Nothing is sent until `udp_client_send()`; there is no handshake and no acknowledgement.
+/// 
+/// @param host The IP address to send to
+/// @param port The port number to send to
+/// @param options Optional client configuration (can be NULL for defaults)
+/// @return Handle of the client, or NULL on failure
+udp_client_t *udp_client_open(const char *host, uint16_t port, const udp_client_options_t *options);
+
+/// @brief Send one datagram without waiting for a reply
+/// @param client Open client
+/// @param data Payload to send
+/// @param len Length of the payload
+/// @return Number of payload bytes sent, or -1 on error
+ssize_t udp_client_send(udp_client_t *client, const void *data, size_t len);
+
+/// @brief Wait for one datagram from the server, e.g. a reply
+/// @param client Open client
+/// @param buffer Buffer to receive into
+/// @param len Size of the buffer
+/// @param timeout_ms How long to wait (0 = do not wait)
+/// @return Number of bytes received, 0 on timeout, or -1 on error
+ssize_t udp_client_recv(udp_client_t *client, void *buffer, size_t len, int timeout_ms);
+
+/// @brief Get the sequence number the next datagram will carry
+/// @param client Open client
+/// @return Next sequence number, which is also the number of datagrams sent so far
+uint32_t udp_client_sequence(const udp_client_t *client);
+
+/// @brief Close a client and free it; the handle is invalid afterwards
+/// @param client Client to close (NULL is ignored)
+void udp_client_close(udp_client_t *client);
+
+#endif // ABSUDP_V4_CLIENT_H
@@ -0,0 +1,393 @@
+#include <stdio.h>
+#include <string.h>
+#include <sys/param.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "esp_log.h"
+
+#include "lwip/err.h"
+#include "lwip/sockets.h"
+#include "lwip/sys.h"
+
+#include "absudp-v4/server.h"
+
+// Set to 0 to compile the server's trace points out
+#ifndef CONFIG_ABSUDP_SERVER_TRACE
+#define CONFIG_ABSUDP_SERVER_TRACE 1
+#endif
+#define ABSTRACE_ENABLED CONFIG_ABSUDP_SERVER_TRACE
+#include "abssys/abstrace.h"
+
+static const char *TAG = "absudp-v4-server";
+
+// Default number of datagrams drained per wake-up
+#define DEFAULT_BATCH_SIZE         8
+
+// Default block size: the largest UDP payload that fits an Ethernet frame unfragmented
+#define DEFAULT_BUFFER_SIZE        1472
+
+// Default server task settings
+#define DEFAULT_TASK_PRIORITY      5
+#define SERVER_TASK_STACK_SIZE     4096
+
+// How often the server task wakes up to check whether the server is being stopped
+#define STOP_POLL_INTERVAL_MS      100
+
+// Next expected sequence number of one sender
+typedef struct {
+    bool used;
+    uint32_t addr;             // Network order
+    uint16_t port;             // Network order
+    uint32_t next_sequence;
+    uint32_t last_seen;        // Value of the server's datagram counter when the sender was last heard from
+} sequence_source_t;
+
+// One datagram drained from the socket, waiting for its callback
+typedef struct {
+    char *block;
+    int len;
+    bool truncated;
+    struct sockaddr_in from;
+} batch_entry_t;
+
+struct udp_server {
+    int sock;
+    uint16_t port;
+    datagram_func_t callback;
+    void *user_data;
+    int batch_size;
+    int buffer_size;
+    buffer_pool_t *pool;
+    bool owns_pool;
+    bool sequenced;
+    int task_priority;
+    batch_entry_t *batch;
+    sequence_source_t sources[UDP_SERVER_MAX_SOURCES];
+    bool stopping;             // Set by udp_server_stop(), read by the server task
+    SemaphoreHandle_t task_done; // Given by the server task as it exits
+    udp_server_stats_t stats;  // Written only by the server task
+};
+
+// Returns the sequence slot of a sender, taking a free or the least recently heard slot for a new one
+static sequence_source_t *find_source(udp_server_t *server, const struct sockaddr_in *from, bool *is_new)
+{
+    sequence_source_t *oldest = &server->sources[0];
+    for (int i = 0; i < UDP_SERVER_MAX_SOURCES; i++) {
+        sequence_source_t *source = &server->sources[i];
+        if (source->used && source->addr == from->sin_addr.s_addr && source->port == from->sin_port) {
+            *is_new = false;
+            return source;
+        }
+        if (!source->used) {
+            oldest = source;
+        } else if (oldest->used && source->last_seen < oldest->last_seen) {
+            oldest = source;
+        }
+    }
+
+    oldest->used = true;
+    oldest->addr = from->sin_addr.s_addr;
+    oldest->port = from->sin_port;
+    *is_new = true;
+    return oldest;
+}
+
+// Updates the loss counters with the sequence number of a datagram
+static void track_sequence(udp_server_t *server, const struct sockaddr_in *from, uint32_t sequence)
+{
+    bool is_new;
+    sequence_source_t *source = find_source(server, from, &is_new);
+    source->last_seen = server->stats.datagrams;
+
+    // The first datagram of a sender sets the baseline; nothing before it counts as lost
+    int32_t gap = (int32_t)(sequence - source->next_sequence);
+    if (is_new || gap >= 0) {
+        if (!is_new) {
+            server->stats.sequence_lost += gap;
+        }
+        source->next_sequence = sequence + 1;
+    } else {
+        server->stats.sequence_late++;
+    }
+}
+
+// Drains up to batch_size datagrams without blocking. Returns the number received.
+static int receive_batch(udp_server_t *server)
+{
+    int count = 0;
+    while (count < server->batch_size) {
+        char *block = buffer_pool_alloc(server->pool);
+        if (!block) {
+            // The rest stays queued in the socket until blocks are returned
+            char probe;
+            if (recv(server->sock, &probe, sizeof(probe), MSG_PEEK | MSG_DONTWAIT) >= 0) {
+                server->stats.dropped++;
+            }
+            break;
+        }
+
+        batch_entry_t *entry = &server->batch[count];
+        struct iovec iov = { .iov_base = block, .iov_len = server->buffer_size };
+        struct msghdr msg = {
+            .msg_name = &entry->from,
+            .msg_namelen = sizeof(entry->from),
+            .msg_iov = &iov,
+            .msg_iovlen = 1,
+        };
+        int len = recvmsg(server->sock, &msg, MSG_DONTWAIT);
+        if (len < 0) {
+            buffer_pool_free(server->pool, block);
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                ESP_LOGE(TAG, "Error occurred during receiving: errno %d", errno);
+            }
+            break;
+        }
+
+        entry->block = block;
+        entry->len = len;
+        entry->truncated = (msg.msg_flags & MSG_TRUNC) != 0;
+        count++;
+    }
+    return count;
+}
+
+// Runs the callback for every datagram of a batch and sends the replies from response_buffer
+static void process_batch(udp_server_t *server, int count, char *response_buffer)
+{
+    for (int i = 0; i < count; i++) {
+        batch_entry_t *entry = &server->batch[i];
+        const char *data = entry->block;
+        int len = entry->len;
+
+        server->stats.datagrams++;
+        server->stats.bytes_in += len;
+        if (entry->truncated) {
+            server->stats.truncated++;
+        }
+
+        bool deliver = server->callback != NULL;
+        if (server->sequenced) {
+            if (len < UDP_SEQUENCE_HEADER_SIZE) {
+                server->stats.sequence_short++;
+                deliver = false;
+            } else {
+                const uint8_t *header = (const uint8_t *)data;
+                uint32_t sequence = ((uint32_t)header[0] << 24) | ((uint32_t)header[1] << 16) |
+                                    ((uint32_t)header[2] << 8) | header[3];
+                track_sequence(server, &entry->from, sequence);
+                data += UDP_SEQUENCE_HEADER_SIZE;
+                len -= UDP_SEQUENCE_HEADER_SIZE;
+            }
+        }
+
+        if (deliver) {
+            int response_len = server->callback(data, len, &entry->from, response_buffer, server->buffer_size,
+                                                server->user_data);
+            if (response_len > 0) {
+                int sent = sendto(server->sock, response_buffer, response_len, 0, (struct sockaddr *)&entry->from,
+                                  sizeof(entry->from));
+                if (sent < 0) {
+                    ESP_LOGD(TAG, "Error occurred during sending: errno %d", errno);
+                } else {
+                    ABSTRACE(TRACE_UDP_SERVER_SEND, server->sock, sent);
+                    server->stats.replies++;
+                    server->stats.bytes_out += sent;
+                }
+            }
+        }
+
+        buffer_pool_free(server->pool, entry->block);
+        entry->block = NULL;
+    }
+}
+
+static void udp_server_task(void *pvParameters)
+{
+    udp_server_t *server = (udp_server_t *)pvParameters;
+
+    while (!__atomic_load_n(&server->stopping, __ATOMIC_ACQUIRE)) {
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(server->sock, &read_fds);
+        struct timeval timeout = {
+            .tv_sec = 0,
+            .tv_usec = STOP_POLL_INTERVAL_MS * 1000,
+        };
+
+        int ready = select(server->sock + 1, &read_fds, NULL, NULL, &timeout);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ESP_LOGE(TAG, "Error occurred during select: errno %d", errno);
+            break;
+        }
+        if (ready == 0) {
+            continue;
+        }
+
+        // The reply block is taken before the socket is drained, so every datagram taken can be answered
+        char *response_buffer = server->callback ? buffer_pool_alloc(server->pool) : NULL;
+        int count = 0;
+        if (server->callback && !response_buffer) {
+            // Nothing taken now could be answered, so the datagrams wait in the socket
+            server->stats.dropped++;
+        } else {
+            count = receive_batch(server);
+        }
+
+        if (count > 0) {
+            ABSTRACE(TRACE_UDP_SERVER_BATCH, server->sock, count);
+            server->stats.batches++;
+            server->stats.batch_max = MAX(server->stats.batch_max, (uint32_t)count);
+            process_batch(server, count, response_buffer);
+        }
+        buffer_pool_free(server->pool, response_buffer);
+        if (count == 0) {
+            // Readable but nothing could be taken: the shared pool is empty, so give other tasks a turn
+            vTaskDelay(1);
+        }
+    }
+
+    xSemaphoreGive(server->task_done);
+    vTaskDelete(NULL);
+}
+
+// Creates and binds a datagram socket. Returns the socket or -1.
+static int open_socket(uint16_t port, const char *host, int recv_buffer)
+{
+    struct sockaddr_in dest_addr;
+    memset(&dest_addr, 0, sizeof(dest_addr));
+    if (host && strlen(host) > 0) {
+        inet_pton(AF_INET, host, &dest_addr.sin_addr);
+    } else {
+        dest_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    }
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_port = htons(port);
+
+    int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Unable to create socket: errno %d", errno);
+        return -1;
+    }
+
+    int opt = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (recv_buffer > 0 && setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &recv_buffer, sizeof(recv_buffer)) != 0) {
+        ESP_LOGD(TAG, "SO_RCVBUF not supported: errno %d", errno);
+    }
+
+    if (bind(sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) != 0) {
+        ESP_LOGE(TAG, "Socket unable to bind: errno %d", errno);
+        close(sock);
+        return -1;
+    }
+    return sock;
+}
+
+static void free_server(udp_server_t *server)
+{
+    if (server->sock >= 0) {
+        close(server->sock);
+    }
+    if (server->owns_pool && server->pool) {
+        buffer_pool_destroy(server->pool);
+    }
+    if (server->task_done) {
+        vSemaphoreDelete(server->task_done);
+    }
+    free(server->batch);
+    free(server);
+}
+
+udp_server_t *udp_server_start(uint16_t port, const char *host, datagram_func_t callback, void *user_data, udp_server_options_t *options)
+{
+    udp_server_t *server = calloc(1, sizeof(udp_server_t));
+    if (!server) {
+        ESP_LOGE(TAG, "Failed to allocate memory for server");
+        return NULL;
+    }
+
+    server->sock = -1;
+    server->port = port;
+    server->callback = callback;
+    server->user_data = user_data;
+    int buffer_count = 0;
+    int recv_buffer = 0;
+    if (options) {
+        server->batch_size = options->batch_size;
+        server->buffer_size = options->buffer_size;
+        server->pool = options->buffer_pool;
+        server->sequenced = options->sequenced;
+        server->task_priority = options->task_priority;
+        buffer_count = options->buffer_count;
+        recv_buffer = options->recv_buffer;
+    }
+    if (server->batch_size <= 0) {
+        server->batch_size = DEFAULT_BATCH_SIZE;
+    }
+    if (server->task_priority <= 0) {
+        server->task_priority = DEFAULT_TASK_PRIORITY;
+    }
+
+    server->owns_pool = server->pool == NULL;
+    if (server->owns_pool) {
+        server->pool = buffer_pool_create(server->buffer_size > 0 ? server->buffer_size : DEFAULT_BUFFER_SIZE,
+                                          buffer_count > 0 ? buffer_count : server->batch_size + 1);
+        if (!server->pool) {
+            ESP_LOGE(TAG, "Failed to create buffer pool");
+            free_server(server);
+            return NULL;
+        }
+    }
+    server->buffer_size = buffer_pool_block_size(server->pool);
+
+    server->batch = calloc(server->batch_size, sizeof(batch_entry_t));
+    server->task_done = xSemaphoreCreateBinary();
+    if (!server->batch || !server->task_done) {
+        ESP_LOGE(TAG, "Failed to allocate server state");
+        free_server(server);
+        return NULL;
+    }
+
+    server->sock = open_socket(port, host, recv_buffer);
+    if (server->sock < 0) {
+        free_server(server);
+        return NULL;
+    }
+
+    if (xTaskCreate(udp_server_task, "udp_server", SERVER_TASK_STACK_SIZE, server, server->task_priority, NULL) != pdPASS) {
+        ESP_LOGE(TAG, "Failed to create server task");
+        free_server(server);
+        return NULL;
+    }
+
+    ESP_LOGI(TAG, "UDP server started on %s:%d", host ? host : "0.0.0.0", port);
+    return server;
+}
+
+void udp_server_stop(udp_server_t *server)
+{
+    if (!server) {
+        return;
+    }
+
+    __atomic_store_n(&server->stopping, true, __ATOMIC_RELEASE);
+    xSemaphoreTake(server->task_done, portMAX_DELAY);
+    ESP_LOGI(TAG, "UDP server stopped on port %d", server->port);
+    free_server(server);
+}
+
+int udp_server_get_stats(udp_server_t *server, udp_server_stats_t *stats)
+{
+    if (!server || !stats) {
+        return -1;
+    }
+
+    // Counters are read without stopping the task; a sample taken while the server runs may be slightly skewed
+    *stats = server->stats;
+    buffer_pool_get_stats(server->pool, &stats->buffers);
+    return 0;
+}
@@ -0,0 +1,85 @@
+#ifndef ABSUDP_V4_SERVER_H
+#define ABSUDP_V4_SERVER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <netinet/in.h>
+
+#include "abstcp-v4/buffer-pool.h"
+
+/// @brief Size of the sequence number header of sequenced datagrams
+#define UDP_SEQUENCE_HEADER_SIZE 4
+
+/// @brief Number of senders whose sequence numbers are tracked at once; further senders take the oldest slot
+#define UDP_SERVER_MAX_SOURCES 8
+
+/// @brief Handle of a running UDP server
+typedef struct udp_server udp_server_t;
+
+/// @brief Datagram callback function type
+/// 
+/// Called once per received datagram. With sequencing enabled the sequence number has already
+/// been stripped from `data`.
+/// 
+/// @param data Pointer to the datagram payload
+/// @param len Length of the payload
+/// @param from Address the datagram came from
+/// @param response_buffer Buffer to write a reply to, sent back to `from`
+/// @param response_buffer_size Maximum size of the reply
+/// @param user_data User-provided data passed to the callback
+/// @return Length of the reply, or 0 if no reply should be sent
+typedef int (*datagram_func_t)(const char *data, int len, const struct sockaddr_in *from, char *response_buffer, int response_buffer_size, void *user_data);
+
+/// @brief UDP server configuration options
+typedef struct {
+    int batch_size;            ///< Datagrams drained from the socket per wake-up before callbacks run (0 = use default of 8)
+    int buffer_size;           ///< Size of the pooled blocks, which bounds a datagram; longer ones are truncated (0 = use default of 1472)
+    int buffer_count;          ///< Number of pooled blocks (0 = one batch plus a reply block)
+    buffer_pool_t *buffer_pool; ///< Existing pool to borrow blocks from (NULL = create one)
+    bool sequenced;            ///< Datagrams start with a big-endian sequence number used to measure loss
+    int recv_buffer;           ///< Receive buffer size in bytes (0 = stack default)
+    int task_priority;         ///< FreeRTOS priority of the server task (0 = use default of 5)
+} udp_server_options_t;
+
+/// @brief UDP server statistics
+typedef struct {
+    uint32_t datagrams;        ///< Datagrams received
+    uint64_t bytes_in;         ///< Payload bytes received
+    uint32_t truncated;        ///< Datagrams longer than a pool block
+    uint32_t dropped;          ///< Wake-ups that left datagrams queued in the socket because the pool was empty
+    uint32_t replies;          ///< Replies sent
+    uint64_t bytes_out;        ///< Reply bytes sent
+    uint32_t batches;          ///< Wake-ups that received at least one datagram
+    uint32_t batch_max;        ///< Most datagrams received in one wake-up
+    uint32_t sequence_lost;    ///< Sequence numbers skipped over, i.e. datagrams lost or not yet arrived
+    uint32_t sequence_late;    ///< Datagrams that arrived behind a higher sequence number (reordered or duplicated)
+    uint32_t sequence_short;   ///< Sequenced datagrams too short to hold a sequence number
+    buffer_pool_stats_t buffers; ///< Usage of the server's buffer pool
+} udp_server_stats_t;
+
+/// @brief Start a UDP server
+/// 
+/// A single task waits for the socket to become readable, drains up to `batch_size` datagrams into
+/// pool blocks and only then runs the callback for each of them, so a burst is taken off the
+/// stack's receive queue before it can overflow.
+/// 
+/// @param port The port number to listen on
+/// @param host The host address to bind to (NULL or empty string for INADDR_ANY)
+/// @param callback Function to call for every received datagram
+/// @param user_data User data to pass to the callback
+/// @param options Optional server configuration (can be NULL for defaults)
+/// @return Handle of the running server, or NULL on failure
+udp_server_t *udp_server_start(uint16_t port, const char *host, datagram_func_t callback, void *user_data, udp_server_options_t *options);
+
+/// @brief Stop a server and free it; the handle is invalid afterwards
+/// @param server Server to stop (NULL is ignored)
+void udp_server_stop(udp_server_t *server);
+
+/// @brief Read the statistics of a running server
+/// @param server Running server
+/// @param stats Filled in with the current counters
+/// @return 0 on success, -1 on invalid arguments
+int udp_server_get_stats(udp_server_t *server, udp_server_stats_t *stats);
+
+#endif // ABSUDP_V4_SERVER_H
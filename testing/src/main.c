@@ -3,25 +3,259 @@
 #include "abstcp-v4/server.h"
 #include "abstcp-v4/client.h"
 #include "abstcp-v4/tools.h"
+#include "abstcp-v4/http.h"
+#include "abstcp-v4/session.h"
+#include "abstcp-v4/dns-cache.h"
+#include "absudp-v4/server.h"
+#include "absudp-v4/client.h"
+#include "abssys/abstrace.h"
 #include "esp_log.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "esp_timer.h"
 #include <string.h>
 #include <sys/socket.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <sys/param.h>
 
 static const char *TAG = "BENCHMARK";
 
+// Number of clients kept open at the same time by the concurrent benchmark
+#define CONCURRENT_CLIENTS 4
+#define CONCURRENT_ROUNDS  10
+
+// Requests sent by the connection pool benchmark, once connecting for each and once through a pool
+#define POOL_REQUESTS      50
+
+// Worker pool sizes compared by the worker benchmark; server N listens on WORKER_BASE_PORT + index
+#define WORKER_CONFIG_COUNT 3
+#define WORKER_BASE_PORT    8081
+static const int worker_configs[WORKER_CONFIG_COUNT] = {1, 2, 4};
+
+// Socket profiles compared by the tuning benchmark; profile N is served on PROFILE_BASE_PORT + N
+#define PROFILE_COUNT       4
+#define PROFILE_BASE_PORT   8090
+#define PROFILE_PING_ROUNDS 20
+#define PROFILE_BULK_BYTES  (64 * 1024)
+#define PROFILE_BULK_CHUNK  512
+static const socket_profile_t profile_configs[PROFILE_COUNT] = {
+    SOCKET_PROFILE_DEFAULT, SOCKET_PROFILE_LOW_LATENCY, SOCKET_PROFILE_BALANCED, SOCKET_PROFILE_BULK
+};
+
+// Port of the backpressure benchmark, where one client stalls a download while another pings
+#define BACKPRESSURE_PORT   (PROFILE_BASE_PORT + PROFILE_COUNT)
+
+// Telemetry benchmark: fire-and-forget sequenced datagrams over loopback
+#define UDP_BENCH_PORT      8100
+#define UDP_BENCH_DATAGRAMS 2000
+#define UDP_BENCH_PAYLOAD   32
+
+// Flood benchmark: one client floods over loopback while another pings over the AP address, first
+// on a server without limits (FLOOD_BASE_PORT) and then on one with per-IP limits (FLOOD_BASE_PORT + 1)
+#define FLOOD_BASE_PORT     8102
+#define FLOOD_RUNS          2
+#define FLOOD_PINGS         20
+#define FLOOD_CHUNK         512
+#define FLOOD_IP_RATE       (16 * 1024)
+
+// HTTP benchmark: keep-alive GETs over loopback, one at a time and then HTTP_PIPELINE_DEPTH per write
+#define HTTP_BENCH_PORT      8104
+#define HTTP_BENCH_REQUESTS  400
+#define HTTP_PIPELINE_DEPTH  8
+
+// Pipelined client benchmark: newline-framed echoes, each waited for and then with
+// PIPELINE_IN_FLIGHT outstanding on one asynchronous connection; a server that never answers is
+// then stopped PIPELINE_DROP_DELAY_MS after the window fills
+#define PIPELINE_BENCH_PORT  8105
+#define PIPELINE_REQUESTS    400
+#define PIPELINE_IN_FLIGHT   8
+#define PIPELINE_DROP_DELAY_MS 200
+
+// Read timeout check: a server with only a read timeout must keep a connection that completed its
+// message and then went quiet, and close one that left a message unfinished
+#define READ_TIMEOUT_PORT    8108
+#define READ_TIMEOUT_MS      200
+
+// Write coalescing benchmark: tiny newline-framed messages to a server that only counts them
+#define COALESCE_BENCH_PORT  8106
+#define COALESCE_MESSAGES    500
+#ifdef CONFIG_LWIP_TCP_MSS
+#define COALESCE_MSS         CONFIG_LWIP_TCP_MSS
+#else
+#define COALESCE_MSS         1440
+#endif
+
+// Session benchmark: messages sent while the server is down are replayed once it is back
+#define SESSION_BENCH_PORT   8107
+#define SESSION_MESSAGES     10
+#define SESSION_OUTAGE_MS    1000
+
+// Scan concurrency benchmark: the first addresses of the AP subnet, where all but the server's
+// own address stay silent until the probe timeout
+#define SCAN_BENCH_START_IP  "192.168.4.1"
+#define SCAN_BENCH_END_IP    "192.168.4.8"
+#define SCAN_BENCH_HOSTS     8
+#define SCAN_BENCH_TIMEOUT   300
+#define SCAN_LEVEL_COUNT     3
+#define INVENTORY_RESCANS    4
+#define INVENTORY_SWEEP      2
+static const int scan_levels[SCAN_LEVEL_COUNT] = {1, 4, 8};
+
+// Result of one concurrent-clients run
+typedef struct {
+    int clients;
+    int round_trips;
+    int64_t time_us;
+} concurrent_result_t;
+
+// Result of the connection pool comparison
+typedef struct {
+    int requests;
+    int64_t connect_time_us;
+    int pooled_requests;
+    int64_t pooled_time_us;
+    uint32_t pool_connects;
+} pool_result_t;
+
+// Result of one socket profile run
+typedef struct {
+    int pings;
+    int64_t ping_time_us;
+    int bulk_bytes;
+    int64_t bulk_time_us;
+} profile_result_t;
+
+// Result of the backpressure run
+typedef struct {
+    int pings;
+    int64_t ping_time_us;
+    int bulk_bytes;
+    uint32_t queue_max_bytes;
+    uint32_t read_pauses;
+} backpressure_result_t;
+
+// Result of the UDP telemetry run
+typedef struct {
+    int sent;
+    int64_t send_time_us;
+    uint32_t received;
+    uint32_t lost;
+    uint32_t batch_max;
+} udp_result_t;
+
+// Result of one flood run
+typedef struct {
+    int pings;
+    int64_t ping_time_us;
+    int64_t ping_max_us;
+    uint64_t flood_bytes_read;
+    uint32_t throttled;
+    uint32_t admission_rejected;
+} flood_result_t;
+
+// Result of the pipelined client comparison
+typedef struct {
+    int sync_requests;
+    int64_t sync_time_us;
+    int async_requests;
+    int64_t async_time_us;
+    int drop_failed;            // Requests completed with an error once the silent server was stopped
+    int64_t drop_time_us;       // Time the sender waiting for a slot took to fail, or 0 if it did not
+} pipeline_result_t;
+
+// Result of the read timeout check
+typedef struct {
+    bool completed_kept;       // Still answered after completing its message and staying quiet past the timeout
+    bool partial_closed;       // Closed after leaving its message unfinished past the timeout
+} read_timeout_result_t;
+
+// Result of one write coalescing run
+typedef struct {
+    int messages;
+    int64_t time_us;
+    uint32_t syscalls;
+    uint32_t segments;         // Estimated from the size of each send and the MSS
+} coalesce_result_t;
+
+// Result of the session outage run
+typedef struct {
+    int delivered_before;
+    int delivered_after;
+    int64_t recovery_time_us;  // From the server restarting to the held messages arriving
+    tcp_session_stats_t stats;
+} session_result_t;
+
+// Result of one scan concurrency run
+typedef struct {
+    int probes;
+    int devices;
+    int64_t time_us;
+} scan_result_t;
+
+// Heap held per device by the two scan result forms
+typedef struct {
+    int devices;
+    int legacy_bytes;
+    int compact_bytes;         // Host records only
+    int compact_arena_bytes;   // Whole arena, including the result and unused chunk space
+} scan_footprint_t;
+
+// Result of the inventory run: one full scan, then delta rescans of the same range
+typedef struct {
+    int devices;
+    int64_t full_time_us;
+    int rescans;
+    int64_t rescan_time_us;
+} inventory_result_t;
+
+// Result of the DNS cache run: each check compares the stub resolver's call count with the expected one
+typedef struct {
+    int checks;
+    int passed;
+    dns_cache_stats_t stats;
+} dns_result_t;
+
+// Result of one HTTP run
+typedef struct {
+    int requests;
+    int64_t time_us;
+} http_result_t;
+
 // Benchmark results structure
 typedef struct {
     int64_t nvs_init_time_us;
     int64_t wifi_init_time_us;
     int64_t server_start_time_us;
+    int64_t server_reconfigure_time_us;
+    int64_t server_stop_time_us;
     int64_t client_connect_time_us;
     int64_t total_send_time_us;
     int64_t total_recv_time_us;
     int64_t network_scan_time_us;
+    int64_t network_discovery_time_us;
+    int64_t network_probe_time_us;
+    int network_hosts_alive;
+    int64_t network_first_device_us;
     int64_t client_cleanup_time_us;
+    concurrent_result_t concurrent;
+    concurrent_result_t workers[WORKER_CONFIG_COUNT];
+    pool_result_t pool;
+    profile_result_t profiles[PROFILE_COUNT];
+    backpressure_result_t backpressure;
+    udp_result_t udp;
+    flood_result_t floods[FLOOD_RUNS];
+    http_result_t http_keep_alive;
+    http_result_t http_pipelined;
+    pipeline_result_t pipeline;
+    read_timeout_result_t read_timeout;
+    coalesce_result_t coalesce[2];
+    session_result_t session;
+    scan_result_t scans[SCAN_LEVEL_COUNT];
+    scan_footprint_t scan_footprint;
+    inventory_result_t inventory;
+    dns_result_t dns;
     int message_count;
     int total_bytes_sent;
     int total_bytes_received;
@@ -32,6 +266,13 @@ typedef struct {
 
 static benchmark_results_t bench_results = {0};
 
+// Block pool shared by the main benchmark server so its usage can be reported
+static buffer_pool_t *server_pool = NULL;
+
+// Running benchmark servers
+static tcp_server_t *echo_server = NULL;
+static tcp_server_t *worker_servers[WORKER_CONFIG_COUNT];
+
 // Custom recv function for the client with timing
 ssize_t client_recv_func(int sockfd, void *buf, size_t len, int flags) {
     int64_t start_time = esp_timer_get_time();
@@ -47,12 +288,8 @@ ssize_t client_recv_func(int sockfd, void *buf, size_t len, int flags) {
     return result;
 }
 
-// Example response function for the TCP server with timing
+// Example response function for the TCP server; its timing is collected by the server statistics
 int echo_response_handler(const char *request_data, int request_len, char *response_buffer, int response_buffer_size, void *user_data) {
-    int64_t start_time = esp_timer_get_time();
-    
-    ESP_LOGI(TAG, "SERVER: Processing request (%d bytes): %.*s", request_len, request_len, request_data);
-    
     // Simple echo response with a prefix
     const char *prefix = "Echo: ";
     int prefix_len = strlen(prefix);
@@ -64,9 +301,6 @@ int echo_response_handler(const char *request_data, int request_len, char *respo
         response_len = prefix_len + request_len;
     }
     
-    int64_t end_time = esp_timer_get_time();
-    ESP_LOGI(TAG, "SERVER: Response prepared in %lld us (%d bytes)", end_time - start_time, response_len);
-    
     return response_len;
 }
 
@@ -169,7 +403,1039 @@ void client_task(void *pvParameters) {
     vTaskDelete(NULL);
 }
 
+// Handler with a fixed processing delay, standing in for a slow response_func_t
+int slow_echo_response_handler(const char *request_data, int request_len, char *response_buffer, int response_buffer_size, void *user_data) {
+    vTaskDelay(pdMS_TO_TICKS(5));
+    int response_len = request_len < response_buffer_size ? request_len : response_buffer_size;
+    memcpy(response_buffer, request_data, response_len);
+    return response_len;
+}
+
+// Opens several connections at once, sends a request on each, then collects the replies. With a
+// single-connection server the second client would sit in the backlog until the first disconnects.
+static void run_concurrent_clients(uint16_t port, concurrent_result_t *result) {
+    int socks[CONCURRENT_CLIENTS];
+    struct sockaddr_in dest_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+    };
+    inet_pton(AF_INET, "192.168.4.1", &dest_addr.sin_addr);
+
+    int connected = 0;
+    for (int i = 0; i < CONCURRENT_CLIENTS; i++) {
+        socks[i] = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+        if (socks[i] < 0 || connect(socks[i], (struct sockaddr *)&dest_addr, sizeof(dest_addr)) != 0) {
+            ESP_LOGE(TAG, "CONCURRENT_CONNECT_FAILED: port %d client %d", port, i);
+            if (socks[i] >= 0) {
+                close(socks[i]);
+            }
+            socks[i] = -1;
+            continue;
+        }
+        connected++;
+    }
+
+    int64_t start = esp_timer_get_time();
+    int round_trips = 0;
+    for (int round = 0; round < CONCURRENT_ROUNDS; round++) {
+        for (int i = 0; i < CONCURRENT_CLIENTS; i++) {
+            if (socks[i] >= 0) {
+                char buffer[64];
+                int len = snprintf(buffer, sizeof(buffer), "client %d round %d", i, round);
+                send(socks[i], buffer, len, 0);
+            }
+        }
+        for (int i = 0; i < CONCURRENT_CLIENTS; i++) {
+            char buffer[64];
+            if (socks[i] >= 0 && recv(socks[i], buffer, sizeof(buffer), 0) > 0) {
+                round_trips++;
+            }
+        }
+    }
+    int64_t end = esp_timer_get_time();
+
+    for (int i = 0; i < CONCURRENT_CLIENTS; i++) {
+        if (socks[i] >= 0) {
+            close(socks[i]);
+        }
+    }
+
+    result->clients = connected;
+    result->round_trips = round_trips;
+    result->time_us = end - start;
+    ESP_LOGI(TAG, "CONCURRENT: port %d, %d clients, %d round trips in %lld us", port, connected, round_trips, end - start);
+}
+
+// Sends one request and waits for its reply
+static bool pool_round_trip(tcp_client_t *conn) {
+    char buffer[64];
+    return tcp_client_send(conn, "pool ping", 9) == 9 && tcp_client_recv(conn, buffer, sizeof(buffer), 1000) > 0;
+}
+
+// Compares opening a connection per request with reusing connections from a pool
+static void run_pool_comparison(uint16_t port, pool_result_t *result) {
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < POOL_REQUESTS; i++) {
+        tcp_client_t *conn = tcp_client_connect("192.168.4.1", port, NULL, 1000);
+        if (!conn) {
+            break;
+        }
+        bool ok = pool_round_trip(conn);
+        tcp_client_close(conn);
+        if (!ok) {
+            break;
+        }
+        result->requests++;
+    }
+    result->connect_time_us = esp_timer_get_time() - start;
+
+    tcp_client_pool_t *pool = tcp_client_pool_create(NULL);
+    if (!pool) {
+        ESP_LOGE(TAG, "POOL_CREATE_FAILED");
+        return;
+    }
+    start = esp_timer_get_time();
+    for (int i = 0; i < POOL_REQUESTS; i++) {
+        tcp_client_t *conn = tcp_client_pool_acquire(pool, "192.168.4.1", port);
+        if (!conn) {
+            break;
+        }
+        bool ok = pool_round_trip(conn);
+        tcp_client_pool_release(pool, conn, ok);
+        if (!ok) {
+            break;
+        }
+        result->pooled_requests++;
+    }
+    result->pooled_time_us = esp_timer_get_time() - start;
+
+    tcp_client_pool_stats_t stats;
+    if (tcp_client_pool_get_stats(pool, &stats) == 0) {
+        result->pool_connects = stats.connected;
+    }
+    tcp_client_pool_destroy(pool);
+    ESP_LOGI(TAG, "POOL: %d requests connecting each in %lld us, %d pooled in %lld us over %u connection(s)",
+             result->requests, result->connect_time_us, result->pooled_requests, result->pooled_time_us,
+             (unsigned)result->pool_connects);
+}
+
+void concurrent_client_task(void *pvParameters) {
+    ESP_LOGI(TAG, "=== STARTING CONCURRENT CLIENT BENCHMARK ===");
+    run_concurrent_clients(8080, &bench_results.concurrent);
+
+    ESP_LOGI(TAG, "=== STARTING WORKER POOL BENCHMARK ===");
+    for (int i = 0; i < WORKER_CONFIG_COUNT; i++) {
+        run_concurrent_clients(WORKER_BASE_PORT + i, &bench_results.workers[i]);
+    }
+
+    ESP_LOGI(TAG, "=== STARTING CONNECTION POOL BENCHMARK ===");
+    run_pool_comparison(8080, &bench_results.pool);
+
+    vTaskDelete(NULL);
+}
+
+// Replies to "BULK" with PROFILE_BULK_BYTES sent in small chunks, and echoes any other message
+static char profile_bulk_chunk[PROFILE_BULK_CHUNK];
+static int profile_response_handler(const char *request_data, int request_len, server_response_t *response, void *user_data) {
+    if (request_len == 4 && memcmp(request_data, "BULK", 4) == 0) {
+        int sent = (int)(intptr_t)response->cursor + PROFILE_BULK_CHUNK;
+        response->segments[0].data = profile_bulk_chunk;
+        response->segments[0].len = PROFILE_BULK_CHUNK;
+        response->segment_count = 1;
+        response->cursor = (void *)(intptr_t)sent;
+        response->more = sent < PROFILE_BULK_BYTES;
+        return 0;
+    }
+
+    response->segments[0].data = request_data;
+    response->segments[0].len = request_len;
+    response->segment_count = 1;
+    return 0;
+}
+
+// Sends a length-prefixed message as two writes, header then body, the pattern Nagle's algorithm
+// combined with delayed ACKs stalls
+static int send_framed(int sock, const char *data, int len) {
+    uint8_t header[2] = { (uint8_t)(len >> 8), (uint8_t)len };
+    if (send(sock, header, sizeof(header), 0) != sizeof(header)) {
+        return -1;
+    }
+    return send(sock, data, len, 0) == len ? 0 : -1;
+}
+
+static int connect_benchmark_server(uint16_t port) {
+    struct sockaddr_in dest_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+    };
+    inet_pton(AF_INET, "192.168.4.1", &dest_addr.sin_addr);
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (sock >= 0 && connect(sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) != 0) {
+        close(sock);
+        sock = -1;
+    }
+    return sock;
+}
+
+static void run_profile(socket_profile_t profile, uint16_t port, profile_result_t *result) {
+    socket_tuning_t tuning;
+    socket_tuning_profile(profile, &tuning);
+
+    server_options_t options = {
+        .max_clients = 1,
+        .response_iov_callback = profile_response_handler,
+        .framer = { .type = FRAMER_LENGTH_PREFIX },
+        .tuning = tuning,
+    };
+    tcp_server_t *server = tcp_server_start(port, NULL, NULL, NULL, &options);
+    if (!server) {
+        ESP_LOGE(TAG, "PROFILE_SERVER_FAILED: %s", socket_profile_name(profile));
+        return;
+    }
+
+    int sock = connect_benchmark_server(port);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "PROFILE_CONNECT_FAILED: %s", socket_profile_name(profile));
+        tcp_server_stop(server, 0);
+        return;
+    }
+    socket_tuning_apply(sock, &tuning);
+
+    static char buffer[1024];
+    const char *ping = "profile latency ping";
+    int ping_len = strlen(ping);
+    int64_t start = esp_timer_get_time();
+    for (int round = 0; round < PROFILE_PING_ROUNDS; round++) {
+        if (send_framed(sock, ping, ping_len) < 0 || recv(sock, buffer, sizeof(buffer), 0) <= 0) {
+            break;
+        }
+        result->pings++;
+    }
+    result->ping_time_us = esp_timer_get_time() - start;
+
+    start = esp_timer_get_time();
+    if (send_framed(sock, "BULK", 4) == 0) {
+        while (result->bulk_bytes < PROFILE_BULK_BYTES) {
+            int len = recv(sock, buffer, sizeof(buffer), 0);
+            if (len <= 0) {
+                break;
+            }
+            result->bulk_bytes += len;
+        }
+    }
+    result->bulk_time_us = esp_timer_get_time() - start;
+
+    close(sock);
+    tcp_server_stop(server, 100);
+    ESP_LOGI(TAG, "PROFILE: %s, %d pings in %lld us, %d bulk bytes in %lld us", socket_profile_name(profile),
+             result->pings, result->ping_time_us, result->bulk_bytes, result->bulk_time_us);
+}
+
+// One client requests the bulk download and stops reading while a second client pings the same
+// event loop; the stalled download waits in the server's output queue instead of blocking the loop
+static void run_backpressure(backpressure_result_t *result) {
+    server_options_t options = {
+        .max_clients = 2,
+        .response_iov_callback = profile_response_handler,
+        .framer = { .type = FRAMER_LENGTH_PREFIX },
+    };
+    tcp_server_t *server = tcp_server_start(BACKPRESSURE_PORT, NULL, NULL, NULL, &options);
+    if (!server) {
+        ESP_LOGE(TAG, "BACKPRESSURE_SERVER_FAILED");
+        return;
+    }
+
+    int slow_sock = connect_benchmark_server(BACKPRESSURE_PORT);
+    int ping_sock = connect_benchmark_server(BACKPRESSURE_PORT);
+    static char buffer[1024];
+    if (slow_sock >= 0 && ping_sock >= 0 && send_framed(slow_sock, "BULK", 4) == 0) {
+        const char *ping = "backpressure ping";
+        int ping_len = strlen(ping);
+        int64_t start = esp_timer_get_time();
+        for (int round = 0; round < PROFILE_PING_ROUNDS; round++) {
+            if (send_framed(ping_sock, ping, ping_len) < 0 || recv(ping_sock, buffer, sizeof(buffer), 0) <= 0) {
+                break;
+            }
+            result->pings++;
+        }
+        result->ping_time_us = esp_timer_get_time() - start;
+
+        while (result->bulk_bytes < PROFILE_BULK_BYTES) {
+            int len = recv(slow_sock, buffer, sizeof(buffer), 0);
+            if (len <= 0) {
+                break;
+            }
+            result->bulk_bytes += len;
+        }
+    } else {
+        ESP_LOGE(TAG, "BACKPRESSURE_CONNECT_FAILED");
+    }
+    if (slow_sock >= 0) {
+        close(slow_sock);
+    }
+    if (ping_sock >= 0) {
+        close(ping_sock);
+    }
+
+    tcp_server_stats_t stats;
+    if (tcp_server_get_stats(server, &stats) == 0) {
+        result->queue_max_bytes = stats.queue_max_bytes;
+        result->read_pauses = stats.read_pauses;
+    }
+    tcp_server_stop(server, 100);
+    ESP_LOGI(TAG, "BACKPRESSURE: %d pings in %lld us, %d bulk bytes, %u bytes max queued", result->pings,
+             result->ping_time_us, result->bulk_bytes, (unsigned)result->queue_max_bytes);
+}
+
+void profile_benchmark_task(void *pvParameters) {
+    ESP_LOGI(TAG, "=== STARTING SOCKET PROFILE BENCHMARK ===");
+    for (int i = 0; i < PROFILE_COUNT; i++) {
+        run_profile(profile_configs[i], PROFILE_BASE_PORT + i, &bench_results.profiles[i]);
+    }
+    run_backpressure(&bench_results.backpressure);
+
+    vTaskDelete(NULL);
+}
+
+// Counts telemetry datagrams; the server's stats do the bookkeeping, so nothing is replied
+static int telemetry_handler(const char *data, int len, const struct sockaddr_in *from, char *response_buffer, int response_buffer_size, void *user_data) {
+    return 0;
+}
+
+void udp_benchmark_task(void *pvParameters) {
+    ESP_LOGI(TAG, "=== STARTING UDP TELEMETRY BENCHMARK ===");
+    udp_result_t *result = &bench_results.udp;
+
+    udp_server_options_t server_options = { .sequenced = true };
+    udp_server_t *server = udp_server_start(UDP_BENCH_PORT, "127.0.0.1", telemetry_handler, NULL, &server_options);
+    udp_client_options_t client_options = { .sequenced = true };
+    udp_client_t *client = udp_client_open("127.0.0.1", UDP_BENCH_PORT, &client_options);
+    if (!server || !client) {
+        ESP_LOGE(TAG, "UDP_BENCH_FAILED");
+    } else {
+        char reading[UDP_BENCH_PAYLOAD];
+        memset(reading, 'T', sizeof(reading));
+        int64_t start = esp_timer_get_time();
+        for (int i = 0; i < UDP_BENCH_DATAGRAMS; i++) {
+            if (udp_client_send(client, reading, sizeof(reading)) > 0) {
+                result->sent++;
+            }
+        }
+        result->send_time_us = esp_timer_get_time() - start;
+
+        // Give the server task time to drain what is still queued
+        vTaskDelay(pdMS_TO_TICKS(200));
+        udp_server_stats_t stats;
+        if (udp_server_get_stats(server, &stats) == 0) {
+            result->received = stats.datagrams;
+            result->lost = stats.sequence_lost;
+            result->batch_max = stats.batch_max;
+        }
+        ESP_LOGI(TAG, "UDP_BENCH: %d sent in %lld us, %u received, %u lost", result->sent, result->send_time_us,
+                 (unsigned)result->received, (unsigned)result->lost);
+    }
+    udp_client_close(client);
+    udp_server_stop(server);
+
+    vTaskDelete(NULL);
+}
+
+// Answers pings and swallows everything else, so the flood only costs the server its reads
+static int flood_response_handler(const char *request_data, int request_len, char *response_buffer, int response_buffer_size, void *user_data) {
+    if (request_len < 4 || memcmp(request_data, "ping", 4) != 0 || request_len > response_buffer_size) {
+        return 0;
+    }
+    memcpy(response_buffer, request_data, request_len);
+    return request_len;
+}
+
+static volatile bool flood_running = false;
+
+// Sends as fast as the socket takes data until flood_running is cleared
+static void flood_sender_task(void *pvParameters) {
+    int sock = (int)(intptr_t)pvParameters;
+    static char chunk[FLOOD_CHUNK];
+    memset(chunk, 'F', sizeof(chunk));
+    while (flood_running) {
+        if (send(sock, chunk, sizeof(chunk), MSG_DONTWAIT) < 0) {
+            vTaskDelay(1);
+        }
+    }
+    close(sock);
+    vTaskDelete(NULL);
+}
+
+static void run_flood(uint16_t port, bool limited, flood_result_t *result) {
+    server_options_t options = {
+        .max_clients = 4,
+        .max_connections = 4,
+    };
+    if (limited) {
+        options.ip_receive_rate.rate = FLOOD_IP_RATE;
+        options.max_connections_per_ip = 1;
+    }
+    tcp_server_t *server = tcp_server_start(port, NULL, flood_response_handler, NULL, &options);
+    if (!server) {
+        ESP_LOGE(TAG, "FLOOD_SERVER_FAILED");
+        return;
+    }
+
+    // The flooder comes from 127.0.0.1 and the pinger from the AP address, so each has its own bucket
+    struct sockaddr_in flood_addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+    };
+    inet_pton(AF_INET, "127.0.0.1", &flood_addr.sin_addr);
+    int flood_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (flood_sock < 0 || connect(flood_sock, (struct sockaddr *)&flood_addr, sizeof(flood_addr)) != 0) {
+        ESP_LOGE(TAG, "FLOOD_CONNECT_FAILED");
+        if (flood_sock >= 0) {
+            close(flood_sock);
+        }
+        tcp_server_stop(server, 0);
+        return;
+    }
+    flood_running = true;
+    xTaskCreate(flood_sender_task, "tcp_flood_sender", 2048, (void *)(intptr_t)flood_sock, 5, NULL);
+    vTaskDelay(pdMS_TO_TICKS(200));
+
+    // A second connection from the flooding address is over the per-IP limit when limits are on
+    int extra_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (extra_sock >= 0) {
+        connect(extra_sock, (struct sockaddr *)&flood_addr, sizeof(flood_addr));
+    }
+
+    int ping_sock = connect_benchmark_server(port);
+    if (ping_sock >= 0) {
+        static char buffer[64];
+        for (int round = 0; round < FLOOD_PINGS; round++) {
+            int64_t start = esp_timer_get_time();
+            if (send(ping_sock, "ping", 4, 0) != 4 || recv(ping_sock, buffer, sizeof(buffer), 0) <= 0) {
+                break;
+            }
+            int64_t elapsed = esp_timer_get_time() - start;
+            result->ping_time_us += elapsed;
+            result->ping_max_us = MAX(result->ping_max_us, elapsed);
+            result->pings++;
+            vTaskDelay(pdMS_TO_TICKS(10));
+        }
+        close(ping_sock);
+    }
+
+    flood_running = false;
+    vTaskDelay(pdMS_TO_TICKS(50));
+    if (extra_sock >= 0) {
+        close(extra_sock);
+    }
+
+    tcp_server_stats_t stats;
+    if (tcp_server_get_stats(server, &stats) == 0) {
+        result->flood_bytes_read = stats.bytes_in;
+        result->throttled = stats.throttled;
+        result->admission_rejected = stats.admission_rejected;
+    }
+    tcp_server_stop(server, 0);
+    ESP_LOGI(TAG, "FLOOD: %s, %d pings in %lld us (max %lld us), %llu bytes read", limited ? "limited" : "unlimited",
+             result->pings, result->ping_time_us, result->ping_max_us, (unsigned long long)result->flood_bytes_read);
+}
+
+void flood_benchmark_task(void *pvParameters) {
+    ESP_LOGI(TAG, "=== STARTING FLOOD BENCHMARK ===");
+    for (int i = 0; i < FLOOD_RUNS; i++) {
+        run_flood(FLOOD_BASE_PORT + i, i > 0, &bench_results.floods[i]);
+    }
+
+    vTaskDelete(NULL);
+}
+
+static const char http_status_body[] = "{\"status\":\"ok\"}";
+
+static int http_status_handler(const http_request_t *request, http_response_t *response, void *user_data) {
+    response->content_type = "application/json";
+    response->body = http_status_body;
+    response->body_len = sizeof(http_status_body) - 1;
+    return 0;
+}
+
+static const http_route_t http_bench_routes[] = {
+    { "GET", "/status", http_status_handler },
+};
+
+static const http_router_t http_bench_router = {
+    .routes = http_bench_routes,
+    .route_count = sizeof(http_bench_routes) / sizeof(http_bench_routes[0]),
+};
+
+static const char http_bench_request[] = "GET /status HTTP/1.1\r\nHost: esp32\r\n\r\n";
+
+// Sends HTTP_BENCH_REQUESTS requests, `depth` per write, and reads until every response arrived
+static void run_http(int depth, http_result_t *result) {
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(HTTP_BENCH_PORT),
+    };
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (sock < 0 || connect(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        ESP_LOGE(TAG, "HTTP_CONNECT_FAILED");
+        if (sock >= 0) {
+            close(sock);
+        }
+        return;
+    }
+
+    static char requests[HTTP_PIPELINE_DEPTH * sizeof(http_bench_request)];
+    static char buffer[1024];
+    int request_len = sizeof(http_bench_request) - 1;
+    for (int i = 0; i < depth; i++) {
+        memcpy(requests + i * request_len, http_bench_request, request_len);
+    }
+
+    // Every response starts with the status line, so counting them counts the responses
+    static const char status_line[] = "HTTP/1.1 200";
+    int64_t start = esp_timer_get_time();
+    int answered = 0;
+    while (answered < HTTP_BENCH_REQUESTS) {
+        if (send(sock, requests, depth * request_len, 0) != depth * request_len) {
+            break;
+        }
+        int pending = depth;
+        int kept = 0;
+        while (pending > 0) {
+            int received = recv(sock, buffer + kept, sizeof(buffer) - kept - 1, 0);
+            if (received <= 0) {
+                break;
+            }
+            int len = kept + received;
+            buffer[len] = '\0';
+            char *p = buffer;
+            char *found;
+            while (pending > 0 && (found = strstr(p, status_line)) != NULL) {
+                pending--;
+                p = found + sizeof(status_line) - 1;
+            }
+            // Keep a tail that may hold the start of a status line split across reads
+            kept = MIN((int)(buffer + len - p), (int)sizeof(status_line) - 2);
+            memmove(buffer, buffer + len - kept, kept);
+        }
+        if (pending > 0) {
+            break;
+        }
+        answered += depth;
+    }
+    result->time_us = esp_timer_get_time() - start;
+    result->requests = answered;
+    close(sock);
+
+    ESP_LOGI(TAG, "HTTP: depth %d, %d requests in %lld us", depth, result->requests, result->time_us);
+}
+
+void http_benchmark_task(void *pvParameters) {
+    ESP_LOGI(TAG, "=== STARTING HTTP BENCHMARK ===");
+    server_options_t options = {
+        .max_clients = 2,
+        .max_connections = 2,
+    };
+    tcp_server_t *server = http_server_start(HTTP_BENCH_PORT, NULL, &http_bench_router, &options);
+    if (!server) {
+        ESP_LOGE(TAG, "HTTP_SERVER_FAILED");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    run_http(1, &bench_results.http_keep_alive);
+    run_http(HTTP_PIPELINE_DEPTH, &bench_results.http_pipelined);
+
+    tcp_server_stop(server, 0);
+    vTaskDelete(NULL);
+}
+
+// Echoes a newline-framed message back with its newline
+static int line_echo_response_handler(const char *request_data, int request_len, char *response_buffer, int response_buffer_size, void *user_data) {
+    if (request_len + 1 > response_buffer_size) {
+        return -1;
+    }
+    memcpy(response_buffer, request_data, request_len);
+    response_buffer[request_len] = '\n';
+    return request_len + 1;
+}
+
+// Never answers, so the requests of a pipelined client stay outstanding
+static int silent_response_handler(const char *request_data, int request_len, char *response_buffer, int response_buffer_size, void *user_data) {
+    return -1;
+}
+
+// Counts completed requests; runs on the client's receiver task
+static void pipeline_response_handler(void *context, const char *response, int response_len, void *user_data) {
+    if (response_len >= 0) {
+        __atomic_add_fetch((int *)user_data, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Counts failed requests; runs on the client's receiver task
+static void pipeline_failure_handler(void *context, const char *response, int response_len, void *user_data) {
+    if (response_len < 0) {
+        __atomic_add_fetch((int *)user_data, 1, __ATOMIC_RELAXED);
+    }
+}
+
+// Stops the silent server while the benchmark task waits for a slot in a full window
+static void pipeline_drop_task(void *pvParameters) {
+    vTaskDelay(pdMS_TO_TICKS(PIPELINE_DROP_DELAY_MS));
+    tcp_server_stop((tcp_server_t *)pvParameters, 0);
+    vTaskDelete(NULL);
+}
+
+void pipeline_benchmark_task(void *pvParameters) {
+    ESP_LOGI(TAG, "=== STARTING PIPELINED CLIENT BENCHMARK ===");
+    pipeline_result_t *result = &bench_results.pipeline;
+    server_options_t options = {
+        .max_clients = 2,
+        .max_connections = 2,
+        .framer = { .type = FRAMER_DELIMITER },
+    };
+    tcp_server_t *server = tcp_server_start(PIPELINE_BENCH_PORT, NULL, line_echo_response_handler, NULL, &options);
+    tcp_client_t *conn = server ? tcp_client_connect("127.0.0.1", PIPELINE_BENCH_PORT, NULL, 1000) : NULL;
+    if (!conn) {
+        ESP_LOGE(TAG, "PIPELINE_SETUP_FAILED");
+        tcp_server_stop(server, 0);
+        vTaskDelete(NULL);
+        return;
+    }
+
+    static const char request[] = "pipelined request\n";
+    char buffer[64];
+
+    // One request per round trip, as client_send_func() does
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < PIPELINE_REQUESTS; i++) {
+        if (tcp_client_send(conn, request, sizeof(request) - 1) < 0) {
+            break;
+        }
+        int received = 0;
+        while (received < (int)sizeof(request) - 1) {
+            int len = tcp_client_recv(conn, buffer + received, sizeof(buffer) - received, 1000);
+            if (len <= 0) {
+                break;
+            }
+            received += len;
+        }
+        if (received < (int)sizeof(request) - 1) {
+            break;
+        }
+        result->sync_requests++;
+    }
+    result->sync_time_us = esp_timer_get_time() - start;
+
+    // The same requests with up to PIPELINE_IN_FLIGHT on the wire
+    static int completed = 0;
+    tcp_client_async_options_t async_options = {
+        .framer = { .type = FRAMER_DELIMITER },
+        .callback = pipeline_response_handler,
+        .user_data = &completed,
+        .max_in_flight = PIPELINE_IN_FLIGHT,
+    };
+    if (tcp_client_start_async(conn, &async_options) == 0) {
+        start = esp_timer_get_time();
+        for (int i = 0; i < PIPELINE_REQUESTS; i++) {
+            if (tcp_client_send_async(conn, request, sizeof(request) - 1, NULL, 1000) < 0) {
+                break;
+            }
+        }
+        tcp_client_flush(conn, 5000);
+        result->async_time_us = esp_timer_get_time() - start;
+        result->async_requests = __atomic_load_n(&completed, __ATOMIC_RELAXED);
+    }
+
+    tcp_client_close(conn);
+    tcp_server_stop(server, 0);
+
+    // The window fills against a server that never answers; stopping it must fail the outstanding
+    // requests and the sender waiting for a slot instead of hanging the client
+    static int failed = 0;
+    async_options.callback = pipeline_failure_handler;
+    async_options.user_data = &failed;
+    server = tcp_server_start(PIPELINE_BENCH_PORT, NULL, silent_response_handler, NULL, &options);
+    conn = server ? tcp_client_connect("127.0.0.1", PIPELINE_BENCH_PORT, NULL, 1000) : NULL;
+    if (conn && tcp_client_start_async(conn, &async_options) == 0) {
+        for (int i = 0; i < PIPELINE_IN_FLIGHT; i++) {
+            tcp_client_send_async(conn, request, sizeof(request) - 1, NULL, 0);
+        }
+        if (xTaskCreate(pipeline_drop_task, "tcp_pipeline_drop", 4096, server, 5, NULL) != pdPASS) {
+            tcp_server_stop(server, 0);
+        }
+        start = esp_timer_get_time();
+        if (tcp_client_send_async(conn, request, sizeof(request) - 1, NULL, 0) < 0) {
+            result->drop_time_us = esp_timer_get_time() - start;
+        }
+        tcp_client_flush(conn, 1000);
+        result->drop_failed = __atomic_load_n(&failed, __ATOMIC_RELAXED);
+    } else {
+        ESP_LOGE(TAG, "PIPELINE_DROP_SETUP_FAILED");
+        tcp_server_stop(server, 0);
+    }
+    tcp_client_close(conn);
+
+    ESP_LOGI(TAG, "PIPELINE: %d sync requests in %lld us, %d async in %lld us, %d failed on drop", result->sync_requests,
+             result->sync_time_us, result->async_requests, result->async_time_us, result->drop_failed);
+    vTaskDelete(NULL);
+}
+
+// Reads a whole newline-terminated echo; returns 0 when the server closed the connection, -1 on timeout
+static int read_echo(tcp_client_t *conn, const char *expected, int timeout_ms) {
+    char buffer[32];
+    int expected_len = strlen(expected);
+    int received = 0;
+    while (received < expected_len) {
+        int len = tcp_client_recv(conn, buffer + received, sizeof(buffer) - received, timeout_ms);
+        if (len <= 0) {
+            return len;
+        }
+        received += len;
+    }
+    return received == expected_len && memcmp(buffer, expected, expected_len) == 0 ? received : -1;
+}
+
+void read_timeout_task(void *pvParameters) {
+    ESP_LOGI(TAG, "=== STARTING READ TIMEOUT CHECK ===");
+    read_timeout_result_t *result = &bench_results.read_timeout;
+    server_options_t options = {
+        .max_clients = 2,
+        .max_connections = 2,
+        .framer = { .type = FRAMER_DELIMITER },
+        .read_timeout_ms = READ_TIMEOUT_MS,
+    };
+    tcp_server_t *server = tcp_server_start(READ_TIMEOUT_PORT, NULL, line_echo_response_handler, NULL, &options);
+    tcp_client_t *completed = server ? tcp_client_connect("127.0.0.1", READ_TIMEOUT_PORT, NULL, 1000) : NULL;
+    tcp_client_t *partial = server ? tcp_client_connect("127.0.0.1", READ_TIMEOUT_PORT, NULL, 1000) : NULL;
+    if (!completed || !partial) {
+        ESP_LOGE(TAG, "READ_TIMEOUT_SETUP_FAILED");
+    } else {
+        // Both start a message; only one finishes it before the timeout
+        tcp_client_send(completed, "half", 4);
+        tcp_client_send(partial, "half", 4);
+        vTaskDelay(pdMS_TO_TICKS(READ_TIMEOUT_MS / 2));
+        tcp_client_send(completed, " done\n", 6);
+        bool echoed = read_echo(completed, "half done\n", 1000) > 0;
+
+        vTaskDelay(pdMS_TO_TICKS(READ_TIMEOUT_MS * 2));
+        tcp_client_send(completed, "again\n", 6);
+        result->completed_kept = echoed && read_echo(completed, "again\n", 1000) > 0;
+        char byte;
+        result->partial_closed = tcp_client_recv(partial, &byte, 1, 1000) == 0;
+    }
+    tcp_client_close(completed);
+    tcp_client_close(partial);
+    tcp_server_stop(server, 0);
+
+    ESP_LOGI(TAG, "READ_TIMEOUT: completed connection %s, partial connection %s",
+             result->completed_kept ? "kept" : "closed", result->partial_closed ? "closed" : "kept");
+    vTaskDelete(NULL);
+}
+
+static int count_response_handler(const char *request_data, int request_len, char *response_buffer, int response_buffer_size, void *user_data) {
+    __atomic_add_fetch((int *)user_data, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static void run_coalesce(bool coalesced, coalesce_result_t *result) {
+    // Nagle off, so every send() becomes its own segment unless the writes are coalesced
+    socket_tuning_t tuning;
+    socket_tuning_profile(SOCKET_PROFILE_LOW_LATENCY, &tuning);
+    tcp_client_t *conn = tcp_client_connect("127.0.0.1", COALESCE_BENCH_PORT, &tuning, 1000);
+    if (!conn || (coalesced && tcp_client_enable_coalescing(conn, NULL) != 0)) {
+        ESP_LOGE(TAG, "COALESCE_SETUP_FAILED");
+        tcp_client_close(conn);
+        return;
+    }
+
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < COALESCE_MESSAGES; i++) {
+        if (tcp_client_write(conn, "PING\n", 5) < 0) {
+            break;
+        }
+        result->messages++;
+    }
+    tcp_client_write_flush(conn);
+    result->time_us = esp_timer_get_time() - start;
+
+    tcp_client_stats_t stats;
+    if (tcp_client_get_stats(conn, &stats) == 0 && stats.syscalls > 0) {
+        uint64_t bytes_per_send = stats.bytes_sent / stats.syscalls;
+        result->syscalls = stats.syscalls;
+        result->segments = stats.syscalls * (uint32_t)((bytes_per_send + COALESCE_MSS - 1) / COALESCE_MSS);
+    }
+    tcp_client_close(conn);
+    ESP_LOGI(TAG, "COALESCE: %s, %d messages in %lld us, %u syscalls", coalesced ? "coalesced" : "direct",
+             result->messages, result->time_us, (unsigned)result->syscalls);
+}
+
+void coalesce_benchmark_task(void *pvParameters) {
+    ESP_LOGI(TAG, "=== STARTING WRITE COALESCING BENCHMARK ===");
+    static int received = 0;
+    server_options_t options = {
+        .max_clients = 2,
+        .max_connections = 2,
+        .framer = { .type = FRAMER_DELIMITER },
+    };
+    tcp_server_t *server = tcp_server_start(COALESCE_BENCH_PORT, NULL, count_response_handler, &received, &options);
+    if (!server) {
+        ESP_LOGE(TAG, "COALESCE_SERVER_FAILED");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    run_coalesce(false, &bench_results.coalesce[0]);
+    run_coalesce(true, &bench_results.coalesce[1]);
+
+    vTaskDelay(pdMS_TO_TICKS(100));
+    tcp_server_stop(server, 0);
+    ESP_LOGI(TAG, "COALESCE: server framed %d messages", __atomic_load_n(&received, __ATOMIC_RELAXED));
+    vTaskDelete(NULL);
+}
+
+static tcp_server_t *start_session_server(int *received) {
+    server_options_t options = {
+        .max_clients = 2,
+        .max_connections = 2,
+        .framer = { .type = FRAMER_DELIMITER },
+    };
+    return tcp_server_start(SESSION_BENCH_PORT, NULL, count_response_handler, received, &options);
+}
+
+void session_benchmark_task(void *pvParameters) {
+    ESP_LOGI(TAG, "=== STARTING SESSION BENCHMARK ===");
+    session_result_t *result = &bench_results.session;
+    static int received = 0;
+    tcp_server_t *server = start_session_server(&received);
+    tcp_session_options_t options = {
+        .initial_backoff_ms = 100,
+        .max_backoff_ms = 1000,
+        .connect_timeout_ms = 500,
+        .queue_size = 1024,
+    };
+    tcp_session_t *session = server ? tcp_session_start("127.0.0.1", SESSION_BENCH_PORT, &options) : NULL;
+    if (!session) {
+        ESP_LOGE(TAG, "SESSION_SETUP_FAILED");
+        tcp_server_stop(server, 0);
+        vTaskDelete(NULL);
+        return;
+    }
+    vTaskDelay(pdMS_TO_TICKS(200));
+
+    char message[32];
+    for (int i = 0; i < SESSION_MESSAGES; i++) {
+        int len = snprintf(message, sizeof(message), "session %d\n", i);
+        tcp_session_send(session, message, len);
+    }
+    vTaskDelay(pdMS_TO_TICKS(100));
+    result->delivered_before = __atomic_load_n(&received, __ATOMIC_RELAXED);
+
+    // Drop the session's connection and keep sending through the outage
+    tcp_server_stop(server, 0);
+    vTaskDelay(pdMS_TO_TICKS(50));
+    for (int i = 0; i < SESSION_MESSAGES; i++) {
+        int len = snprintf(message, sizeof(message), "held %d\n", i);
+        tcp_session_send(session, message, len);
+    }
+    vTaskDelay(pdMS_TO_TICKS(SESSION_OUTAGE_MS));
+
+    __atomic_store_n(&received, 0, __ATOMIC_RELAXED);
+    int64_t restart = esp_timer_get_time();
+    server = start_session_server(&received);
+    while (server && __atomic_load_n(&received, __ATOMIC_RELAXED) < SESSION_MESSAGES &&
+           esp_timer_get_time() - restart < 5000000) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    result->recovery_time_us = esp_timer_get_time() - restart;
+    result->delivered_after = __atomic_load_n(&received, __ATOMIC_RELAXED);
+    tcp_session_get_stats(session, &result->stats);
+
+    tcp_session_stop(session);
+    tcp_server_stop(server, 0);
+    ESP_LOGI(TAG, "SESSION: %d + %d messages delivered, recovered in %lld us, %u reconnect(s)",
+             result->delivered_before, result->delivered_after, result->recovery_time_us,
+             (unsigned)result->stats.reconnects);
+    vTaskDelete(NULL);
+}
+
 // Function to print comprehensive benchmark results
+static int scan_bench_ports[] = {8080, 80, 0};
+static int64_t scan_started_us;
+
+// Logs devices as the scan streams them, so none has to wait for the whole range
+static void scan_device_found(const network_device_t *device, void *user_data) {
+    if (bench_results.network_first_device_us == 0) {
+        bench_results.network_first_device_us = esp_timer_get_time() - scan_started_us;
+    }
+    ESP_LOGI(TAG, "  Host: %s, Port: %d, Status: %s", device->ipv4, device->open_ports[0],
+             device->online ? "ONLINE" : "OFFLINE");
+}
+
+// Scans the benchmark range once per concurrency level with a single attempt per probe. Discovery
+// is skipped so the silent addresses are still probed and the connect window is what gets measured.
+static void run_scan_levels(void) {
+    int port_count = sizeof(scan_bench_ports) / sizeof(scan_bench_ports[0]) - 1;
+    for (int i = 0; i < SCAN_LEVEL_COUNT; i++) {
+        network_scan_options_t options = {
+            .timeout = SCAN_BENCH_TIMEOUT,
+            .start_ip = SCAN_BENCH_START_IP,
+            .end_ip = SCAN_BENCH_END_IP,
+            .ports = scan_bench_ports,
+            .retry_count = 1,
+            .concurrency = scan_levels[i],
+            .skip_discovery = true,
+        };
+        scan_result_t *result = &bench_results.scans[i];
+        int64_t start = esp_timer_get_time();
+        network_scan_result_t *scan = network_scan(&options);
+        result->time_us = esp_timer_get_time() - start;
+        result->probes = SCAN_BENCH_HOSTS * port_count;
+        result->devices = scan ? scan->device_count : 0;
+        free_scan_result(scan);
+        ESP_LOGI(TAG, "SCAN_LEVEL: %d in flight, %d probes in %lld us", scan_levels[i], result->probes, result->time_us);
+    }
+}
+
+// Scans the benchmark range into the compact form, then expands it so both forms hold the same devices
+static void run_scan_footprint(void) {
+    network_scan_options_t options = {
+        .timeout = SCAN_BENCH_TIMEOUT,
+        .start_ip = SCAN_BENCH_START_IP,
+        .end_ip = SCAN_BENCH_END_IP,
+        .ports = scan_bench_ports,
+        .retry_count = 1,
+    };
+    scan_footprint_t *result = &bench_results.scan_footprint;
+    network_scan_compact_t *compact = network_scan_compact(&options);
+    if (!compact) {
+        ESP_LOGE(TAG, "SCAN_FOOTPRINT_FAILED");
+        return;
+    }
+    result->devices = compact->host_count;
+    result->compact_arena_bytes = (int)compact->arena_bytes;
+    for (const network_host_t *host = compact->hosts; host; host = host->next) {
+        result->compact_bytes += sizeof(network_host_t) + host->port_count * sizeof(uint16_t);
+    }
+
+    int free_before = (int)esp_get_free_heap_size();
+    network_scan_result_t *expanded = network_scan_expand(compact);
+    result->legacy_bytes = free_before - (int)esp_get_free_heap_size();
+    free_scan_result(expanded);
+    network_scan_compact_free(compact);
+    ESP_LOGI(TAG, "SCAN_FOOTPRINT: %d device(s), %d bytes expanded, %d bytes compact (%d byte arena)",
+             result->devices, result->legacy_bytes, result->compact_bytes, result->compact_arena_bytes);
+}
+
+// Fills an inventory with a full scan of the benchmark range, then keeps it current with delta
+// rescans that recheck the known hosts and sweep INVENTORY_SWEEP further addresses each
+static void run_inventory(void) {
+    network_scan_options_t options = {
+        .timeout = SCAN_BENCH_TIMEOUT,
+        .start_ip = SCAN_BENCH_START_IP,
+        .end_ip = SCAN_BENCH_END_IP,
+        .ports = scan_bench_ports,
+        .retry_count = 1,
+        .skip_discovery = true,
+        .sweep_hosts = INVENTORY_SWEEP,
+    };
+    inventory_result_t *result = &bench_results.inventory;
+    network_inventory_t *inventory = network_inventory_create();
+    if (!inventory || network_inventory_scan(inventory, &options) != 0) {
+        ESP_LOGE(TAG, "INVENTORY_FAILED");
+        network_inventory_free(inventory);
+        return;
+    }
+    result->full_time_us = inventory->sweep_time_us;
+
+    for (int i = 0; i < INVENTORY_RESCANS; i++) {
+        int64_t start = esp_timer_get_time();
+        if (network_inventory_rescan(inventory, &options) != 0) {
+            break;
+        }
+        result->rescan_time_us += esp_timer_get_time() - start;
+        result->rescans++;
+    }
+    result->devices = inventory->device_count;
+    network_inventory_free(inventory);
+    ESP_LOGI(TAG, "INVENTORY: %d device(s), full scan %lld us, %d rescans in %lld us",
+             result->devices, result->full_time_us, result->rescans, result->rescan_time_us);
+}
+
+// DNS cache run: capacity for two names, short TTLs so expiry is seen within the run
+#define DNS_BENCH_CAPACITY     2
+#define DNS_BENCH_TTL_MS       200
+#define DNS_BENCH_NEGATIVE_MS  100
+
+// Stub resolver: "missing.bench" fails, any other name resolves to loopback. Counts its calls.
+static int dns_stub_resolver(const char *host, uint32_t *addr, void *user_data) {
+    (*(int *)user_data)++;
+    if (strcmp(host, "missing.bench") == 0) {
+        return -1;
+    }
+    *addr = htonl(INADDR_LOOPBACK);
+    return 0;
+}
+
+static void check_dns(dns_result_t *result, const char *what, int calls, int expected) {
+    result->checks++;
+    if (calls == expected) {
+        result->passed++;
+    } else {
+        ESP_LOGE(TAG, "DNS_CHECK_FAILED: %s, %d resolver call(s) instead of %d", what, calls, expected);
+    }
+}
+
+// Runs the cache against the stub resolver to check TTL expiry, negative entries and LRU eviction,
+// then restores the default configuration
+static void run_dns_cache(void) {
+    dns_result_t *result = &bench_results.dns;
+    int calls = 0;
+    uint32_t addr;
+    dns_cache_options_t options = {
+        .capacity = DNS_BENCH_CAPACITY,
+        .ttl_ms = DNS_BENCH_TTL_MS,
+        .negative_ttl_ms = DNS_BENCH_NEGATIVE_MS,
+        .resolver = dns_stub_resolver,
+        .resolver_data = &calls,
+    };
+    if (dns_cache_configure(&options) != 0) {
+        ESP_LOGE(TAG, "DNS_SETUP_FAILED");
+        return;
+    }
+
+    for (int i = 0; i < 4; i++) {
+        dns_resolve("a.bench", &addr);
+    }
+    check_dns(result, "repeated name", calls, 1);
+    for (int i = 0; i < 4; i++) {
+        dns_resolve("missing.bench", &addr);
+    }
+    check_dns(result, "repeated failure", calls, 2);
+
+    vTaskDelay(pdMS_TO_TICKS(DNS_BENCH_NEGATIVE_MS + 20));
+    dns_resolve("missing.bench", &addr);
+    check_dns(result, "negative entry expired", calls, 3);
+    vTaskDelay(pdMS_TO_TICKS(DNS_BENCH_TTL_MS));
+    dns_resolve("a.bench", &addr);
+    check_dns(result, "entry expired", calls, 4);
+
+    // "b.bench" is the least recently used name when "c.bench" needs room; "a.bench" stays cached
+    dns_cache_flush();
+    dns_resolve("a.bench", &addr);
+    dns_resolve("b.bench", &addr);
+    dns_resolve("a.bench", &addr);
+    dns_resolve("c.bench", &addr);
+    dns_resolve("a.bench", &addr);
+    check_dns(result, "recently used name kept", calls, 7);
+    dns_resolve("b.bench", &addr);
+    check_dns(result, "least recently used name evicted", calls, 8);
+
+    dns_cache_get_stats(&result->stats);
+    dns_cache_configure(NULL);
+    ESP_LOGI(TAG, "DNS_CACHE: %d/%d checks passed", result->passed, result->checks);
+}
+
 void print_benchmark_results(void) {
     ESP_LOGI(TAG, "\n");
     ESP_LOGI(TAG, "========================================");
@@ -184,6 +1450,10 @@ void print_benchmark_results(void) {
              bench_results.wifi_init_time_us, bench_results.wifi_init_time_us / 1000.0);
     ESP_LOGI(TAG, "  Server Start:       %lld us (%.2f ms)", 
              bench_results.server_start_time_us, bench_results.server_start_time_us / 1000.0);
+    ESP_LOGI(TAG, "  Server Reconfigure: %lld us (%.2f ms)", 
+             bench_results.server_reconfigure_time_us, bench_results.server_reconfigure_time_us / 1000.0);
+    ESP_LOGI(TAG, "  Server Stop (x%d):   %lld us (%.2f ms)", WORKER_CONFIG_COUNT,
+             bench_results.server_stop_time_us, bench_results.server_stop_time_us / 1000.0);
     ESP_LOGI(TAG, "");
     
     ESP_LOGI(TAG, "CONNECTION TIMINGS:");
@@ -211,6 +1481,175 @@ void print_benchmark_results(void) {
     ESP_LOGI(TAG, "  Send Throughput:    %.2f Kbps", bench_results.throughput_kbps);
     ESP_LOGI(TAG, "  Network Scan:       %lld us (%.2f ms)", 
              bench_results.network_scan_time_us, bench_results.network_scan_time_us / 1000.0);
+    ESP_LOGI(TAG, "    Discovery:        %lld us (%.2f ms), %d live host(s)",
+             bench_results.network_discovery_time_us, bench_results.network_discovery_time_us / 1000.0,
+             bench_results.network_hosts_alive);
+    ESP_LOGI(TAG, "    Port Probing:     %lld us (%.2f ms)",
+             bench_results.network_probe_time_us, bench_results.network_probe_time_us / 1000.0);
+    ESP_LOGI(TAG, "    First Device:     %lld us (%.2f ms)",
+             bench_results.network_first_device_us, bench_results.network_first_device_us / 1000.0);
+    ESP_LOGI(TAG, "");
+
+    ESP_LOGI(TAG, "CONCURRENT CLIENTS:");
+    ESP_LOGI(TAG, "  Clients Connected:  %d/%d", bench_results.concurrent.clients, CONCURRENT_CLIENTS);
+    ESP_LOGI(TAG, "  Round Trips:        %d", bench_results.concurrent.round_trips);
+    ESP_LOGI(TAG, "  Total Time:         %lld us (%.2f ms)", 
+             bench_results.concurrent.time_us, bench_results.concurrent.time_us / 1000.0);
+    if (bench_results.concurrent.round_trips > 0) {
+        ESP_LOGI(TAG, "  Avg Round Trip:     %.2f us", 
+                 (double)bench_results.concurrent.time_us / bench_results.concurrent.round_trips);
+    }
+    ESP_LOGI(TAG, "");
+
+    ESP_LOGI(TAG, "WORKER POOL THROUGHPUT (5 ms handler):");
+    for (int i = 0; i < WORKER_CONFIG_COUNT; i++) {
+        concurrent_result_t *workers = &bench_results.workers[i];
+        double requests_per_sec = workers->time_us > 0 ? workers->round_trips * 1000000.0 / workers->time_us : 0;
+        ESP_LOGI(TAG, "  %d Worker(s):        %d requests in %lld us (%.1f req/s)", 
+                 worker_configs[i], workers->round_trips, workers->time_us, requests_per_sec);
+    }
+    ESP_LOGI(TAG, "");
+    
+    pool_result_t *pool = &bench_results.pool;
+    ESP_LOGI(TAG, "CONNECTION POOL (%d echo requests):", POOL_REQUESTS);
+    if (pool->requests > 0) {
+        ESP_LOGI(TAG, "  Connect Per Request: %.2f us/request", (double)pool->connect_time_us / pool->requests);
+    }
+    if (pool->pooled_requests > 0) {
+        ESP_LOGI(TAG, "  Pooled:             %.2f us/request, %u connect(s)",
+                 (double)pool->pooled_time_us / pool->pooled_requests, (unsigned)pool->pool_connects);
+    }
+    ESP_LOGI(TAG, "");
+
+    ESP_LOGI(TAG, "SOCKET PROFILES (split writes, %d KB chunked download):", PROFILE_BULK_BYTES / 1024);
+    for (int i = 0; i < PROFILE_COUNT; i++) {
+        profile_result_t *profile = &bench_results.profiles[i];
+        double ping_us = profile->pings > 0 ? (double)profile->ping_time_us / profile->pings : 0;
+        double bulk_kbps = profile->bulk_time_us > 0 ? profile->bulk_bytes * 8000.0 / profile->bulk_time_us : 0;
+        ESP_LOGI(TAG, "  %-12s        %.2f us/round trip, %.2f Kbps", socket_profile_name(profile_configs[i]),
+                 ping_us, bulk_kbps);
+    }
+    ESP_LOGI(TAG, "");
+
+    backpressure_result_t *backpressure = &bench_results.backpressure;
+    ESP_LOGI(TAG, "BACKPRESSURE (ping beside a stalled %d KB download):", PROFILE_BULK_BYTES / 1024);
+    if (backpressure->pings > 0) {
+        ESP_LOGI(TAG, "  Avg Round Trip:     %.2f us", (double)backpressure->ping_time_us / backpressure->pings);
+    }
+    ESP_LOGI(TAG, "  Download:           %d bytes, %u bytes max queued, %u read pauses",
+             backpressure->bulk_bytes, (unsigned)backpressure->queue_max_bytes, (unsigned)backpressure->read_pauses);
+    ESP_LOGI(TAG, "");
+
+    udp_result_t *udp = &bench_results.udp;
+    ESP_LOGI(TAG, "UDP TELEMETRY (%d x %d byte datagrams, loopback):", UDP_BENCH_DATAGRAMS, UDP_BENCH_PAYLOAD);
+    if (udp->send_time_us > 0) {
+        ESP_LOGI(TAG, "  Send Rate:          %.0f packets/s", udp->sent * 1000000.0 / udp->send_time_us);
+    }
+    ESP_LOGI(TAG, "  Delivery:           %u of %d received, %u lost, up to %u per batch",
+             (unsigned)udp->received, udp->sent, (unsigned)udp->lost, (unsigned)udp->batch_max);
+    ESP_LOGI(TAG, "");
+
+    ESP_LOGI(TAG, "FLOOD (ping beside a flooding client, %d bytes/s per-IP limit):", FLOOD_IP_RATE);
+    for (int i = 0; i < FLOOD_RUNS; i++) {
+        flood_result_t *flood = &bench_results.floods[i];
+        double ping_us = flood->pings > 0 ? (double)flood->ping_time_us / flood->pings : 0;
+        ESP_LOGI(TAG, "  %-9s           %.2f us avg, %lld us max, %u throttled, %u rejected",
+                 i > 0 ? "Limited" : "Unlimited", ping_us, flood->ping_max_us,
+                 (unsigned)flood->throttled, (unsigned)flood->admission_rejected);
+    }
+    ESP_LOGI(TAG, "");
+
+    ESP_LOGI(TAG, "HTTP (keep-alive GET /status, loopback):");
+    http_result_t *http_runs[] = { &bench_results.http_keep_alive, &bench_results.http_pipelined };
+    for (int i = 0; i < 2; i++) {
+        if (http_runs[i]->time_us > 0) {
+            ESP_LOGI(TAG, "  Depth %-2d            %.0f requests/s (%d requests)", i > 0 ? HTTP_PIPELINE_DEPTH : 1,
+                     http_runs[i]->requests * 1000000.0 / http_runs[i]->time_us, http_runs[i]->requests);
+        }
+    }
+    ESP_LOGI(TAG, "");
+    
+    ESP_LOGI(TAG, "WRITE COALESCING (%d x 5 byte messages, Nagle off):", COALESCE_MESSAGES);
+    for (int i = 0; i < 2; i++) {
+        coalesce_result_t *coalesce = &bench_results.coalesce[i];
+        if (coalesce->messages > 0) {
+            ESP_LOGI(TAG, "  %-9s           %.3f syscalls/message, %.3f segments/message, %lld us",
+                     i > 0 ? "Coalesced" : "Direct", (double)coalesce->syscalls / coalesce->messages,
+                     (double)coalesce->segments / coalesce->messages, coalesce->time_us);
+        }
+    }
+    ESP_LOGI(TAG, "");
+
+    session_result_t *session = &bench_results.session;
+    ESP_LOGI(TAG, "SESSION (%d messages held through a %d ms outage):", SESSION_MESSAGES, SESSION_OUTAGE_MS);
+    ESP_LOGI(TAG, "  Delivered:          %d before, %d replayed after, %u dropped",
+             session->delivered_before, session->delivered_after, (unsigned)session->stats.dropped);
+    ESP_LOGI(TAG, "  Recovery:           %lld us after restart, %u reconnect(s), %u failed attempt(s)",
+             session->recovery_time_us, (unsigned)session->stats.reconnects, (unsigned)session->stats.connect_failures);
+    ESP_LOGI(TAG, "  Downtime:           %llu ms", (unsigned long long)session->stats.downtime_ms);
+    ESP_LOGI(TAG, "");
+
+    ESP_LOGI(TAG, "SCAN CONCURRENCY (%s - %s, %d ms timeout):", SCAN_BENCH_START_IP, SCAN_BENCH_END_IP, SCAN_BENCH_TIMEOUT);
+    for (int i = 0; i < SCAN_LEVEL_COUNT; i++) {
+        scan_result_t *scan = &bench_results.scans[i];
+        if (scan->time_us > 0) {
+            ESP_LOGI(TAG, "  %d In Flight:         %.1f probes/s, %d device(s)", scan_levels[i],
+                     scan->probes * 1000000.0 / scan->time_us, scan->devices);
+        }
+    }
+    ESP_LOGI(TAG, "");
+
+    scan_footprint_t *footprint = &bench_results.scan_footprint;
+    if (footprint->devices > 0) {
+        ESP_LOGI(TAG, "SCAN RESULT FOOTPRINT (%d device(s)):", footprint->devices);
+        ESP_LOGI(TAG, "  Device Structs:     %.1f bytes/device", (double)footprint->legacy_bytes / footprint->devices);
+        ESP_LOGI(TAG, "  Compact Records:    %.1f bytes/device, %d byte arena in total",
+                 (double)footprint->compact_bytes / footprint->devices, footprint->compact_arena_bytes);
+        ESP_LOGI(TAG, "");
+    }
+
+    inventory_result_t *inventory = &bench_results.inventory;
+    if (inventory->rescans > 0) {
+        ESP_LOGI(TAG, "INVENTORY (%s - %s, %d address sweep per rescan):", SCAN_BENCH_START_IP, SCAN_BENCH_END_IP,
+                 INVENTORY_SWEEP);
+        ESP_LOGI(TAG, "  Full Scan:          %lld us, %d device(s)", inventory->full_time_us, inventory->devices);
+        ESP_LOGI(TAG, "  Delta Rescan:       %lld us avg (%.1f%% of a full scan)", inventory->rescan_time_us / inventory->rescans,
+                 inventory->full_time_us > 0 ? 100.0 * inventory->rescan_time_us / inventory->rescans / inventory->full_time_us : 0);
+        ESP_LOGI(TAG, "");
+    }
+
+    dns_result_t *dns = &bench_results.dns;
+    if (dns->checks > 0) {
+        ESP_LOGI(TAG, "DNS CACHE (stub resolver, %d names, %d ms TTL, %d ms negative TTL):", DNS_BENCH_CAPACITY,
+                 DNS_BENCH_TTL_MS, DNS_BENCH_NEGATIVE_MS);
+        ESP_LOGI(TAG, "  Checks Passed:      %d/%d", dns->passed, dns->checks);
+        ESP_LOGI(TAG, "  Hits/Negative/Miss: %lu/%lu/%lu, %lu eviction(s)", (unsigned long)dns->stats.hits,
+                 (unsigned long)dns->stats.negative_hits, (unsigned long)dns->stats.misses,
+                 (unsigned long)dns->stats.evictions);
+        ESP_LOGI(TAG, "");
+    }
+
+    pipeline_result_t *pipeline = &bench_results.pipeline;
+    ESP_LOGI(TAG, "PIPELINED CLIENT (%d newline-framed echoes, loopback):", PIPELINE_REQUESTS);
+    if (pipeline->sync_time_us > 0) {
+        ESP_LOGI(TAG, "  Send Then Recv:     %.0f requests/s", pipeline->sync_requests * 1000000.0 / pipeline->sync_time_us);
+    }
+    if (pipeline->async_time_us > 0) {
+        ESP_LOGI(TAG, "  %d In Flight:        %.0f requests/s", PIPELINE_IN_FLIGHT,
+                 pipeline->async_requests * 1000000.0 / pipeline->async_time_us);
+    }
+    if (pipeline->drop_time_us > 0) {
+        ESP_LOGI(TAG, "  Server Dropped:     %d/%d failed, blocked sender released after %lld ms", pipeline->drop_failed,
+                 PIPELINE_IN_FLIGHT, pipeline->drop_time_us / 1000);
+    } else {
+        ESP_LOGI(TAG, "  Server Dropped:     blocked sender was not released");
+    }
+    ESP_LOGI(TAG, "");
+
+    read_timeout_result_t *read_timeout = &bench_results.read_timeout;
+    ESP_LOGI(TAG, "READ TIMEOUT (%d ms, no idle timeout):", READ_TIMEOUT_MS);
+    ESP_LOGI(TAG, "  Completed, Quiet:   %s", read_timeout->completed_kept ? "kept open" : "closed (FAILED)");
+    ESP_LOGI(TAG, "  Left Partial:       %s", read_timeout->partial_closed ? "closed" : "kept open (FAILED)");
     ESP_LOGI(TAG, "");
     
     // Calculate total benchmark time
@@ -223,6 +1662,34 @@ void print_benchmark_results(void) {
                         bench_results.network_scan_time_us + 
                         bench_results.client_cleanup_time_us;
     
+    tcp_server_stats_t server_stats;
+    if (tcp_server_get_stats(echo_server, &server_stats) == 0) {
+        ESP_LOGI(TAG, "SERVER STATISTICS:");
+        ESP_LOGI(TAG, "  Connections:        %u accepted, %u active, %u rejected",
+                 (unsigned)server_stats.accepted, (unsigned)server_stats.active, (unsigned)server_stats.rejected);
+        ESP_LOGI(TAG, "  Bytes In/Out:       %llu / %llu",
+                 (unsigned long long)server_stats.bytes_in, (unsigned long long)server_stats.bytes_out);
+        ESP_LOGI(TAG, "  Output Queue:       %u bytes queued, %u max, %u read pauses",
+                 (unsigned)server_stats.queued_bytes, (unsigned)server_stats.queue_max_bytes,
+                 (unsigned)server_stats.read_pauses);
+        ESP_LOGI(TAG, "  Timeouts:           %u idle, %u read",
+                 (unsigned)server_stats.idle_timeouts, (unsigned)server_stats.read_timeouts);
+        if (server_stats.callbacks > 0) {
+            ESP_LOGI(TAG, "  Callback Time:      %.2f us avg, %u us max",
+                     (double)server_stats.callback_time_us / server_stats.callbacks, (unsigned)server_stats.callback_max_us);
+        }
+        ESP_LOGI(TAG, "  Latency p50/p99:    %u / %u us",
+                 (unsigned)server_stats.latency_p50_us, (unsigned)server_stats.latency_p99_us);
+        if (server_stats.closed > 0) {
+            ESP_LOGI(TAG, "  Connection Life:    %.1f ms avg, %u ms max",
+                     (double)server_stats.lifetime_total_ms / server_stats.closed, (unsigned)server_stats.lifetime_max_ms);
+        }
+        ESP_LOGI(TAG, "  Buffer Pool:        %d x %d bytes, high water %d, %u alloc failures",
+                 server_stats.buffers.block_count, server_stats.buffers.block_size,
+                 server_stats.buffers.high_water, (unsigned)server_stats.buffers.alloc_failures);
+        ESP_LOGI(TAG, "");
+    }
+    
     ESP_LOGI(TAG, "SUMMARY:");
     ESP_LOGI(TAG, "  Total Benchmark:    %lld us (%.2f ms)", total_time, total_time / 1000.0);
     ESP_LOGI(TAG, "  Memory Usage:       %d bytes free", (int)esp_get_free_heap_size());
@@ -256,35 +1723,98 @@ void app_main(void) {
     
     // Benchmark TCP server start
     int64_t server_start = esp_timer_get_time();
+    server_pool = buffer_pool_create(1024, 8);
     server_options_t server_opts = {
         .keepalive_idle = 30,
         .keepalive_interval = 5,
         .keepalive_count = 3,
-        .max_connections = 5
+        .max_connections = 5,
+        .max_clients = CONCURRENT_CLIENTS + 1,
+        .buffer_pool = server_pool,
+        .idle_timeout_ms = 30000
     };
     
-    int result = tcp_server_start(8080, NULL, echo_response_handler, NULL, &server_opts);
+    echo_server = tcp_server_start(8080, NULL, echo_response_handler, NULL, &server_opts);
     int64_t server_end = esp_timer_get_time();
     bench_results.server_start_time_us = server_end - server_start;
     ESP_LOGI(TAG, "SERVER_START: %lld us", bench_results.server_start_time_us);
     
-    if (result == 0) {
+    if (echo_server) {
         ESP_LOGI(TAG, "TCP server started successfully");
     } else {
         ESP_LOGE(TAG, "Failed to start TCP server");
         return;
     }
     
+    // Start one server per worker pool size for the worker benchmark
+    for (int i = 0; i < WORKER_CONFIG_COUNT; i++) {
+        server_options_t worker_opts = {
+            .max_connections = CONCURRENT_CLIENTS,
+            .max_clients = CONCURRENT_CLIENTS,
+            .worker_count = worker_configs[i],
+            .core_mask = 0x3
+        };
+        worker_servers[i] = tcp_server_start(WORKER_BASE_PORT + i, NULL, slow_echo_response_handler, NULL, &worker_opts);
+        if (!worker_servers[i]) {
+            ESP_LOGE(TAG, "Failed to start worker benchmark server on port %d", WORKER_BASE_PORT + i);
+        }
+    }
+    
     // Create a task to demonstrate client functionality
     xTaskCreate(client_task, "tcp_client_benchmark", 8192, NULL, 5, NULL);
     
     // Wait for client task to complete
     vTaskDelay(pdMS_TO_TICKS(8000));
+
+    xTaskCreate(concurrent_client_task, "tcp_concurrent_benchmark", 4096, NULL, 5, NULL);
+    vTaskDelay(pdMS_TO_TICKS(3000));
+
+    xTaskCreate(profile_benchmark_task, "tcp_profile_benchmark", 4096, NULL, 5, NULL);
+    vTaskDelay(pdMS_TO_TICKS(10000));
+
+    xTaskCreate(udp_benchmark_task, "udp_benchmark", 4096, NULL, 5, NULL);
+    vTaskDelay(pdMS_TO_TICKS(2000));
+
+    xTaskCreate(flood_benchmark_task, "tcp_flood_benchmark", 4096, NULL, 5, NULL);
+    vTaskDelay(pdMS_TO_TICKS(3000));
+
+    xTaskCreate(http_benchmark_task, "http_benchmark", 4096, NULL, 5, NULL);
+    vTaskDelay(pdMS_TO_TICKS(3000));
+
+    xTaskCreate(pipeline_benchmark_task, "tcp_pipeline_benchmark", 4096, NULL, 5, NULL);
+    vTaskDelay(pdMS_TO_TICKS(3000));
+
+    xTaskCreate(read_timeout_task, "tcp_read_timeout", 4096, NULL, 5, NULL);
+    vTaskDelay(pdMS_TO_TICKS(2000));
+
+    xTaskCreate(coalesce_benchmark_task, "tcp_coalesce_benchmark", 4096, NULL, 5, NULL);
+    vTaskDelay(pdMS_TO_TICKS(2000));
+
+    xTaskCreate(session_benchmark_task, "tcp_session_benchmark", 4096, NULL, 5, NULL);
+    vTaskDelay(pdMS_TO_TICKS(4000));
+
+    // Reconfiguring and stopping servers replaces the reboot (and Wi-Fi bring-up) it used to take
+    server_opts.keepalive_idle = 60;
+    int64_t reconfigure_start = esp_timer_get_time();
+    if (tcp_server_update_options(echo_server, &server_opts, 500) != 0) {
+        ESP_LOGE(TAG, "Failed to reconfigure TCP server");
+    }
+    bench_results.server_reconfigure_time_us = esp_timer_get_time() - reconfigure_start;
+    ESP_LOGI(TAG, "SERVER_RECONFIGURE: %lld us", bench_results.server_reconfigure_time_us);
+
+    int64_t stop_start = esp_timer_get_time();
+    for (int i = 0; i < WORKER_CONFIG_COUNT; i++) {
+        tcp_server_stop(worker_servers[i], 500);
+        worker_servers[i] = NULL;
+    }
+    bench_results.server_stop_time_us = esp_timer_get_time() - stop_start;
+    ESP_LOGI(TAG, "SERVER_STOP: %lld us", bench_results.server_stop_time_us);
     
     ESP_LOGI(TAG, "=== STARTING NETWORK SCAN BENCHMARK ===");
     
     // Benchmark network scan
     int64_t scan_start = esp_timer_get_time();
+    scan_started_us = scan_start;
     
     network_scan_options_t *scan_options = malloc(sizeof(network_scan_options_t));
     scan_options->timeout = 1000; 
@@ -292,31 +1822,42 @@ void app_main(void) {
     scan_options->end_ip = "192.168.4.255";
     scan_options->ports = NULL;
     scan_options->retry_count = 3;
+    scan_options->concurrency = 8;
+    scan_options->skip_discovery = false;
+    scan_options->discovery_timeout = 200;
+    scan_options->device_callback = scan_device_found;
+    scan_options->port_callback = NULL;
+    scan_options->user_data = NULL;
+    scan_options->discard_devices = true;
 
+    ESP_LOGI(TAG, "Network scan results:");
     network_scan_result_t *scan_result = network_scan(scan_options);
     int64_t scan_end = esp_timer_get_time();
     bench_results.network_scan_time_us = scan_end - scan_start;
     ESP_LOGI(TAG, "NETWORK_SCAN: %lld us", bench_results.network_scan_time_us);
 
     if (scan_result != NULL) {
-        ESP_LOGI(TAG, "Network scan results (%d devices found):", scan_result->device_count);
-        for (int i = 0; i < scan_result->device_count; i++) {
-            ESP_LOGI(TAG, "  Host: %s, Port: %d, Status: %s",
-                     scan_result->devices[i].ipv4,
-                     scan_result->devices[i].open_ports[0],
-                     scan_result->devices[i].online ? "ONLINE" : "OFFLINE");
-        }
+        bench_results.network_discovery_time_us = scan_result->discovery_time_us;
+        bench_results.network_probe_time_us = scan_result->probe_time_us;
+        bench_results.network_hosts_alive = scan_result->hosts_alive;
+        ESP_LOGI(TAG, "%d devices found", scan_result->devices_found);
         free_scan_result(scan_result);
     } else {
         ESP_LOGI(TAG, "No scan results or scan failed.");
     }
     free(scan_options);
+
+    run_dns_cache();
+    run_scan_levels();
+    run_scan_footprint();
+    run_inventory();
     
     // Wait a bit more for any remaining operations
     vTaskDelay(pdMS_TO_TICKS(2000));
     
     // Print comprehensive benchmark results
     print_benchmark_results();
+    abstrace_dump();
     
     ESP_LOGI(TAG, "=== BENCHMARK COMPLETE ===");
 }
\ No newline at end of file